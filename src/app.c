@@ -1,8 +1,17 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "app.h"
+#include "asset.h"
+#include "debug_utils.h"
+#include "device_select.h"
 #include "log.h"
+#include "pipeline_cache.h"
+#include "shaders.h"
+#include "timer.h"
+#include "upload.h"
 
 static inline uint32_t clamp_u32(uint32_t value, uint32_t min, uint32_t max)
 {
@@ -17,75 +26,148 @@ static inline uint32_t clamp_u32(uint32_t value, uint32_t min, uint32_t max)
     return value;
 }
 
-char* readFile(const char* filename, size_t* fileSize)
+VkResult create_shader_module(VkDevice device, const char* path, VkShaderModule* shaderModule)
 {
-    FILE* fp = fopen(filename, "rb");
-    if (fp == NULL) {
-        LOG_ERROR("Could not open file %s", filename);
-        return NULL;
+    VkResult result;
+
+    AssetView shader;
+    if (!asset_acquire(path, &shader)) {
+        LOG_ERROR("Failed to read shader SPIR-V %s: %s", path, strerror(errno));
+        return VK_RESULT_MAX_ENUM;
     }
 
-    fseek(fp, 0, SEEK_END);
-    *fileSize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    // SPIR-V is a stream of 32-bit words, codeSize has to be a non-zero multiple of 4
+    if (shader.data == NULL || shader.size == 0 || shader.size % 4 != 0) {
+        LOG_ERROR("Invalid shader SPIR-V %s: %zu bytes", path, shader.size);
+        asset_release(&shader);
+        return VK_RESULT_MAX_ENUM;
+    }
 
-    char* buffer = (char*)malloc(*fileSize);
+    // The mapping is page aligned, so it can be handed to the driver as is
+    VkShaderModuleCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = shader.size,
+        .pCode = shader.data };
 
-    if (fread(buffer, 1, *fileSize, fp) != *fileSize) {
-        LOG_ERROR("Could not read file %s completely", filename);
-        free(buffer);
-        fclose(fp);
-        return NULL;
+    result = vkCreateShaderModule(device, &createInfo, NULL, shaderModule);
+    size_t shaderSize = shader.size;
+    asset_release(&shader);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create shader module %s: %d", path, result);
+        return result;
     }
+    LOG_DEBUG("Shader module created successfully. Shader size: %zu bytes", shaderSize);
 
-    fclose(fp);
-    return buffer;
+    return result;
 }
 
-static const char* enabledLayers[] = { "VK_LAYER_KHRONOS_validation" };
-static uint32_t enabledLayerCount = sizeof(enabledLayers) / sizeof(enabledLayers[0]);
-
-VkResult init_instance(VkInstance* instance)
+// Headless instances skip GLFW and only enable VK_EXT_headless_surface, when the loader has it.
+// Validation is added on top in builds with YACW_ENABLE_VALIDATION.
+VkResult init_instance(bool headless,
+    VkInstance* instance,
+    bool* headlessSurface,
+    VkDebugUtilsMessengerEXT* debugMessenger)
 {
     VkResult result;
 
     VkApplicationInfo appInfo
-        = { .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO, .apiVersion = VK_API_VERSION_1_2 };
+        = { .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO, .apiVersion = VK_API_VERSION_1_3 };
 
     uint32_t glfwExtensionCount = 0;
     const char** glfwExtensions = NULL;
 
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    if (glfwExtensions == NULL) {
-        LOG_ERROR("Failed to get required Vulkan instance extensions from GLFW");
+    static const char* headlessExtensions[]
+        = { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+
+    *headlessSurface = false;
+    if (headless) {
+        if (instance_has_extension(NULL, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME)) {
+            *headlessSurface = true;
+            glfwExtensions = headlessExtensions;
+            glfwExtensionCount = sizeof(headlessExtensions) / sizeof(headlessExtensions[0]);
+        }
+        LOG_INFO("Headless instance, %s",
+            *headlessSurface ? "using VK_EXT_headless_surface" : "rendering to plain images");
+    } else {
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        if (glfwExtensions == NULL) {
+            LOG_ERROR("Failed to get required Vulkan instance extensions from GLFW");
+            return VK_RESULT_MAX_ENUM;
+        }
+    }
+
+    DebugUtilsConfig debugConfig;
+    debug_utils_configure(&debugConfig);
+
+    uint32_t extensionCount = glfwExtensionCount + debugConfig.extensionCount;
+    const char** extensions = malloc(extensionCount * sizeof(const char*));
+    if (extensions == NULL && extensionCount > 0) {
+        LOG_ERROR("Failed to allocate memory for instance extensions");
         return VK_RESULT_MAX_ENUM;
     }
+    for (uint32_t i = 0; i < glfwExtensionCount; i++) {
+        extensions[i] = glfwExtensions[i];
+    }
+    for (uint32_t i = 0; i < debugConfig.extensionCount; i++) {
+        extensions[glfwExtensionCount + i] = debugConfig.extensions[i];
+    }
 
-    LOG_INFO("Number of required Vulkan instance extensions from GLFW: %u", glfwExtensionCount);
-    for (unsigned int i = 0; i < glfwExtensionCount; i++) {
-        LOG_INFO("  - %s", glfwExtensions[i]);
+    LOG_DEBUG("Number of required Vulkan instance extensions: %u", extensionCount);
+    for (unsigned int i = 0; i < extensionCount; i++) {
+        LOG_DEBUG("  - %s", extensions[i]);
     }
 
+    // Device layers are deprecated and ignored, the instance ones apply to every device
     VkInstanceCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pNext = debugConfig.pNext,
         .pApplicationInfo = &appInfo,
-        .enabledExtensionCount = glfwExtensionCount,
-        .ppEnabledExtensionNames = glfwExtensions,
-        .enabledLayerCount = enabledLayerCount,
-        .ppEnabledLayerNames = enabledLayers };
+        .enabledExtensionCount = extensionCount,
+        .ppEnabledExtensionNames = extensions,
+        .enabledLayerCount = debugConfig.layerCount,
+        .ppEnabledLayerNames = debugConfig.layers };
 
     result = vkCreateInstance(&createInfo, NULL, instance);
+    free(extensions);
     if (result != VK_SUCCESS) {
         LOG_ERROR("Failed to create Vulkan instance: %d", result);
         return VK_RESULT_MAX_ENUM;
     }
     LOG_INFO("Vulkan instance created successfully");
 
-    return result;
+    return debug_utils_init(*instance, &debugConfig, debugMessenger);
 }
 
-VkResult init_surface(VkInstance instance, GLFWwindow* window, VkSurfaceKHR* surface)
+VkResult init_surface(
+    VkInstance instance, GLFWwindow* window, bool headlessSurface, VkSurfaceKHR* surface)
 {
     VkResult result;
+
+    if (window == NULL) {
+        // Without the extension the swapchain is replaced by plain images, see init_offscreen
+        if (!headlessSurface) {
+            *surface = VK_NULL_HANDLE;
+            return VK_SUCCESS;
+        }
+
+        PFN_vkCreateHeadlessSurfaceEXT createHeadlessSurface
+            = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(
+                instance, "vkCreateHeadlessSurfaceEXT");
+        if (createHeadlessSurface == NULL) {
+            LOG_ERROR("vkCreateHeadlessSurfaceEXT not found");
+            return VK_RESULT_MAX_ENUM;
+        }
+
+        VkHeadlessSurfaceCreateInfoEXT createInfo
+            = { .sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT };
+
+        result = createHeadlessSurface(instance, &createInfo, NULL, surface);
+        if (result != VK_SUCCESS) {
+            LOG_ERROR("Failed to create headless surface: %d", result);
+            return result;
+        }
+        LOG_INFO("Headless surface created successfully");
+        return result;
+    }
+
     result = glfwCreateWindowSurface(instance, window, NULL, surface);
     if (result != VK_SUCCESS) {
         LOG_ERROR("Failed to create Vulkan surface: %d", result);
@@ -95,125 +177,189 @@ VkResult init_surface(VkInstance instance, GLFWwindow* window, VkSurfaceKHR* sur
     return result;
 }
 
-VkResult init_physical_device(VkInstance instance, VkPhysicalDevice* physicalDevice)
+// A single family has to do both graphics and presentation, the same criteria device_select
+// scores devices by
+VkResult init_queue_family_index(
+    VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, int32_t* queueFamilyIndex)
 {
-    VkResult result;
+    *queueFamilyIndex = -1;
 
-    uint32_t deviceCount = 0;
-    result = vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
-    if (result != VK_SUCCESS) {
-        LOG_ERROR("Failed to enumerate physical devices: %d", result);
-        return result;
-    }
-    if (deviceCount == 0) {
-        LOG_ERROR("No physical devices found");
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+    if (queueFamilyCount == 0) {
+        LOG_ERROR("No queue families found for the physical device");
         return VK_RESULT_MAX_ENUM;
     }
-    LOG_INFO("Number of physical devices available: %u", deviceCount);
+    LOG_DEBUG("Number of queue families available: %u", queueFamilyCount);
 
-    VkPhysicalDevice* physicalDevices = malloc(deviceCount * sizeof(VkPhysicalDevice));
-    result = vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices);
-    if (result != VK_SUCCESS) {
-        LOG_ERROR("Failed to enumerate physical devices: %d", result);
-        free(physicalDevices);
-        return result;
+    VkQueueFamilyProperties* queueFamilies
+        = malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+    if (queueFamilies == NULL) {
+        LOG_ERROR("Failed to allocate queue family properties");
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
     }
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
 
-    VkPhysicalDeviceType preferredTypeOrder[] = { VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU,
-        VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU,
-        VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU,
-        VK_PHYSICAL_DEVICE_TYPE_CPU };
-    uint32_t preferredTypeOrderCount = sizeof(preferredTypeOrder) / sizeof(preferredTypeOrder[0]);
-
-    for (uint32_t i = 0; i < preferredTypeOrderCount; i++) {
-        for (uint32_t j = 0; j < deviceCount; j++) {
-            VkPhysicalDeviceProperties properties;
-            vkGetPhysicalDeviceProperties(physicalDevices[j], &properties);
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+        if (!(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
+        }
 
-            if (properties.deviceType == preferredTypeOrder[i]) {
-                *physicalDevice = physicalDevices[j];
-                LOG_INFO("Selected physical device: %s", properties.deviceName);
-                break;
-            }
+        // Offscreen images are never presented
+        VkBool32 presentSupport = surface == VK_NULL_HANDLE;
+        if (!presentSupport
+            && vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport)
+                != VK_SUCCESS) {
+            presentSupport = VK_FALSE;
         }
 
-        if (*physicalDevice != VK_NULL_HANDLE) {
+        if (presentSupport) {
+            LOG_DEBUG("Queue family %u supports graphics and presentation", i);
+            *queueFamilyIndex = (int32_t)i;
             break;
         }
     }
+    free(queueFamilies);
 
-    if (*physicalDevice == VK_NULL_HANDLE) {
-        LOG_ERROR("No suitable physical device found");
-        free(physicalDevices);
+    if (*queueFamilyIndex == -1) {
+        LOG_ERROR("No queue family supports both graphics and presentation");
         return VK_RESULT_MAX_ENUM;
     }
 
-    free(physicalDevices);
-    return result;
+    return VK_SUCCESS;
 }
 
-VkResult init_queue_family_index(
-    VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, int32_t* queueFamilyIndex)
+// Prefers a family that only does transfers (the DMA engine on discrete GPUs), then any
+// non-graphics family with transfers, and falls back to the graphics family
+VkResult init_transfer_queue_family_index(VkPhysicalDevice physicalDevice,
+    int32_t graphicsQueueFamilyIndex,
+    int32_t* transferQueueFamilyIndex)
 {
-    VkResult result;
-    *queueFamilyIndex = -1;
+    *transferQueueFamilyIndex = graphicsQueueFamilyIndex;
 
     uint32_t queueFamilyCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
-    if (queueFamilyCount == 0) {
-        LOG_ERROR("No queue families found for the physical device");
-        return VK_RESULT_MAX_ENUM;
-    }
-    LOG_INFO("Number of queue families available: %u", queueFamilyCount);
 
     VkQueueFamilyProperties* queueFamilies
         = malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+    if (queueFamilies == NULL) {
+        LOG_ERROR("Failed to allocate queue family properties");
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
     vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
 
-    VkBool32 presentSupport = VK_FALSE;
+    int32_t dedicated = -1;
+    int32_t nonGraphics = -1;
     for (uint32_t i = 0; i < queueFamilyCount; i++) {
-
-        // Check graphics bit
-        if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            *queueFamilyIndex = i;
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
         }
 
-        // Check presentation bit
-        result = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
-        if (result == VK_SUCCESS && presentSupport == VK_TRUE) {
-            LOG_INFO("Queue family %u supports presentation", i);
-            break;
+        if (!(flags & VK_QUEUE_COMPUTE_BIT) && dedicated < 0) {
+            dedicated = (int32_t)i;
+        } else if (nonGraphics < 0) {
+            nonGraphics = (int32_t)i;
         }
     }
 
-    if (*queueFamilyIndex == -1 || presentSupport == VK_FALSE) {
-        LOG_ERROR("No suitable queue family found for graphics operations");
-        free(queueFamilies);
-        return VK_RESULT_MAX_ENUM;
+    if (dedicated >= 0) {
+        *transferQueueFamilyIndex = dedicated;
+    } else if (nonGraphics >= 0) {
+        *transferQueueFamilyIndex = nonGraphics;
     }
 
+    LOG_INFO("Transfer queue family: %d%s",
+        *transferQueueFamilyIndex,
+        *transferQueueFamilyIndex == graphicsQueueFamilyIndex ? " (shared with graphics)" : "");
+
     free(queueFamilies);
-    return result;
+    return VK_SUCCESS;
 }
 
-VkResult init_device(int32_t queueFamilyIndex, VkPhysicalDevice physicalDevice, VkDevice* device)
+VkResult init_device(int32_t queueFamilyIndex,
+    int32_t transferQueueFamilyIndex,
+    VkPhysicalDevice physicalDevice,
+    bool enableSwapchain,
+    bool enablePresentWait,
+    bool enableIncrementalPresent,
+    DynamicRenderingSupport dynamicRendering,
+    Sync2Support sync2,
+    VkDevice* device)
 {
     VkResult result;
 
     float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfo = { .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = queueFamilyIndex,
-        .queueCount = 1,
-        .pQueuePriorities = &queuePriority };
-
-    const char* const enabledExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-    uint32_t enabledExtensionCount = sizeof(enabledExtensions) / sizeof(enabledExtensions[0]);
+    VkDeviceQueueCreateInfo queueCreateInfos[] = {
+        { .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = queueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriority },
+        { .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = transferQueueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriority },
+    };
+    uint32_t queueCreateInfoCount = transferQueueFamilyIndex == queueFamilyIndex ? 1 : 2;
+
+    // Both core in 1.3, see dynamic_rendering_support and sync2_support
+    VkPhysicalDeviceSynchronization2Features synchronization2Features
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+              .synchronization2 = VK_TRUE };
+    VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
+              .dynamicRendering = VK_TRUE };
+    void* optionalFeatures = NULL;
+    if (sync2 != SYNC2_NONE) {
+        synchronization2Features.pNext = optionalFeatures;
+        optionalFeatures = &synchronization2Features;
+    }
+    if (dynamicRendering != DYNAMIC_RENDERING_NONE) {
+        dynamicRenderingFeatures.pNext = optionalFeatures;
+        optionalFeatures = &dynamicRenderingFeatures;
+    }
+
+    // Core in 1.2 and required to be supported there
+    VkPhysicalDeviceVulkan12Features vulkan12Features
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+              .pNext = optionalFeatures,
+              .timelineSemaphore = VK_TRUE };
+
+    // Only used to pace frames, see frame_pacing
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+              .pNext = &vulkan12Features,
+              .presentWait = VK_TRUE };
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+              .pNext = &presentWaitFeatures,
+              .presentId = VK_TRUE };
+
+    const char* enabledExtensions[6];
+    uint32_t enabledExtensionCount = 0;
+    if (dynamicRendering == DYNAMIC_RENDERING_EXTENSION) {
+        enabledExtensions[enabledExtensionCount++] = VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME;
+    }
+    if (sync2 == SYNC2_EXTENSION) {
+        enabledExtensions[enabledExtensionCount++] = VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME;
+    }
+    if (enableSwapchain) {
+        enabledExtensions[enabledExtensionCount++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+        if (enablePresentWait) {
+            enabledExtensions[enabledExtensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+            enabledExtensions[enabledExtensionCount++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+        }
+        // Only a hint to the presentation engine, see damage_chain_present
+        if (enableIncrementalPresent) {
+            enabledExtensions[enabledExtensionCount++]
+                = VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME;
+        }
+    }
 
     VkDeviceCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &queueCreateInfo,
-        .enabledLayerCount = enabledLayerCount,
-        .ppEnabledLayerNames = enabledLayers,
+        .pNext = enablePresentWait ? (const void*)&presentIdFeatures : &vulkan12Features,
+        .queueCreateInfoCount = queueCreateInfoCount,
+        .pQueueCreateInfos = queueCreateInfos,
         .enabledExtensionCount = enabledExtensionCount,
         .ppEnabledExtensionNames = enabledExtensions };
 
@@ -229,7 +375,8 @@ VkResult init_device(int32_t queueFamilyIndex, VkPhysicalDevice physicalDevice,
 
 VkResult init_swapchain_metadata(VkPhysicalDevice physicalDevice,
     VkSurfaceKHR surface,
-    GLFWwindow* window,
+    VkExtent2D framebufferExtent,
+    PresentPolicy presentPolicy,
     SwapchainMetadata* swapChainMetadata)
 {
     VkResult result;
@@ -266,7 +413,7 @@ VkResult init_swapchain_metadata(VkPhysicalDevice physicalDevice,
         for (uint32_t i = 0; i < surfaceFormatCount; i++) {
             if (surfaceFormats[i].format == VK_FORMAT_B8G8R8A8_SRGB
                 && surfaceFormats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-                LOG_INFO("Preferred surface format found: %d, %d",
+                LOG_DEBUG("Preferred surface format found: %d, %d",
                     surfaceFormats[i].format,
                     surfaceFormats[i].colorSpace);
                 swapChainMetadata->surfaceFormat = surfaceFormats[i];
@@ -306,13 +453,11 @@ VkResult init_swapchain_metadata(VkPhysicalDevice physicalDevice,
             return result;
         }
 
-        for (uint32_t i = 0; i < surfacePresentModeCount; i++) {
-            if (surfacePresentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-                LOG_INFO("Preferred present mode found: %d", surfacePresentModes[i]);
-                swapChainMetadata->presentMode = surfacePresentModes[i]; // Triple buffering
-                break;
-            }
-        }
+        swapChainMetadata->presentMode = frame_pacing_present_mode(
+            presentPolicy, surfacePresentModes, surfacePresentModeCount);
+        LOG_DEBUG("Present mode %d for the %s policy",
+            swapChainMetadata->presentMode,
+            present_policy_name(presentPolicy));
 
         free(surfacePresentModes);
     }
@@ -330,11 +475,7 @@ VkResult init_swapchain_metadata(VkPhysicalDevice physicalDevice,
         if (surfaceCapabilities.currentExtent.width != UINT32_MAX) {
             swapChainMetadata->swapchainExtent = surfaceCapabilities.currentExtent;
         } else {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
-
-            swapChainMetadata->swapchainExtent.width = (uint32_t)width;
-            swapChainMetadata->swapchainExtent.height = (uint32_t)height;
+            swapChainMetadata->swapchainExtent = framebufferExtent;
 
             swapChainMetadata->swapchainExtent.width
                 = clamp_u32(swapChainMetadata->swapchainExtent.width,
@@ -346,13 +487,14 @@ VkResult init_swapchain_metadata(VkPhysicalDevice physicalDevice,
                     surfaceCapabilities.maxImageExtent.height);
         }
 
-        swapChainMetadata->swapChainImageCount = surfaceCapabilities.minImageCount + 1;
-        if (surfaceCapabilities.maxImageCount > 0
-            && swapChainMetadata->swapChainImageCount > surfaceCapabilities.maxImageCount) {
-            swapChainMetadata->swapChainImageCount = surfaceCapabilities.maxImageCount;
-        }
+        swapChainMetadata->swapChainImageCount = frame_pacing_image_count(
+            presentPolicy, swapChainMetadata->presentMode, &surfaceCapabilities);
 
         swapChainMetadata->swapChainTransform = surfaceCapabilities.currentTransform;
+
+        // Transfer source lets frames be read back, when the surface allows it
+        swapChainMetadata->imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+            | (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
     }
 
     return result;
@@ -360,7 +502,8 @@ VkResult init_swapchain_metadata(VkPhysicalDevice physicalDevice,
 
 VkResult init_swapchain(VkSurfaceKHR surface,
     VkDevice device,
-    SwapchainMetadata swapchainMetadata,
+    VkSwapchainKHR oldSwapchain,
+    SwapchainMetadata* swapchainMetadata,
     VkSwapchainKHR* swapchain,
     VkImage** swapchainImages)
 {
@@ -369,17 +512,18 @@ VkResult init_swapchain(VkSurfaceKHR surface,
     VkSwapchainCreateInfoKHR swapchainCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .surface = surface,
-        .minImageCount = swapchainMetadata.swapChainImageCount,
-        .imageFormat = swapchainMetadata.surfaceFormat.format,
-        .imageColorSpace = swapchainMetadata.surfaceFormat.colorSpace,
-        .imageExtent = swapchainMetadata.swapchainExtent,
+        .minImageCount = swapchainMetadata->swapChainImageCount,
+        .imageFormat = swapchainMetadata->surfaceFormat.format,
+        .imageColorSpace = swapchainMetadata->surfaceFormat.colorSpace,
+        .imageExtent = swapchainMetadata->swapchainExtent,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = swapchainMetadata->imageUsage,
         .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .preTransform = swapchainMetadata.swapChainTransform,
+        .preTransform = swapchainMetadata->swapChainTransform,
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR, // Opaque composite
-        .presentMode = swapchainMetadata.presentMode,
+        .presentMode = swapchainMetadata->presentMode,
         .clipped = VK_TRUE, // Discard pixels outside the visible area
+        .oldSwapchain = oldSwapchain, // Lets the driver reuse resources of the retired swapchain
     };
 
     result = vkCreateSwapchainKHR(device, &swapchainCreateInfo, NULL, swapchain);
@@ -389,17 +533,22 @@ VkResult init_swapchain(VkSurfaceKHR surface,
     }
     LOG_INFO("Swapchain created successfully");
 
+    // The driver may create more images than requested, store the actual count
     result
-        = vkGetSwapchainImagesKHR(device, *swapchain, &swapchainMetadata.swapChainImageCount, NULL);
+        = vkGetSwapchainImagesKHR(device, *swapchain, &swapchainMetadata->swapChainImageCount, NULL);
     if (result != VK_SUCCESS) {
         LOG_ERROR("Failed to get swapchain images count: %d", result);
         return result;
     }
-    LOG_INFO("Number of swapchain images: %u", swapchainMetadata.swapChainImageCount);
+    LOG_DEBUG("Number of swapchain images: %u", swapchainMetadata->swapChainImageCount);
 
-    *swapchainImages = malloc(swapchainMetadata.swapChainImageCount * sizeof(VkImage));
+    *swapchainImages = malloc(swapchainMetadata->swapChainImageCount * sizeof(VkImage));
+    if (*swapchainImages == NULL) {
+        LOG_ERROR("Failed to allocate memory for swapchain images");
+        return VK_RESULT_MAX_ENUM;
+    }
     result = vkGetSwapchainImagesKHR(
-        device, *swapchain, &swapchainMetadata.swapChainImageCount, *swapchainImages);
+        device, *swapchain, &swapchainMetadata->swapChainImageCount, *swapchainImages);
     if (result != VK_SUCCESS) {
         LOG_ERROR("Failed to get swapchain images: %d", result);
         return result;
@@ -408,6 +557,60 @@ VkResult init_swapchain(VkSurfaceKHR surface,
     return result;
 }
 
+// Stand-in for a swapchain when there is no surface at all: one plain image per frame in flight
+VkResult init_offscreen(GpuMemory* gpuMemory,
+    VkExtent2D extent,
+    SwapchainMetadata* swapchainMetadata,
+    VkImage** images,
+    GpuAllocation** allocations)
+{
+    VkResult result = VK_SUCCESS;
+
+    *swapchainMetadata = (SwapchainMetadata) {
+        .surfaceFormat
+        = { .format = VK_FORMAT_B8G8R8A8_SRGB, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR },
+        .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+        .swapchainExtent = extent,
+        .swapChainTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+        .swapChainImageCount = YACW_FRAMES_IN_FLIGHT,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+    };
+
+    *images = calloc(swapchainMetadata->swapChainImageCount, sizeof(VkImage));
+    *allocations = calloc(swapchainMetadata->swapChainImageCount, sizeof(GpuAllocation));
+    if (*images == NULL || *allocations == NULL) {
+        LOG_ERROR("Failed to allocate memory for offscreen images");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    VkImageCreateInfo imageInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = swapchainMetadata->surfaceFormat.format,
+        .extent = { extent.width, extent.height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = swapchainMetadata->imageUsage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED };
+
+    for (uint32_t i = 0; i < swapchainMetadata->swapChainImageCount; i++) {
+        result = gpu_memory_create_image(
+            gpuMemory, &imageInfo, GPU_MEMORY_USAGE_GPU_ONLY, &(*images)[i], &(*allocations)[i]);
+        if (result != VK_SUCCESS) {
+            LOG_ERROR("Failed to create offscreen image %u: %d", i, result);
+            return result;
+        }
+    }
+    LOG_INFO("%u offscreen images of %ux%u created successfully",
+        swapchainMetadata->swapChainImageCount,
+        extent.width,
+        extent.height);
+
+    return result;
+}
+
 VkResult init_image_views(VkDevice device,
     SwapchainMetadata swapchainMetadata,
     VkImage* swapchainImages,
@@ -449,19 +652,26 @@ VkResult init_image_views(VkDevice device,
     return result;
 }
 
-VkResult init_render_pass(
-    VkDevice device, SwapchainMetadata swapchainMetadata, VkRenderPass* renderPass)
+// CLEAR redraws the whole image, LOAD keeps the contents from the last time the image was drawn
+// so only the damage has to be redrawn. Both are compatible, framebuffers and secondary command
+// buffers work with either.
+VkResult init_render_pass(VkDevice device,
+    SwapchainMetadata swapchainMetadata,
+    VkAttachmentLoadOp loadOp,
+    VkImageLayout finalLayout,
+    VkRenderPass* renderPass)
 {
     VkResult result;
 
+    bool load = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
     VkAttachmentDescription colorAttachment = { .format = swapchainMetadata.surfaceFormat.format,
         .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, // Clear the attachment before rendering
+        .loadOp = loadOp,
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+        .initialLayout = load ? finalLayout : VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = finalLayout };
 
     VkAttachmentReference colorAttachmentRef
         = { .attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
@@ -470,88 +680,54 @@ VkResult init_render_pass(
         .colorAttachmentCount = 1,
         .pColorAttachments = &colorAttachmentRef };
 
-    VkSubpassDependency dependency = { .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = 0,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+    VkSubpassDependency dependencies[] = {
+        // Also waits for the readback of the image's previous frame
+        { .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask
+            = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .srcAccessMask = 0,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                | (load ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0) },
+        // Orders the final layout transition before a readback recorded after the pass
+        { .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask
+            = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT },
+    };
 
     VkRenderPassCreateInfo renderPassInfo = { .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
         .attachmentCount = 1,
         .pAttachments = &colorAttachment,
         .subpassCount = 1,
         .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency };
+        .dependencyCount = sizeof(dependencies) / sizeof(dependencies[0]),
+        .pDependencies = dependencies };
 
     result = vkCreateRenderPass(device, &renderPassInfo, NULL, renderPass);
     if (result != VK_SUCCESS) {
-        LOG_ERROR("Failed to create render pass: %d", result);
+        LOG_ERROR("Failed to create %s render pass: %d", load ? "load" : "clear", result);
         return result;
     }
-    LOG_INFO("Render pass created successfully");
+    LOG_INFO("Render pass created successfully: %s", load ? "load" : "clear");
 
     return result;
 }
 
-VkResult init_pipeline(VkDevice device,
-    SwapchainMetadata swapchainMetadata,
-    VkRenderPass renderPass,
-    VkPipelineLayout* pipelineLayout,
+VkResult create_graphics_pipeline(VkDevice device,
+    VkPipelineCache pipelineCache,
+    const RenderTarget* target,
+    VkPipelineLayout pipelineLayout,
+    VkShaderModule vertShaderModule,
+    VkShaderModule fragShaderModule,
     VkPipeline* pipeline)
 {
     VkResult result;
 
-    VkShaderModule vertShaderModule;
-    VkShaderModule fragShaderModule;
-    {
-        size_t vertShaderSize;
-        char* vertShaderCode = readFile(YACW_VERT_SHADER_PATH, &vertShaderSize);
-        if (vertShaderCode == NULL) {
-            LOG_ERROR("Failed to read vertex shader SPIR-V: %s", YACW_VERT_SHADER_PATH);
-            return VK_RESULT_MAX_ENUM;
-        }
-
-        VkShaderModuleCreateInfo vertShaderModuleCreateInfo
-            = { .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-                  .codeSize = vertShaderSize,
-                  .pCode = (const uint32_t*)vertShaderCode };
-
-        result = vkCreateShaderModule(device, &vertShaderModuleCreateInfo, NULL, &vertShaderModule);
-        if (result != VK_SUCCESS) {
-            LOG_ERROR("Failed to create vertex shader module: %d", result);
-            free(vertShaderCode);
-            return result;
-        }
-        LOG_INFO(
-            "Vertex shader module created successfully. Shader size: %zu bytes", vertShaderSize);
-        free(vertShaderCode);
-
-        size_t fragShaderSize;
-        char* fragShaderCode = readFile(YACW_FRAG_SHADER_PATH, &fragShaderSize);
-        if (fragShaderCode == NULL) {
-            LOG_ERROR("Failed to read fragment shader SPIR-V: %s", YACW_FRAG_SHADER_PATH);
-            return VK_RESULT_MAX_ENUM;
-        }
-
-        VkShaderModuleCreateInfo fragShaderModuleCreateInfo
-            = { .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-                  .codeSize = fragShaderSize,
-                  .pCode = (const uint32_t*)fragShaderCode };
-
-        result = vkCreateShaderModule(device, &fragShaderModuleCreateInfo, NULL, &fragShaderModule);
-        if (result != VK_SUCCESS) {
-            LOG_ERROR("Failed to create fragment shader module: %d", result);
-            vkDestroyShaderModule(device, vertShaderModule, NULL);
-            free(fragShaderCode);
-            return result;
-        }
-        LOG_INFO(
-            "Fragment shader module created successfully. Shader size: %zu bytes", fragShaderSize);
-        free(fragShaderCode);
-    }
-
     VkPipelineShaderStageCreateInfo vertShaderStageInfo
         = { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
               .stage = VK_SHADER_STAGE_VERTEX_BIT,
@@ -591,22 +767,18 @@ VkResult init_pipeline(VkDevice device,
               .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
               .primitiveRestartEnable = VK_FALSE };
 
-    // Viewport and Scissor
-    VkViewport viewport = { .x = 0.0f,
-        .y = 0.0f,
-        .width = (float)swapchainMetadata.swapchainExtent.width,
-        .height = (float)swapchainMetadata.swapchainExtent.height,
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f };
-
-    VkRect2D scissor = { .offset = { 0, 0 }, .extent = swapchainMetadata.swapchainExtent };
-
+    // Viewport and Scissor, set at record time so the pipeline survives swapchain recreation
     VkPipelineViewportStateCreateInfo viewportState
         = { .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
               .viewportCount = 1,
-              .pViewports = &viewport,
-              .scissorCount = 1,
-              .pScissors = &scissor };
+              .scissorCount = 1 };
+
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+              .dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]),
+              .pDynamicStates = dynamicStates };
 
     // Rasterization
     VkPipelineRasterizationStateCreateInfo rasterizer
@@ -631,24 +803,10 @@ VkResult init_pipeline(VkDevice device,
         .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
             | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT };
 
-    // Pipeline layout (empty for now, for uniform buffers or push constants)
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 0, // No descriptor sets for now
-        .pushConstantRangeCount = 0 // No push constants for now
-    };
-
-    result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, pipelineLayout);
-    if (result != VK_SUCCESS) {
-        LOG_ERROR("Failed to create pipeline layout: %d", result);
-        vkDestroyShaderModule(device, fragShaderModule, NULL);
-        vkDestroyShaderModule(device, vertShaderModule, NULL);
-        return result;
-    }
-    LOG_INFO("Pipeline layout created successfully");
-
+    VkPipelineRenderingCreateInfo renderingInfo;
     VkGraphicsPipelineCreateInfo pipelineInfo
         = { .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+              .pNext = render_target_pipeline_chain(target, &renderingInfo),
               .stageCount = shaderStageCount,
               .pStages = shaderStages,
               .pVertexInputState = &vertexInputInfo,
@@ -661,21 +819,160 @@ VkResult init_pipeline(VkDevice device,
                   .logicOpEnable = VK_FALSE,
                   .attachmentCount = 1,
                   .pAttachments = &colorBlendAttachment },
-              .layout = *pipelineLayout,
-              .renderPass = renderPass,
+              .pDynamicState = &dynamicState,
+              .layout = pipelineLayout,
+              .renderPass = target->renderPass,
               .subpass = 0 };
 
-    result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, pipeline);
+    uint64_t startNs = timer_now_ns();
+    result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL, pipeline);
     if (result != VK_SUCCESS) {
         LOG_ERROR("Failed to create graphics pipeline: %d", result);
-        vkDestroyShaderModule(device, fragShaderModule, NULL);
-        vkDestroyShaderModule(device, vertShaderModule, NULL);
         return result;
     }
-    LOG_INFO("Graphics pipeline created successfully");
+    LOG_INFO("Graphics pipeline created successfully in %.3f ms",
+        timer_ns_to_ms(timer_now_ns() - startNs));
+
+    return result;
+}
+
+VkResult init_pipeline_layout(VkDevice device, VkPipelineLayout* pipelineLayout)
+{
+    VkResult result;
+
+    // Pipeline layout (empty for now, for uniform buffers or push constants)
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 0, // No descriptor sets for now
+        .pushConstantRangeCount = 0 // No push constants for now
+    };
+
+    result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, pipelineLayout);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create pipeline layout: %d", result);
+        return result;
+    }
+    LOG_INFO("Pipeline layout created successfully");
+
+    return result;
+}
+
+typedef struct ShaderModuleJob {
+    Job job;
+    VkDevice device;
+    ShaderId id;
+    VkShaderModule module;
+    VkResult result;
+} ShaderModuleJob;
+
+// Builds a pipeline from the modules of the two jobs it depends on
+typedef struct PipelineJob {
+    Job job;
+    AppCtx* appCtx;
+    ShaderModuleJob* vert;
+    ShaderModuleJob* frag;
+    VkResult result;
+} PipelineJob;
+
+// Startup work handed to the job system, lives on appCtx_init's stack
+typedef struct InitJobs {
+    ShaderModuleJob modules[SHADER_COUNT];
+    PipelineJob trianglePipeline;
+    PipelineJob uiPipeline;
+    bool pipelinesSubmitted;
+} InitJobs;
+
+static void shader_module_job(void* arg)
+{
+    ShaderModuleJob* job = arg;
+    job->result = shader_create_module(job->device, job->id, &job->module);
+}
+
+static VkResult pipeline_job_modules_result(const PipelineJob* job)
+{
+    return job->vert->result != VK_SUCCESS ? job->vert->result : job->frag->result;
+}
+
+static void triangle_pipeline_job(void* arg)
+{
+    PipelineJob* job = arg;
+    AppCtx* appCtx = job->appCtx;
+
+    job->result = pipeline_job_modules_result(job);
+    if (job->result == VK_SUCCESS) {
+        job->result = create_graphics_pipeline(appCtx->device,
+            appCtx->pipelineCache,
+            &appCtx->renderTarget,
+            appCtx->pipelineLayout,
+            job->vert->module,
+            job->frag->module,
+            &appCtx->pipeline);
+    }
+}
+
+static void ui_pipeline_job(void* arg)
+{
+    PipelineJob* job = arg;
+    AppCtx* appCtx = job->appCtx;
+
+    job->result = pipeline_job_modules_result(job);
+    if (job->result == VK_SUCCESS) {
+        job->result = nk_vulkan_create_pipeline(&appCtx->ui,
+            appCtx->device,
+            appCtx->pipelineCache,
+            &appCtx->renderTarget,
+            job->vert->module,
+            job->frag->module);
+    }
+}
+
+static void init_jobs_submit_modules(AppCtx* appCtx, InitJobs* init)
+{
+    for (ShaderId id = 0; id < SHADER_COUNT; id++) {
+        ShaderModuleJob* module = &init->modules[id];
+        *module = (ShaderModuleJob) { .device = appCtx->device, .id = id };
+        job_init(&module->job, shader_module_job, module);
+        job_submit(&appCtx->jobs, &module->job);
+    }
+}
+
+static VkResult init_jobs_submit_pipeline(AppCtx* appCtx,
+    PipelineJob* pipeline,
+    JobFunction function,
+    ShaderModuleJob* vert,
+    ShaderModuleJob* frag)
+{
+    *pipeline = (PipelineJob) { .appCtx = appCtx, .vert = vert, .frag = frag };
+    job_init(&pipeline->job, function, pipeline);
+
+    if (!job_depends_on(&appCtx->jobs, &pipeline->job, &vert->job)
+        || !job_depends_on(&appCtx->jobs, &pipeline->job, &frag->job)) {
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    job_submit(&appCtx->jobs, &pipeline->job);
+    return VK_SUCCESS;
+}
+
+// Waits for everything submitted and destroys the modules, returning the first job failure
+static VkResult init_jobs_wait(AppCtx* appCtx, InitJobs* init)
+{
+    VkResult result = VK_SUCCESS;
+
+    if (init->pipelinesSubmitted) {
+        job_wait(&appCtx->jobs, &init->trianglePipeline.job);
+        job_wait(&appCtx->jobs, &init->uiPipeline.job);
+
+        result = init->trianglePipeline.result != VK_SUCCESS ? init->trianglePipeline.result
+                                                              : init->uiPipeline.result;
+    }
 
-    vkDestroyShaderModule(device, fragShaderModule, NULL);
-    vkDestroyShaderModule(device, vertShaderModule, NULL);
+    for (ShaderId id = 0; id < SHADER_COUNT; id++) {
+        job_wait(&appCtx->jobs, &init->modules[id].job);
+        if (init->modules[id].module != VK_NULL_HANDLE) {
+            vkDestroyShaderModule(appCtx->device, init->modules[id].module, NULL);
+        }
+    }
 
     return result;
 }
@@ -689,7 +986,7 @@ VkResult init_framebuffers(VkDevice device,
     VkResult result;
 
     *swapchainFramebuffers = malloc(swapchainMetadata.swapChainImageCount * sizeof(VkFramebuffer));
-    if (swapchainFramebuffers == NULL) {
+    if (*swapchainFramebuffers == NULL) {
         LOG_ERROR("Failed to allocate memory for swapchain framebuffers");
         return VK_RESULT_MAX_ENUM;
     }
@@ -713,165 +1010,493 @@ VkResult init_framebuffers(VkDevice device,
             LOG_ERROR("Failed to create framebuffer %u: %d", i, result);
             return result;
         }
-        LOG_INFO("Framebuffer %u created successfully", i);
+        LOG_DEBUG("Framebuffer %u created successfully", i);
     }
 
     return result;
 }
 
-VkResult init_command_pool(int32_t queueFamilyIndex,
-    VkDevice device,
-    SwapchainMetadata swapchainMetadata,
-    VkRenderPass renderPass,
-    VkFramebuffer* swapchainFramebuffers,
-    VkPipeline pipeline,
+static VkResult init_command_buffer(VkDevice device,
+    int32_t queueFamilyIndex,
+    VkCommandBufferLevel level,
     VkCommandPool* commandPool,
-    VkCommandBuffer** commandBuffers)
+    VkCommandBuffer* commandBuffer)
 {
     VkResult result;
 
-    VkCommandPoolCreateInfo commandPoolInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    // Reset as a whole every frame, never per command buffer
+    VkCommandPoolCreateInfo commandPoolInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .queueFamilyIndex = queueFamilyIndex,
-        .flags
-        = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT // Allow command buffers to be reset
-    };
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT };
 
     result = vkCreateCommandPool(device, &commandPoolInfo, NULL, commandPool);
     if (result != VK_SUCCESS) {
         LOG_ERROR("Failed to create command pool: %d", result);
         return result;
     }
-    LOG_INFO("Command pool created successfully");
-
-    *commandBuffers = malloc(swapchainMetadata.swapChainImageCount * sizeof(VkCommandBuffer));
-    if (*commandBuffers == NULL) {
-        LOG_ERROR("Failed to allocate memory for command buffers");
-        return VK_RESULT_MAX_ENUM;
-    }
 
     VkCommandBufferAllocateInfo allocInfo
         = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
               .commandPool = *commandPool,
-              .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-              .commandBufferCount = swapchainMetadata.swapChainImageCount };
+              .level = level,
+              .commandBufferCount = 1 };
 
-    result = vkAllocateCommandBuffers(device, &allocInfo, *commandBuffers);
+    result = vkAllocateCommandBuffers(device, &allocInfo, commandBuffer);
     if (result != VK_SUCCESS) {
-        LOG_ERROR("Failed to allocate command buffers: %d", result);
-        free(commandBuffers);
+        LOG_ERROR("Failed to allocate command buffer: %d", result);
         return result;
     }
-    LOG_INFO("Command buffers allocated successfully");
 
-    VkCommandBuffer* buffers = *commandBuffers;
+    return result;
+}
 
-    for (uint32_t i = 0; i < swapchainMetadata.swapChainImageCount; i++) {
-        VkCommandBufferBeginInfo beginInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT // Allow simultaneous use
-        };
+VkResult init_command_pools(int32_t queueFamilyIndex, VkDevice device, FrameCtx* frames)
+{
+    VkResult result = VK_SUCCESS;
 
-        result = vkBeginCommandBuffer(buffers[i], &beginInfo);
+    for (uint32_t i = 0; i < YACW_FRAMES_IN_FLIGHT; i++) {
+        result = init_command_buffer(device,
+            queueFamilyIndex,
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            &frames[i].commandPool,
+            &frames[i].commandBuffer);
         if (result != VK_SUCCESS) {
-            LOG_ERROR("Failed to begin command buffer %u: %d", i, result);
             return result;
         }
 
-        VkRenderPassBeginInfo renderPassInfo = { .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            .renderPass = renderPass,
-            .framebuffer = swapchainFramebuffers[i],
-            .renderArea = { .offset = { 0, 0 }, .extent = swapchainMetadata.swapchainExtent },
-            .clearValueCount = 1,
-            .pClearValues = &(VkClearValue) { .color = { { 0.0f, 0.0f, 1.0f, 1.0f } } } };
-
-        vkCmdBeginRenderPass(buffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-        vkCmdDraw(buffers[i], 3, 1, 0, 0); // Draw a triangle (3 vertices)
-
-        vkCmdEndRenderPass(buffers[i]);
-
-        result = vkEndCommandBuffer(buffers[i]);
-        if (result != VK_SUCCESS) {
-            LOG_ERROR("Failed to end command buffer %u: %d", i, result);
-            return result;
+        for (uint32_t pass = 0; pass < FRAME_PASS_COUNT; pass++) {
+            result = init_command_buffer(device,
+                queueFamilyIndex,
+                VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                &frames[i].passPools[pass],
+                &frames[i].passBuffers[pass]);
+            if (result != VK_SUCCESS) {
+                return result;
+            }
         }
     }
-    LOG_INFO("Command buffers recorded successfully");
+    LOG_INFO("Command pools created successfully: %u frames in flight, %u passes each",
+        YACW_FRAMES_IN_FLIGHT,
+        FRAME_PASS_COUNT);
 
     return result;
 }
 
-VkResult init_sync_objects(VkDevice device,
+static const VkClearValue clearValue = { .color = { { 0.0f, 0.0f, 1.0f, 1.0f } } };
+
+static void record_scene_pass(VkCommandBuffer commandBuffer,
     SwapchainMetadata swapchainMetadata,
-    VkSemaphore* imageAvailableSemaphore,
-    VkSemaphore** renderFinishedSemaphore,
-    VkFence* inFlightFence)
+    VkPipeline pipeline,
+    const DamageRegion* damage)
 {
-    VkResult result;
+    // The load pass keeps everything, the damage is cleared the way the clear pass would
+    if (!damage->full) {
+        VkClearAttachment clearAttachment = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .colorAttachment = 0,
+            .clearValue = clearValue };
+        VkClearRect clearRects[DAMAGE_MAX_RECTS];
+        for (uint32_t i = 0; i < damage->count; i++) {
+            clearRects[i] = (VkClearRect) {
+                .rect = damage->rects[i], .baseArrayLayer = 0, .layerCount = 1
+            };
+        }
+        vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, damage->count, clearRects);
+    }
 
-    VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-    result = vkCreateSemaphore(device, &semaphoreInfo, NULL, imageAvailableSemaphore);
-    if (result != VK_SUCCESS) {
-        LOG_ERROR("Failed to create image available semaphore: %d", result);
-        return result;
+    VkViewport viewport = { .x = 0.0f,
+        .y = 0.0f,
+        .width = (float)swapchainMetadata.swapchainExtent.width,
+        .height = (float)swapchainMetadata.swapchainExtent.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    if (damage->full) {
+        VkRect2D scissor = { .offset = { 0, 0 }, .extent = swapchainMetadata.swapchainExtent };
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0); // Draw a triangle (3 vertices)
+        return;
     }
-    LOG_INFO("Image available semaphore created successfully");
 
-    *renderFinishedSemaphore = malloc(swapchainMetadata.swapChainImageCount * sizeof(VkSemaphore));
-    if (renderFinishedSemaphore == NULL) {
-        LOG_ERROR("Failed to allocate memory for render finished semaphores");
-        return VK_RESULT_MAX_ENUM;
+    for (uint32_t i = 0; i < damage->count; i++) {
+        vkCmdSetScissor(commandBuffer, 0, 1, &damage->rects[i]);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
     }
+}
 
-    VkSemaphore* semaphores = *renderFinishedSemaphore;
-    for (uint32_t i = 0; i < swapchainMetadata.swapChainImageCount; i++) {
-        result = vkCreateSemaphore(device, &semaphoreInfo, NULL, &semaphores[i]);
-        if (result != VK_SUCCESS) {
-            LOG_ERROR("Failed to create render finished semaphore %u: %d", i, result);
+// Records one pass of the current frame into its secondary command buffer
+typedef struct PassRecordJob {
+    Job job;
+    AppCtx* appCtx;
+    FramePass pass;
+    VkFramebuffer framebuffer; // VK_NULL_HANDLE when rendering dynamically
+    VkResult result;
+} PassRecordJob;
 
-            for (uint32_t j = 0; j < i; ++j) {
-                vkDestroySemaphore(device, semaphores[j], NULL);
-            }
-            free(renderFinishedSemaphore);
-            return VK_RESULT_MAX_ENUM;
-        }
+static void record_pass_job(void* arg)
+{
+    PassRecordJob* job = arg;
+    AppCtx* appCtx = job->appCtx;
+    VkCommandBuffer commandBuffer = appCtx->frames[appCtx->currentFrame].passBuffers[job->pass];
+
+    VkCommandBufferInheritanceRenderingInfo renderingInfo;
+    VkCommandBufferInheritanceInfo inheritanceInfo
+        = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+              .pNext = render_target_inheritance_chain(&appCtx->renderTarget, &renderingInfo),
+              .renderPass = appCtx->renderTarget.renderPass,
+              .subpass = 0,
+              .framebuffer = job->framebuffer };
+
+    VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+            | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritanceInfo };
+
+    job->result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if (job->result != VK_SUCCESS) {
+        LOG_ERROR("Failed to begin secondary command buffer: %d", job->result);
+        return;
+    }
+
+    switch (job->pass) {
+    case FRAME_PASS_SCENE:
+        record_scene_pass(
+            commandBuffer, appCtx->swapchainMetadata, appCtx->pipeline, &appCtx->imageDamage);
+        break;
+    case FRAME_PASS_UI:
+        nk_vulkan_render(&appCtx->ui,
+            commandBuffer,
+            appCtx->currentFrame,
+            appCtx->swapchainMetadata.swapchainExtent,
+            &appCtx->imageDamage);
+        break;
+    case FRAME_PASS_COUNT:
+        break;
+    }
+
+    job->result = vkEndCommandBuffer(commandBuffer);
+    if (job->result != VK_SUCCESS) {
+        LOG_ERROR("Failed to end secondary command buffer: %d", job->result);
     }
-    LOG_INFO("Render finished semaphore created successfully");
+}
 
-    VkFenceCreateInfo fenceInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT // Start in signaled state
+// The image a frame draws into, through a render pass or dynamic rendering
+typedef struct FrameTarget {
+    const DynamicRendering* dynamicRendering; // Used instead of the render pass when enabled
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkImage image;
+    VkImageView imageView;
+    VkImageLayout finalLayout;
+} FrameTarget;
+
+// Without damage there is nothing to draw, rendering is skipped and passJobs are not submitted.
+// Full damage clears the image, otherwise its contents are kept.
+VkResult record_command_buffer(VkCommandBuffer commandBuffer,
+    SwapchainMetadata swapchainMetadata,
+    const FrameTarget* target,
+    const DamageRegion* damage,
+    JobSystem* jobs,
+    PassRecordJob* passJobs,
+    const VkCommandBuffer* passBuffers,
+    uint32_t frameIndex,
+    UploadCtx* upload,
+    const Sync2* sync2,
+    uint64_t* uploadWaitValue,
+    VkPipelineStageFlags* uploadWaitStageMask,
+    FrameTiming* timing)
+{
+    VkResult result;
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT // Re-recorded every frame
     };
 
-    result = vkCreateFence(device, &fenceInfo, NULL, inFlightFence);
+    result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    bool draw = !damage_is_empty(damage);
+    bool dynamic = dynamic_rendering_enabled(target->dynamicRendering);
+
+    // The pass jobs are running, they have to be waited for on every path
+    if (result == VK_SUCCESS) {
+        // Ownership acquires have to happen outside the render pass
+        *uploadWaitValue
+            = upload_record_acquire(upload, sync2, commandBuffer, uploadWaitStageMask);
+
+        frame_timing_record_begin(timing, commandBuffer, frameIndex);
+
+        // Tiled GPUs only load and store the render area
+        VkRect2D renderArea = damage_bounds(damage, swapchainMetadata.swapchainExtent);
+        if (draw && dynamic) {
+            dynamic_rendering_begin(target->dynamicRendering,
+                commandBuffer,
+                target->image,
+                target->imageView,
+                target->finalLayout,
+                renderArea,
+                damage->full,
+                &clearValue);
+        } else if (draw) {
+            VkRenderPassBeginInfo renderPassInfo
+                = { .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                      .renderPass = target->renderPass,
+                      .framebuffer = target->framebuffer,
+                      .renderArea = renderArea,
+                      .clearValueCount = 1,
+                      .pClearValues = &clearValue };
+            vkCmdBeginRenderPass(
+                commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        }
+    } else {
+        LOG_ERROR("Failed to begin command buffer: %d", result);
+    }
+
+    for (uint32_t pass = 0; pass < FRAME_PASS_COUNT && draw; pass++) {
+        job_wait(jobs, &passJobs[pass].job);
+        if (result == VK_SUCCESS) {
+            result = passJobs[pass].result;
+        }
+    }
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    if (draw) {
+        vkCmdExecuteCommands(commandBuffer, FRAME_PASS_COUNT, passBuffers);
+        if (dynamic) {
+            dynamic_rendering_end(
+                target->dynamicRendering, commandBuffer, target->image, target->finalLayout);
+        } else {
+            vkCmdEndRenderPass(commandBuffer);
+        }
+    }
+
+    frame_timing_record_end(timing, commandBuffer, frameIndex);
+
+    return result;
+}
+
+// Frame completion goes through the frame timeline, only acquiring still needs binary semaphores
+VkResult init_sync_objects(VkDevice device, FrameCtx* frames, FrameTimeline* timeline)
+{
+    VkResult result;
+
+    VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+    for (uint32_t i = 0; i < YACW_FRAMES_IN_FLIGHT; i++) {
+        result = vkCreateSemaphore(device, &semaphoreInfo, NULL, &frames[i].imageAvailableSemaphore);
+        if (result != VK_SUCCESS) {
+            LOG_ERROR("Failed to create image available semaphore %u: %d", i, result);
+            return result;
+        }
+    }
+
+    result = frame_timeline_init(timeline, device);
     if (result != VK_SUCCESS) {
-        LOG_ERROR("Failed to create in-flight fence: %d", result);
         return result;
     }
-    LOG_INFO("In-flight fence created successfully");
 
     LOG_INFO("Synchronization objects created successfully");
     return result;
 }
 
+VkResult init_swapchain_sync_objects(VkDevice device,
+    SwapchainMetadata swapchainMetadata,
+    VkSemaphore** renderFinishedSemaphore,
+    uint64_t** imageTimelineValues)
+{
+    VkResult result = VK_SUCCESS;
+
+    VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+    *renderFinishedSemaphore = malloc(swapchainMetadata.swapChainImageCount * sizeof(VkSemaphore));
+    if (*renderFinishedSemaphore == NULL) {
+        LOG_ERROR("Failed to allocate memory for render finished semaphores");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    VkSemaphore* semaphores = *renderFinishedSemaphore;
+    for (uint32_t i = 0; i < swapchainMetadata.swapChainImageCount; i++) {
+        result = vkCreateSemaphore(device, &semaphoreInfo, NULL, &semaphores[i]);
+        if (result != VK_SUCCESS) {
+            LOG_ERROR("Failed to create render finished semaphore %u: %d", i, result);
+
+            for (uint32_t j = 0; j < i; ++j) {
+                vkDestroySemaphore(device, semaphores[j], NULL);
+            }
+            free(*renderFinishedSemaphore);
+            *renderFinishedSemaphore = NULL;
+            return VK_RESULT_MAX_ENUM;
+        }
+    }
+    LOG_INFO("Render finished semaphore created successfully");
+
+    // No frame has drawn into the images yet
+    *imageTimelineValues = calloc(swapchainMetadata.swapChainImageCount, sizeof(uint64_t));
+    if (*imageTimelineValues == NULL) {
+        LOG_ERROR("Failed to allocate memory for swapchain image timeline values");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    return result;
+}
+
+// Size the swapchain should have when the surface leaves it up to the application
+static VkExtent2D framebuffer_extent(AppCtx* appCtx)
+{
+    if (appCtx->window == NULL) {
+        return appCtx->headlessExtent;
+    }
+
+    // GLFW window queries are restricted to the event thread
+    return appCtx->framebufferExtent;
+}
+
+#ifdef YACW_SHADER_HOT_RELOAD
+static void shader_reload_ready(void* arg) { appCtx_request_redraw(arg); }
+
+static void destroy_pipeline(VkDevice device, uint64_t handle)
+{
+    vkDestroyPipeline(device, (VkPipeline)handle, NULL);
+}
+#endif
+
+// Names are only set with YACW_ENABLE_VALIDATION, the calls compile away otherwise
+static void name_swapchain_objects(AppCtx* appCtx)
+{
+    VkDevice device = appCtx->device;
+
+    const char* kind = appCtx->swapchain != VK_NULL_HANDLE ? "swapchain" : "offscreen";
+
+    DEBUG_NAME(device, VK_OBJECT_TYPE_SWAPCHAIN_KHR, appCtx->swapchain, "swapchain");
+    for (uint32_t i = 0; i < appCtx->swapchainMetadata.swapChainImageCount; i++) {
+        DEBUG_NAME(
+            device, VK_OBJECT_TYPE_IMAGE, appCtx->swapchainImages[i], "%s image %u", kind, i);
+        DEBUG_NAME(device,
+            VK_OBJECT_TYPE_IMAGE_VIEW,
+            appCtx->swapchainImageViews[i],
+            "%s image view %u",
+            kind,
+            i);
+        if (appCtx->swapchainFramebuffers != NULL) {
+            DEBUG_NAME(device,
+                VK_OBJECT_TYPE_FRAMEBUFFER,
+                appCtx->swapchainFramebuffers[i],
+                "framebuffer %u",
+                i);
+        }
+        DEBUG_NAME(device,
+            VK_OBJECT_TYPE_SEMAPHORE,
+            appCtx->renderFinishedSemaphore[i],
+            "render finished %u",
+            i);
+    }
+}
+
+static void name_objects(AppCtx* appCtx)
+{
+    VkDevice device = appCtx->device;
+
+    DEBUG_NAME(device, VK_OBJECT_TYPE_INSTANCE, appCtx->instance, "instance");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_PHYSICAL_DEVICE, appCtx->physicalDevice, "physical device");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_DEVICE, device, "device");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_SURFACE_KHR, appCtx->surface, "surface");
+
+    VkQueue queue;
+    vkGetDeviceQueue(device, appCtx->queueFamilyIndex, 0, &queue);
+    DEBUG_NAME(device, VK_OBJECT_TYPE_QUEUE, queue, "graphics queue");
+    if (appCtx->transferQueueFamilyIndex != appCtx->queueFamilyIndex) {
+        DEBUG_NAME(device, VK_OBJECT_TYPE_QUEUE, appCtx->upload.queue, "transfer queue");
+    }
+
+    DEBUG_NAME(device, VK_OBJECT_TYPE_COMMAND_POOL, appCtx->upload.commandPool, "upload pool");
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+        DEBUG_NAME(device,
+            VK_OBJECT_TYPE_COMMAND_BUFFER,
+            appCtx->upload.batches[i].commandBuffer,
+            "upload batch %u",
+            i);
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_SEMAPHORE, appCtx->upload.timeline, "upload timeline");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, appCtx->upload.stagingBuffer, "upload staging");
+
+    DEBUG_NAME(device, VK_OBJECT_TYPE_PIPELINE_CACHE, appCtx->pipelineCache, "pipeline cache");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_RENDER_PASS, appCtx->renderPass, "clear render pass");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_RENDER_PASS, appCtx->loadRenderPass, "load render pass");
+    DEBUG_NAME(
+        device, VK_OBJECT_TYPE_PIPELINE_LAYOUT, appCtx->pipelineLayout, "triangle pipeline layout");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_PIPELINE, appCtx->pipeline, "triangle pipeline");
+
+    NkVulkan* ui = &appCtx->ui;
+    DEBUG_NAME(
+        device, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, ui->descriptorSetLayout, "ui set layout");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_DESCRIPTOR_POOL, ui->descriptorPool, "ui descriptor pool");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_DESCRIPTOR_SET, ui->descriptorSet, "ui descriptor set");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_PIPELINE_LAYOUT, ui->pipelineLayout, "ui pipeline layout");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_PIPELINE, ui->pipeline, "ui pipeline");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_IMAGE, ui->fontImage, "ui font atlas");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_IMAGE_VIEW, ui->fontImageView, "ui font atlas view");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_SAMPLER, ui->fontSampler, "ui font sampler");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, ui->streamBuffer, "ui vertex and index ring");
+
+    DEBUG_NAME(device, VK_OBJECT_TYPE_QUERY_POOL, appCtx->timing.queryPool, "frame timestamps");
+
+    static const char* passNames[FRAME_PASS_COUNT] = { "scene", "ui" };
+    for (uint32_t i = 0; i < YACW_FRAMES_IN_FLIGHT; i++) {
+        FrameCtx* frame = &appCtx->frames[i];
+
+        DEBUG_NAME(device, VK_OBJECT_TYPE_COMMAND_POOL, frame->commandPool, "frame %u pool", i);
+        DEBUG_NAME(
+            device, VK_OBJECT_TYPE_COMMAND_BUFFER, frame->commandBuffer, "frame %u commands", i);
+        for (uint32_t pass = 0; pass < FRAME_PASS_COUNT; pass++) {
+            DEBUG_NAME(device,
+                VK_OBJECT_TYPE_COMMAND_POOL,
+                frame->passPools[pass],
+                "frame %u %s pool",
+                i,
+                passNames[pass]);
+            DEBUG_NAME(device,
+                VK_OBJECT_TYPE_COMMAND_BUFFER,
+                frame->passBuffers[pass],
+                "frame %u %s commands",
+                i,
+                passNames[pass]);
+        }
+        DEBUG_NAME(device,
+            VK_OBJECT_TYPE_SEMAPHORE,
+            frame->imageAvailableSemaphore,
+            "frame %u image available",
+            i);
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_SEMAPHORE, appCtx->timeline.semaphore, "frame timeline");
+
+    name_swapchain_objects(appCtx);
+}
+
 VkResult appCtx_init(AppCtx* appCtx)
 {
     VkResult result = VK_SUCCESS;
 
-    result = init_instance(&appCtx->instance);
+    // Read from disk while the instance and device are being created
+    pipeline_cache_prefetch();
+    shader_prefetch();
+
+    bool headlessSurface = false;
+    result = init_instance(
+        appCtx->window == NULL, &appCtx->instance, &headlessSurface, &appCtx->debugMessenger);
     if (result != VK_SUCCESS) {
         return result;
     }
 
-    result = init_surface(appCtx->instance, appCtx->window, &appCtx->surface);
+    result = init_surface(appCtx->instance, appCtx->window, headlessSurface, &appCtx->surface);
     if (result != VK_SUCCESS) {
         return result;
     }
 
-    result = init_physical_device(appCtx->instance, &appCtx->physicalDevice);
+    result = device_select(
+        appCtx->instance, appCtx->surface, appCtx->gpuSelector, &appCtx->physicalDevice);
     if (result != VK_SUCCESS) {
         return result;
     }
@@ -882,85 +1507,279 @@ VkResult appCtx_init(AppCtx* appCtx)
         return result;
     }
 
-    result = init_device(appCtx->queueFamilyIndex, appCtx->physicalDevice, &appCtx->device);
+    result = init_transfer_queue_family_index(
+        appCtx->physicalDevice, appCtx->queueFamilyIndex, &appCtx->transferQueueFamilyIndex);
     if (result != VK_SUCCESS) {
         return result;
     }
 
-    result = init_swapchain_metadata(
-        appCtx->physicalDevice, appCtx->surface, appCtx->window, &appCtx->swapchainMetadata);
+    // Pacing only matters when there is a window to present to
+    bool presentWait = appCtx->window != NULL
+        && frame_pacing_supports_present_wait(appCtx->physicalDevice);
+
+    appCtx->incrementalPresent = appCtx->surface != VK_NULL_HANDLE
+        && device_has_extension(appCtx->physicalDevice, VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+
+    DynamicRenderingSupport dynamicRendering = appCtx->forceRenderPass
+        ? DYNAMIC_RENDERING_NONE
+        : dynamic_rendering_support(appCtx->physicalDevice);
+    Sync2Support sync2 = sync2_support(appCtx->physicalDevice);
+
+    result = init_device(appCtx->queueFamilyIndex,
+        appCtx->transferQueueFamilyIndex,
+        appCtx->physicalDevice,
+        appCtx->surface != VK_NULL_HANDLE,
+        presentWait,
+        appCtx->incrementalPresent,
+        dynamicRendering,
+        sync2,
+        &appCtx->device);
     if (result != VK_SUCCESS) {
         return result;
     }
 
-    result = init_swapchain(appCtx->surface,
+    // Without synchronization2, submissions and barriers are translated to the 1.2 commands
+    if (!sync2_init(&appCtx->sync2, appCtx->device, sync2)) {
+        sync2 = SYNC2_NONE;
+    }
+    LOG_INFO("Synchronizing with %s",
+        sync2 != SYNC2_NONE ? "synchronization2" : "the original barriers and submissions");
+
+    // Render passes still work on every device, so missing entry points only cost the fast path
+    if (!dynamic_rendering_init(
+            &appCtx->dynamicRendering, appCtx->device, dynamicRendering, &appCtx->sync2)) {
+        dynamicRendering = DYNAMIC_RENDERING_NONE;
+    }
+    static const char* renderingPaths[] = { [DYNAMIC_RENDERING_NONE] = "render passes",
+        [DYNAMIC_RENDERING_EXTENSION] = "VK_KHR_dynamic_rendering",
+        [DYNAMIC_RENDERING_CORE] = "Vulkan 1.3 dynamic rendering" };
+    LOG_INFO("Rendering with %s", renderingPaths[dynamicRendering]);
+
+    int refreshHz = 0;
+    if (appCtx->window != NULL) {
+        GLFWmonitor* monitor = glfwGetWindowMonitor(appCtx->window);
+        if (monitor == NULL) {
+            monitor = glfwGetPrimaryMonitor();
+        }
+        const GLFWvidmode* videoMode = monitor != NULL ? glfwGetVideoMode(monitor) : NULL;
+        refreshHz = videoMode != NULL ? videoMode->refreshRate : 0;
+    }
+    frame_pacing_init(&appCtx->pacing, appCtx->device, presentWait, refreshHz);
+
+    result = gpu_memory_init(&appCtx->gpuMemory, appCtx->physicalDevice, appCtx->device);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    VkQueue transferQueue;
+    vkGetDeviceQueue(appCtx->device, appCtx->transferQueueFamilyIndex, 0, &transferQueue);
+
+    result = upload_init(&appCtx->upload,
         appCtx->device,
-        appCtx->swapchainMetadata,
-        &appCtx->swapchain,
-        &appCtx->swapchainImages);
+        &appCtx->gpuMemory,
+        transferQueue,
+        appCtx->transferQueueFamilyIndex,
+        appCtx->queueFamilyIndex);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = pipeline_cache_init(appCtx->physicalDevice, appCtx->device, &appCtx->pipelineCache);
     if (result != VK_SUCCESS) {
         return result;
     }
 
+    if (!job_system_init(&appCtx->jobs, 0)) {
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    // Shader modules and pipelines are built on the workers while this thread sets up everything
+    // else. Failures below must still wait for the jobs, they point into this stack frame.
+    InitJobs init = { 0 };
+    uint64_t waitStartNs;
+    VkResult jobResult;
+    init_jobs_submit_modules(appCtx, &init);
+
+    result = nk_vulkan_init(
+        &appCtx->ui, &appCtx->gpuMemory, &appCtx->upload, appCtx->device, YACW_FRAMES_IN_FLIGHT);
+    if (result != VK_SUCCESS) {
+        goto wait_jobs;
+    }
+
+    result = init_pipeline_layout(appCtx->device, &appCtx->pipelineLayout);
+    if (result != VK_SUCCESS) {
+        goto wait_jobs;
+    }
+
+    if (appCtx->surface != VK_NULL_HANDLE) {
+        result = init_swapchain_metadata(appCtx->physicalDevice,
+            appCtx->surface,
+            framebuffer_extent(appCtx),
+            appCtx->presentPolicy,
+            &appCtx->swapchainMetadata);
+        if (result != VK_SUCCESS) {
+            goto wait_jobs;
+        }
+
+        appCtx->swapchainFinalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    } else {
+        result = init_offscreen(&appCtx->gpuMemory,
+            appCtx->headlessExtent,
+            &appCtx->swapchainMetadata,
+            &appCtx->swapchainImages,
+            &appCtx->offscreenAllocations);
+        if (result != VK_SUCCESS) {
+            goto wait_jobs;
+        }
+
+        // Nothing presents these, leave them ready for readback
+        appCtx->swapchainFinalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    }
+
+    // The render pass only needs the surface format, the pipelines can start before the
+    // swapchain exists
+    if (!dynamic_rendering_enabled(&appCtx->dynamicRendering)) {
+        result = init_render_pass(appCtx->device,
+            appCtx->swapchainMetadata,
+            VK_ATTACHMENT_LOAD_OP_CLEAR,
+            appCtx->swapchainFinalLayout,
+            &appCtx->renderPass);
+        if (result == VK_SUCCESS) {
+            result = init_render_pass(appCtx->device,
+                appCtx->swapchainMetadata,
+                VK_ATTACHMENT_LOAD_OP_LOAD,
+                appCtx->swapchainFinalLayout,
+                &appCtx->loadRenderPass);
+        }
+        if (result != VK_SUCCESS) {
+            goto wait_jobs;
+        }
+    }
+    appCtx->renderTarget = (RenderTarget) { .renderPass = appCtx->renderPass,
+        .colorFormat = appCtx->swapchainMetadata.surfaceFormat.format };
+
+    result = init_jobs_submit_pipeline(appCtx,
+        &init.trianglePipeline,
+        triangle_pipeline_job,
+        &init.modules[SHADER_TRIANGLE_VERT],
+        &init.modules[SHADER_TRIANGLE_FRAG]);
+    if (result == VK_SUCCESS) {
+        result = init_jobs_submit_pipeline(appCtx,
+            &init.uiPipeline,
+            ui_pipeline_job,
+            &init.modules[SHADER_UI_VERT],
+            &init.modules[SHADER_UI_FRAG]);
+        if (result != VK_SUCCESS) {
+            job_wait(&appCtx->jobs, &init.trianglePipeline.job);
+        }
+    }
+    if (result != VK_SUCCESS) {
+        goto wait_jobs;
+    }
+    init.pipelinesSubmitted = true;
+
+    if (appCtx->surface != VK_NULL_HANDLE) {
+        result = init_swapchain(appCtx->surface,
+            appCtx->device,
+            VK_NULL_HANDLE,
+            &appCtx->swapchainMetadata,
+            &appCtx->swapchain,
+            &appCtx->swapchainImages);
+        if (result != VK_SUCCESS) {
+            goto wait_jobs;
+        }
+    }
+
     result = init_image_views(appCtx->device,
         appCtx->swapchainMetadata,
         appCtx->swapchainImages,
         &appCtx->swapchainImageViews);
     if (result != VK_SUCCESS) {
-        return result;
+        goto wait_jobs;
     }
 
-    result = init_render_pass(appCtx->device, appCtx->swapchainMetadata, &appCtx->renderPass);
+    if (appCtx->renderPass != VK_NULL_HANDLE) {
+        result = init_framebuffers(appCtx->device,
+            appCtx->swapchainMetadata,
+            appCtx->swapchainImageViews,
+            appCtx->renderPass,
+            &appCtx->swapchainFramebuffers);
+        if (result != VK_SUCCESS) {
+            goto wait_jobs;
+        }
+    }
+
+    result = init_command_pools(appCtx->queueFamilyIndex, appCtx->device, appCtx->frames);
     if (result != VK_SUCCESS) {
-        return result;
+        goto wait_jobs;
     }
 
-    result = init_pipeline(appCtx->device,
-        appCtx->swapchainMetadata,
-        appCtx->renderPass,
-        &appCtx->pipelineLayout,
-        &appCtx->pipeline);
+    result = frame_timing_init(&appCtx->timing,
+        appCtx->physicalDevice,
+        appCtx->device,
+        appCtx->queueFamilyIndex,
+        YACW_FRAMES_IN_FLIGHT);
     if (result != VK_SUCCESS) {
-        return result;
+        goto wait_jobs;
     }
 
-    result = init_framebuffers(appCtx->device,
-        appCtx->swapchainMetadata,
-        appCtx->swapchainImageViews,
-        appCtx->renderPass,
-        &appCtx->swapchainFramebuffers);
+    result = init_sync_objects(appCtx->device, appCtx->frames, &appCtx->timeline);
     if (result != VK_SUCCESS) {
-        return result;
+        goto wait_jobs;
     }
 
-    result = init_command_pool(appCtx->queueFamilyIndex,
-        appCtx->device,
+    result = init_swapchain_sync_objects(appCtx->device,
         appCtx->swapchainMetadata,
-        appCtx->renderPass,
-        appCtx->swapchainFramebuffers,
-        appCtx->pipeline,
-        &appCtx->commandPool,
-        &appCtx->commandBuffers);
+        &appCtx->renderFinishedSemaphore,
+        &appCtx->imageTimelineValues);
+    if (result == VK_SUCCESS
+        && !damage_history_init(&appCtx->damage, appCtx->swapchainMetadata.swapChainImageCount)) {
+        result = VK_RESULT_MAX_ENUM;
+    }
+
+wait_jobs:
+    waitStartNs = timer_now_ns();
+    jobResult = init_jobs_wait(appCtx, &init);
     if (result != VK_SUCCESS) {
         return result;
     }
+    if (jobResult != VK_SUCCESS) {
+        return jobResult;
+    }
+    LOG_DEBUG("Waited %.3f ms for the pipeline jobs", timer_ns_to_ms(timer_now_ns() - waitStartNs));
 
-    result = init_sync_objects(appCtx->device,
-        appCtx->swapchainMetadata,
-        &appCtx->imageAvailableSemaphore,
-        &appCtx->renderFinishedSemaphore,
-        &appCtx->inFlightFence);
+    name_objects(appCtx);
+
+#ifdef YACW_SHADER_HOT_RELOAD
+    result = shader_reload_init(&appCtx->shaderReload,
+        appCtx->device,
+        appCtx->pipelineCache,
+        &appCtx->renderTarget,
+        appCtx->pipelineLayout,
+        shader_reload_ready,
+        appCtx);
     if (result != VK_SUCCESS) {
         return result;
     }
+#endif
+
+    gpu_memory_log_stats(&appCtx->gpuMemory);
+
+    // Startup assets have all been consumed
+    asset_cache_trim();
 
     return result;
 }
 
-void appCtx_deinit(AppCtx* appCtx)
+// Destroys everything derived from the swapchain images, but not the swapchain itself so it can
+// be handed to the next one as oldSwapchain
+void deinit_swapchain_resources(AppCtx* appCtx)
 {
-    if (appCtx->inFlightFence != VK_NULL_HANDLE) {
-        vkDestroyFence(appCtx->device, appCtx->inFlightFence, NULL);
+    damage_history_deinit(&appCtx->damage);
+
+    if (appCtx->imageTimelineValues != NULL) {
+        free(appCtx->imageTimelineValues);
+        appCtx->imageTimelineValues = NULL;
     }
 
     if (appCtx->renderFinishedSemaphore != NULL) {
@@ -971,31 +1790,371 @@ void appCtx_deinit(AppCtx* appCtx)
         appCtx->renderFinishedSemaphore = NULL;
     }
 
-    if (appCtx->imageAvailableSemaphore != VK_NULL_HANDLE) {
-        vkDestroySemaphore(appCtx->device, appCtx->imageAvailableSemaphore, NULL);
+    if (appCtx->swapchainFramebuffers != NULL) {
+        for (uint32_t i = 0; i < appCtx->swapchainMetadata.swapChainImageCount; i++) {
+            vkDestroyFramebuffer(appCtx->device, appCtx->swapchainFramebuffers[i], NULL);
+        }
+        free(appCtx->swapchainFramebuffers);
+        appCtx->swapchainFramebuffers = NULL;
+    }
+
+    if (appCtx->swapchainImageViews != NULL) {
+        for (uint32_t i = 0; i < appCtx->swapchainMetadata.swapChainImageCount; i++) {
+            vkDestroyImageView(appCtx->device, appCtx->swapchainImageViews[i], NULL);
+        }
+        free(appCtx->swapchainImageViews);
+        appCtx->swapchainImageViews = NULL;
     }
 
-    if (appCtx->commandBuffers != NULL) {
-        vkFreeCommandBuffers(appCtx->device,
-            appCtx->commandPool,
-            appCtx->swapchainMetadata.swapChainImageCount,
-            appCtx->commandBuffers);
-        free(appCtx->commandBuffers);
-        appCtx->commandBuffers = NULL;
+    if (appCtx->offscreenAllocations != NULL) {
+        for (uint32_t i = 0; i < appCtx->swapchainMetadata.swapChainImageCount; i++) {
+            if (appCtx->swapchainImages[i] != VK_NULL_HANDLE) {
+                gpu_memory_destroy_image(&appCtx->gpuMemory,
+                    appCtx->swapchainImages[i],
+                    &appCtx->offscreenAllocations[i]);
+            }
+        }
+        free(appCtx->offscreenAllocations);
+        appCtx->offscreenAllocations = NULL;
     }
 
-    if (appCtx->commandPool != VK_NULL_HANDLE) {
-        vkDestroyCommandPool(appCtx->device, appCtx->commandPool, NULL);
+    // Swapchain images are destroyed by vkDestroySwapchainKHR, only the offscreen ones above
+    // belong to us
+    if (appCtx->swapchainImages != NULL) {
+        free(appCtx->swapchainImages);
+        appCtx->swapchainImages = NULL;
     }
+}
 
-    if (appCtx->swapchainFramebuffers != NULL) {
-        for (uint32_t i = 0; i < appCtx->swapchainMetadata.swapChainImageCount; i++) {
-            vkDestroyFramebuffer(appCtx->device, appCtx->swapchainFramebuffers[i], NULL);
+VkResult appCtx_recreate_swapchain(AppCtx* appCtx)
+{
+    VkResult result;
+
+    // A minimized window has a zero sized framebuffer, nothing can be presented until it is
+    // restored and reports its size again
+    VkExtent2D extent = framebuffer_extent(appCtx);
+    if (extent.width == 0 || extent.height == 0) {
+        appCtx->framebufferResized = true;
+        return VK_SUCCESS;
+    }
+
+    vkDeviceWaitIdle(appCtx->device);
+
+    deinit_swapchain_resources(appCtx);
+
+    VkFormat oldFormat = appCtx->swapchainMetadata.surfaceFormat.format;
+
+    result = init_swapchain_metadata(appCtx->physicalDevice,
+        appCtx->surface,
+        extent,
+        appCtx->presentPolicy,
+        &appCtx->swapchainMetadata);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    // The render pass and pipeline are kept, they only depend on the surface format
+    if (appCtx->swapchainMetadata.surfaceFormat.format != oldFormat) {
+        LOG_ERROR("Surface format changed from %d to %d, cannot recreate swapchain",
+            oldFormat,
+            appCtx->swapchainMetadata.surfaceFormat.format);
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    VkSwapchainKHR oldSwapchain = appCtx->swapchain;
+    appCtx->swapchain = VK_NULL_HANDLE;
+
+    result = init_swapchain(appCtx->surface,
+        appCtx->device,
+        oldSwapchain,
+        &appCtx->swapchainMetadata,
+        &appCtx->swapchain,
+        &appCtx->swapchainImages);
+
+    // The old swapchain is retired either way and no longer used by the GPU
+    vkDestroySwapchainKHR(appCtx->device, oldSwapchain, NULL);
+    frame_pacing_reset(&appCtx->pacing);
+
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = init_image_views(appCtx->device,
+        appCtx->swapchainMetadata,
+        appCtx->swapchainImages,
+        &appCtx->swapchainImageViews);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    if (appCtx->renderPass != VK_NULL_HANDLE) {
+        result = init_framebuffers(appCtx->device,
+            appCtx->swapchainMetadata,
+            appCtx->swapchainImageViews,
+            appCtx->renderPass,
+            &appCtx->swapchainFramebuffers);
+        if (result != VK_SUCCESS) {
+            return result;
         }
-        free(appCtx->swapchainFramebuffers);
-        appCtx->swapchainFramebuffers = NULL;
     }
 
+    result = init_swapchain_sync_objects(appCtx->device,
+        appCtx->swapchainMetadata,
+        &appCtx->renderFinishedSemaphore,
+        &appCtx->imageTimelineValues);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    // The new images have never been drawn, the history starts out fully damaged
+    if (!damage_history_init(&appCtx->damage, appCtx->swapchainMetadata.swapChainImageCount)) {
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    name_swapchain_objects(appCtx);
+    appCtx_request_redraw(appCtx);
+
+    appCtx->framebufferResized = false;
+    LOG_INFO_LIMITED("Swapchain recreated: %ux%u, %u images",
+        appCtx->swapchainMetadata.swapchainExtent.width,
+        appCtx->swapchainMetadata.swapchainExtent.height,
+        appCtx->swapchainMetadata.swapChainImageCount);
+
+    return result;
+}
+
+VkResult appCtx_set_present_policy(AppCtx* appCtx, PresentPolicy policy)
+{
+    if (policy == appCtx->presentPolicy) {
+        return VK_SUCCESS;
+    }
+
+    LOG_INFO("Present policy %s, was %s",
+        present_policy_name(policy),
+        present_policy_name(appCtx->presentPolicy));
+    appCtx->presentPolicy = policy;
+
+    // Headless surfaces keep the mode they were created with
+    if (appCtx->window == NULL) {
+        return VK_SUCCESS;
+    }
+    return appCtx_recreate_swapchain(appCtx);
+}
+
+void appCtx_request_redraw(AppCtx* appCtx)
+{
+    atomic_store_explicit(&appCtx->redrawFrames, YACW_REDRAW_FRAMES, memory_order_relaxed);
+
+    // Wakes the render thread if it is sleeping on input, any thread may call this
+    if (appCtx->window != NULL) {
+        input_queue_wake(&appCtx->input);
+    }
+}
+
+bool appCtx_needs_redraw(AppCtx* appCtx)
+{
+    return atomic_load_explicit(&appCtx->redrawFrames, memory_order_relaxed) > 0;
+}
+
+void appCtx_frame_drawn(AppCtx* appCtx)
+{
+    uint32_t frames = atomic_load_explicit(&appCtx->redrawFrames, memory_order_relaxed);
+    while (frames > 0
+        && !atomic_compare_exchange_weak_explicit(&appCtx->redrawFrames,
+            &frames,
+            frames - 1,
+            memory_order_relaxed,
+            memory_order_relaxed)) { }
+}
+
+void appCtx_begin_frame(AppCtx* appCtx)
+{
+    frame_timeline_collect(&appCtx->timeline);
+
+#ifdef YACW_SHADER_HOT_RELOAD
+    // The frames already submitted may still use the current pipeline, this one will not
+    VkPipeline pipeline = shader_reload_take(&appCtx->shaderReload);
+    if (pipeline != VK_NULL_HANDLE) {
+        frame_timeline_defer(&appCtx->timeline, destroy_pipeline, (uint64_t)appCtx->pipeline);
+        appCtx->pipeline = pipeline;
+        appCtx->sceneDamaged = true;
+        DEBUG_NAME(appCtx->device, VK_OBJECT_TYPE_PIPELINE, pipeline, "triangle pipeline");
+        LOG_INFO("Swapped in the reloaded pipeline");
+    }
+#endif
+}
+
+VkResult appCtx_record_frame(
+    AppCtx* appCtx, VkCommandBuffer commandBuffer, uint32_t imageIndex, Readback* readback)
+{
+    VkResult result;
+
+    FrameCtx* frame = &appCtx->frames[appCtx->currentFrame];
+
+    // The slot's last frame has executed, everything allocated from its pools can be recycled
+    result = vkResetCommandPool(appCtx->device, frame->commandPool, 0);
+    for (uint32_t pass = 0; pass < FRAME_PASS_COUNT && result == VK_SUCCESS; pass++) {
+        result = vkResetCommandPool(appCtx->device, frame->passPools[pass], 0);
+    }
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to reset command pools: %d", result);
+        return result;
+    }
+
+    // Everything staged since the last frame goes out as one transfer submission
+    result = upload_flush(&appCtx->upload);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    VkExtent2D extent = appCtx->swapchainMetadata.swapchainExtent;
+    damage_clear(&appCtx->frameDamage);
+    if (appCtx->sceneDamaged) {
+        damage_set_full(&appCtx->frameDamage);
+        appCtx->sceneDamaged = false;
+    }
+    nk_vulkan_prepare(&appCtx->ui, appCtx->currentFrame, extent, &appCtx->frameDamage);
+    damage_history_push(
+        &appCtx->damage, &appCtx->frameDamage, imageIndex, extent, &appCtx->imageDamage);
+    bool draw = !damage_is_empty(&appCtx->imageDamage);
+
+    FrameTarget target = { .dynamicRendering = &appCtx->dynamicRendering,
+        .renderPass = appCtx->imageDamage.full ? appCtx->renderPass : appCtx->loadRenderPass,
+        .framebuffer = appCtx->swapchainFramebuffers != NULL
+            ? appCtx->swapchainFramebuffers[imageIndex]
+            : VK_NULL_HANDLE,
+        .image = appCtx->swapchainImages[imageIndex],
+        .imageView = appCtx->swapchainImageViews[imageIndex],
+        .finalLayout = appCtx->swapchainFinalLayout };
+
+    // The passes are recorded on the workers while this thread records the primary around them
+    PassRecordJob passJobs[FRAME_PASS_COUNT];
+    for (uint32_t pass = 0; pass < FRAME_PASS_COUNT && draw; pass++) {
+        passJobs[pass] = (PassRecordJob) {
+            .appCtx = appCtx, .pass = (FramePass)pass, .framebuffer = target.framebuffer
+        };
+        job_init(&passJobs[pass].job, record_pass_job, &passJobs[pass]);
+        job_submit(&appCtx->jobs, &passJobs[pass].job);
+    }
+
+    result = record_command_buffer(commandBuffer,
+        appCtx->swapchainMetadata,
+        &target,
+        &appCtx->imageDamage,
+        &appCtx->jobs,
+        passJobs,
+        frame->passBuffers,
+        appCtx->currentFrame,
+        &appCtx->upload,
+        &appCtx->sync2,
+        &frame->uploadWaitValue,
+        &frame->uploadWaitStageMask,
+        &appCtx->timing);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    if (readback != NULL) {
+        readback_record(readback,
+            &appCtx->sync2,
+            commandBuffer,
+            appCtx->swapchainImages[imageIndex],
+            appCtx->swapchainFinalLayout);
+    }
+
+    result = vkEndCommandBuffer(commandBuffer);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to end command buffer: %d", result);
+        return result;
+    }
+
+    return result;
+}
+
+VkResult appCtx_submit_frame(AppCtx* appCtx, VkQueue queue, uint32_t imageIndex)
+{
+    VkResult result;
+
+    FrameCtx* frame = &appCtx->frames[appCtx->currentFrame];
+
+    // Offscreen images are not acquired and not presented, so there is no binary semaphore
+    bool presentable = appCtx->swapchain != VK_NULL_HANDLE;
+
+    // Binary acquire semaphore, plus the upload timeline when this frame consumes uploads
+    VkSemaphoreSubmitInfo waits[2];
+    uint32_t waitCount = 0;
+
+    if (presentable) {
+        waits[waitCount++] = (VkSemaphoreSubmitInfo) {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = frame->imageAvailableSemaphore,
+            .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        };
+    }
+
+    if (frame->uploadWaitValue != 0) {
+        waits[waitCount++] = (VkSemaphoreSubmitInfo) {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = appCtx->upload.timeline,
+            .value = frame->uploadWaitValue,
+            .stageMask = frame->uploadWaitStageMask,
+        };
+    }
+
+    // Signals the frame's timeline value, which the slot and the image are waited on with
+    result = frame_timeline_submit(&appCtx->timeline,
+        &appCtx->sync2,
+        queue,
+        waits,
+        waitCount,
+        frame->commandBuffer,
+        presentable ? appCtx->renderFinishedSemaphore[imageIndex] : VK_NULL_HANDLE,
+        &frame->timelineValue);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    appCtx->imageTimelineValues[imageIndex] = frame->timelineValue;
+    return result;
+}
+
+void appCtx_deinit(AppCtx* appCtx)
+{
+#ifdef YACW_SHADER_HOT_RELOAD
+    shader_reload_deinit(&appCtx->shaderReload);
+#endif
+
+    job_system_deinit(&appCtx->jobs);
+
+    deinit_swapchain_resources(appCtx);
+
+    frame_timeline_deinit(&appCtx->timeline);
+
+    for (uint32_t i = 0; i < YACW_FRAMES_IN_FLIGHT; i++) {
+        FrameCtx* frame = &appCtx->frames[i];
+
+        if (frame->imageAvailableSemaphore != VK_NULL_HANDLE) {
+            vkDestroySemaphore(appCtx->device, frame->imageAvailableSemaphore, NULL);
+        }
+
+        // Command buffers are freed together with their pool
+        if (frame->commandPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(appCtx->device, frame->commandPool, NULL);
+        }
+
+        for (uint32_t pass = 0; pass < FRAME_PASS_COUNT; pass++) {
+            if (frame->passPools[pass] != VK_NULL_HANDLE) {
+                vkDestroyCommandPool(appCtx->device, frame->passPools[pass], NULL);
+            }
+        }
+    }
+
+    nk_vulkan_deinit(&appCtx->ui, appCtx->device);
+
+    frame_timing_deinit(&appCtx->timing);
+
+    upload_deinit(&appCtx->upload);
+
     if (appCtx->pipeline != VK_NULL_HANDLE) {
         vkDestroyPipeline(appCtx->device, appCtx->pipeline, NULL);
     }
@@ -1004,28 +2163,24 @@ void appCtx_deinit(AppCtx* appCtx)
         vkDestroyPipelineLayout(appCtx->device, appCtx->pipelineLayout, NULL);
     }
 
-    if (appCtx->renderPass != VK_NULL_HANDLE) {
-        vkDestroyRenderPass(appCtx->device, appCtx->renderPass, NULL);
+    if (appCtx->loadRenderPass != VK_NULL_HANDLE) {
+        vkDestroyRenderPass(appCtx->device, appCtx->loadRenderPass, NULL);
     }
 
-    if (appCtx->swapchainImageViews != NULL) {
-        for (uint32_t i = 0; i < appCtx->swapchainMetadata.swapChainImageCount; i++) {
-            vkDestroyImageView(appCtx->device, appCtx->swapchainImageViews[i], NULL);
-        }
-        free(appCtx->swapchainImageViews);
-        appCtx->swapchainImageViews = NULL;
+    if (appCtx->renderPass != VK_NULL_HANDLE) {
+        vkDestroyRenderPass(appCtx->device, appCtx->renderPass, NULL);
     }
 
-    // No need to call vkDestroyImage on each of these, they are destroyed by vkDestroySwapchainKHR
-    if (appCtx->swapchainImages != NULL) {
-        free(appCtx->swapchainImages);
-        appCtx->swapchainImages = NULL;
+    if (appCtx->pipelineCache != VK_NULL_HANDLE) {
+        pipeline_cache_deinit(appCtx->device, appCtx->pipelineCache);
     }
 
     if (appCtx->swapchain != VK_NULL_HANDLE) {
         vkDestroySwapchainKHR(appCtx->device, appCtx->swapchain, NULL);
     }
 
+    gpu_memory_deinit(&appCtx->gpuMemory);
+
     if (appCtx->device != VK_NULL_HANDLE) {
         vkDestroyDevice(appCtx->device, NULL);
     }
@@ -1035,6 +2190,7 @@ void appCtx_deinit(AppCtx* appCtx)
     }
 
     if (appCtx->instance != VK_NULL_HANDLE) {
+        debug_utils_deinit(appCtx->instance, appCtx->debugMessenger);
         vkDestroyInstance(appCtx->instance, NULL);
     }
 }
@@ -0,0 +1,238 @@
+#include "asset.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+
+// A power of two, there are only a handful of assets
+#define ASSET_BUCKET_COUNT 64
+
+struct AssetEntry {
+    AssetEntry* next;
+    uint64_t hash;
+    void* data;
+    size_t size;
+    // Identifies the file version, a changed file gets a new entry
+    dev_t device;
+    ino_t inode;
+    struct timespec modified;
+    uint32_t refs;
+    bool cached; // Cleared once the entry is out of the table, it is freed with its last view
+    char path[];
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    AssetEntry* buckets[ASSET_BUCKET_COUNT];
+} assetCache = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+// FNV-1a
+static uint64_t path_hash(const char* path)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char* c = (const unsigned char*)path; *c != '\0'; c++) {
+        hash = (hash ^ *c) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool same_file(const AssetEntry* entry, const struct stat* st)
+{
+    return entry->device == st->st_dev && entry->inode == st->st_ino
+        && entry->size == (size_t)st->st_size && entry->modified.tv_sec == st->st_mtim.tv_sec
+        && entry->modified.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void entry_free(AssetEntry* entry)
+{
+    if (entry->data != NULL) {
+        munmap(entry->data, entry->size);
+    }
+    free(entry);
+}
+
+// Takes the entry out of the table, freeing it unless views still use it. Needs the mutex.
+static void entry_evict(AssetEntry** link)
+{
+    AssetEntry* entry = *link;
+    *link = entry->next;
+    entry->cached = false;
+
+    if (entry->refs == 0) {
+        entry_free(entry);
+    }
+}
+
+// Needs the mutex
+static AssetEntry* entry_map(const char* path, uint64_t hash)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // The identity comes from the descriptor actually mapped, not the earlier stat
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+
+    size_t pathLength = strlen(path);
+    AssetEntry* entry = malloc(sizeof(AssetEntry) + pathLength + 1);
+    if (entry == NULL) {
+        LOG_ERROR("Failed to allocate asset entry for %s", path);
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    *entry = (AssetEntry) { .hash = hash,
+        .size = (size_t)st.st_size,
+        .device = st.st_dev,
+        .inode = st.st_ino,
+        .modified = st.st_mtim,
+        .cached = true };
+    memcpy(entry->path, path, pathLength + 1);
+
+    // mmap rejects empty mappings, an empty file is a valid asset without data
+    if (entry->size > 0) {
+        entry->data = mmap(NULL, entry->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (entry->data == MAP_FAILED) {
+            int error = errno;
+            LOG_ERROR("Failed to map %s: %s", path, strerror(error));
+            free(entry);
+            close(fd);
+            errno = error;
+            return NULL;
+        }
+    }
+    close(fd);
+
+    LOG_DEBUG("Mapped asset %s: %zu bytes", path, entry->size);
+    return entry;
+}
+
+bool asset_acquire(const char* path, AssetView* view)
+{
+    *view = (AssetView) { 0 };
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+
+    uint64_t hash = path_hash(path);
+    AssetEntry** bucket = &assetCache.buckets[hash & (ASSET_BUCKET_COUNT - 1)];
+
+    pthread_mutex_lock(&assetCache.mutex);
+
+    AssetEntry* entry = NULL;
+    for (AssetEntry** link = bucket; *link != NULL; link = &(*link)->next) {
+        if ((*link)->hash != hash || strcmp((*link)->path, path) != 0) {
+            continue;
+        }
+
+        if (same_file(*link, &st)) {
+            entry = *link;
+        } else {
+            LOG_DEBUG("Asset %s changed on disk, remapping", path);
+            entry_evict(link);
+        }
+        break;
+    }
+
+    if (entry == NULL) {
+        entry = entry_map(path, hash);
+        if (entry == NULL) {
+            int error = errno;
+            pthread_mutex_unlock(&assetCache.mutex);
+            errno = error;
+            return false;
+        }
+
+        entry->next = *bucket;
+        *bucket = entry;
+    }
+
+    entry->refs++;
+    pthread_mutex_unlock(&assetCache.mutex);
+
+    *view = (AssetView) { .data = entry->data, .size = entry->size, .entry = entry };
+    return true;
+}
+
+void asset_release(AssetView* view)
+{
+    AssetEntry* entry = view->entry;
+    if (entry == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&assetCache.mutex);
+    entry->refs--;
+    if (entry->refs == 0 && !entry->cached) {
+        entry_free(entry);
+    }
+    pthread_mutex_unlock(&assetCache.mutex);
+
+    *view = (AssetView) { 0 };
+}
+
+void asset_prefetch(const char* path)
+{
+    AssetView view;
+    if (!asset_acquire(path, &view)) {
+        return;
+    }
+
+    if (view.data != NULL && madvise((void*)view.data, view.size, MADV_WILLNEED) != 0) {
+        LOG_WARN("madvise(MADV_WILLNEED) failed for %s: %s", path, strerror(errno));
+    }
+    LOG_DEBUG("Prefetching asset %s: %zu bytes", path, view.size);
+
+    // The mapping stays in the cache for the real acquire
+    asset_release(&view);
+}
+
+void asset_cache_trim(void)
+{
+    pthread_mutex_lock(&assetCache.mutex);
+    for (uint32_t i = 0; i < ASSET_BUCKET_COUNT; i++) {
+        AssetEntry** link = &assetCache.buckets[i];
+        while (*link != NULL) {
+            if ((*link)->refs == 0) {
+                entry_evict(link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&assetCache.mutex);
+}
+
+void asset_cache_deinit(void)
+{
+    asset_cache_trim();
+
+    pthread_mutex_lock(&assetCache.mutex);
+    for (uint32_t i = 0; i < ASSET_BUCKET_COUNT; i++) {
+        while (assetCache.buckets[i] != NULL) {
+            LOG_WARN("Asset %s still has %u views at shutdown",
+                assetCache.buckets[i]->path,
+                assetCache.buckets[i]->refs);
+            entry_evict(&assetCache.buckets[i]);
+        }
+    }
+    pthread_mutex_unlock(&assetCache.mutex);
+}
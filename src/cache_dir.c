@@ -0,0 +1,64 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cache_dir.h"
+#include "log.h"
+
+static bool make_dirs(char* dir)
+{
+    // Create every component in turn, like mkdir -p
+    for (char* p = dir + 1; *p != '\0'; p++) {
+        if (*p != '/') {
+            continue;
+        }
+
+        *p = '\0';
+        int rc = mkdir(dir, 0700);
+        *p = '/';
+
+        if (rc != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+
+    return mkdir(dir, 0700) == 0 || errno == EEXIST;
+}
+
+bool cache_dir_path(const char* fileName, char* path, size_t pathSize)
+{
+    char dir[4096];
+    int len;
+
+    const char* xdgCacheHome = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    if (xdgCacheHome != NULL && xdgCacheHome[0] == '/') {
+        len = snprintf(dir, sizeof(dir), "%s/yacw", xdgCacheHome);
+    } else if (home != NULL && home[0] != '\0') {
+        len = snprintf(dir, sizeof(dir), "%s/.cache/yacw", home);
+    } else {
+        LOG_ERROR("Neither XDG_CACHE_HOME nor HOME is set, no cache directory available");
+        return false;
+    }
+
+    if (len < 0 || (size_t)len >= sizeof(dir)) {
+        LOG_ERROR("Cache directory path is too long");
+        return false;
+    }
+
+    if (!make_dirs(dir)) {
+        LOG_ERROR("Could not create cache directory %s: %s", dir, strerror(errno));
+        return false;
+    }
+
+    len = snprintf(path, pathSize, "%s/%s", dir, fileName);
+    if (len < 0 || (size_t)len >= pathSize) {
+        LOG_ERROR("Cache file path is too long");
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,201 @@
+#include "damage.h"
+
+#include <stdlib.h>
+
+#include "log.h"
+
+// Redrawing most of the image with scissors costs more than one cleared full redraw
+#define DAMAGE_FULL_PERCENT 75
+
+static inline int64_t rect_right(VkRect2D rect)
+{
+    return (int64_t)rect.offset.x + rect.extent.width;
+}
+static inline int64_t rect_bottom(VkRect2D rect)
+{
+    return (int64_t)rect.offset.y + rect.extent.height;
+}
+static inline uint64_t rect_area(VkRect2D rect)
+{
+    return (uint64_t)rect.extent.width * rect.extent.height;
+}
+
+static VkRect2D rect_union(VkRect2D a, VkRect2D b)
+{
+    int32_t x0 = a.offset.x < b.offset.x ? a.offset.x : b.offset.x;
+    int32_t y0 = a.offset.y < b.offset.y ? a.offset.y : b.offset.y;
+    int64_t x1 = rect_right(a) > rect_right(b) ? rect_right(a) : rect_right(b);
+    int64_t y1 = rect_bottom(a) > rect_bottom(b) ? rect_bottom(a) : rect_bottom(b);
+
+    return (VkRect2D) { .offset = { x0, y0 },
+        .extent = { (uint32_t)(x1 - x0), (uint32_t)(y1 - y0) } };
+}
+
+// Rects sharing part of an edge count as overlapping, which saves a rect for at most the area
+// beside the shorter edge. Touching only at a corner does not, its union would cover two
+// undamaged rects as large as the inputs.
+static bool rect_overlaps(VkRect2D a, VkRect2D b)
+{
+    bool touchX = a.offset.x <= rect_right(b) && b.offset.x <= rect_right(a);
+    bool touchY = a.offset.y <= rect_bottom(b) && b.offset.y <= rect_bottom(a);
+    bool crossX = a.offset.x < rect_right(b) && b.offset.x < rect_right(a);
+    bool crossY = a.offset.y < rect_bottom(b) && b.offset.y < rect_bottom(a);
+
+    return (touchX && crossY) || (crossX && touchY);
+}
+
+void damage_add(DamageRegion* region, VkRect2D rect, VkExtent2D extent)
+{
+    VkRect2D bounds = { .offset = { 0, 0 }, .extent = extent };
+    if (region->full || !damage_intersect(rect, bounds, &rect)) {
+        return;
+    }
+
+    // Absorb every rect the growing one overlaps, which may in turn overlap others
+    for (uint32_t i = 0; i < region->count;) {
+        if (rect_overlaps(region->rects[i], rect)) {
+            rect = rect_union(rect, region->rects[i]);
+            region->rects[i] = region->rects[--region->count];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (region->count == DAMAGE_MAX_RECTS) {
+        uint32_t best = 0;
+        uint64_t bestGrowth = UINT64_MAX;
+        for (uint32_t i = 0; i < region->count; i++) {
+            uint64_t growth = rect_area(rect_union(region->rects[i], rect))
+                - rect_area(region->rects[i]) - rect_area(rect);
+            if (growth < bestGrowth) {
+                best = i;
+                bestGrowth = growth;
+            }
+        }
+
+        // The union may now overlap others, so it goes through the merge again
+        rect = rect_union(region->rects[best], rect);
+        region->rects[best] = region->rects[--region->count];
+        damage_add(region, rect, extent);
+        return;
+    }
+
+    region->rects[region->count++] = rect;
+}
+
+void damage_add_region(DamageRegion* region, const DamageRegion* other, VkExtent2D extent)
+{
+    if (other->full) {
+        damage_set_full(region);
+        return;
+    }
+
+    for (uint32_t i = 0; i < other->count; i++) {
+        damage_add(region, other->rects[i], extent);
+    }
+}
+
+bool damage_intersect(VkRect2D a, VkRect2D b, VkRect2D* intersection)
+{
+    int32_t x0 = a.offset.x > b.offset.x ? a.offset.x : b.offset.x;
+    int32_t y0 = a.offset.y > b.offset.y ? a.offset.y : b.offset.y;
+    int64_t x1 = rect_right(a) < rect_right(b) ? rect_right(a) : rect_right(b);
+    int64_t y1 = rect_bottom(a) < rect_bottom(b) ? rect_bottom(a) : rect_bottom(b);
+    if (x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+
+    *intersection = (VkRect2D) { .offset = { x0, y0 },
+        .extent = { (uint32_t)(x1 - x0), (uint32_t)(y1 - y0) } };
+    return true;
+}
+
+VkRect2D damage_bounds(const DamageRegion* region, VkExtent2D extent)
+{
+    if (region->full) {
+        return (VkRect2D) { .offset = { 0, 0 }, .extent = extent };
+    }
+    if (region->count == 0) {
+        return (VkRect2D) { 0 };
+    }
+
+    VkRect2D bounds = region->rects[0];
+    for (uint32_t i = 1; i < region->count; i++) {
+        bounds = rect_union(bounds, region->rects[i]);
+    }
+    return bounds;
+}
+
+bool damage_history_init(DamageHistory* history, uint32_t imageCount)
+{
+    uint64_t* imageFrames = calloc(imageCount, sizeof(uint64_t));
+    if (imageFrames == NULL) {
+        LOG_ERROR("Failed to allocate memory for the damage history");
+        return false;
+    }
+
+    damage_history_deinit(history);
+    history->imageFrames = imageFrames;
+    history->imageCount = imageCount;
+    return true;
+}
+
+void damage_history_deinit(DamageHistory* history)
+{
+    free(history->imageFrames);
+    *history = (DamageHistory) { 0 };
+}
+
+void damage_history_push(DamageHistory* history,
+    const DamageRegion* frameDamage,
+    uint32_t imageIndex,
+    VkExtent2D extent,
+    DamageRegion* imageDamage)
+{
+    uint64_t frame = history->frameCount++;
+    history->frames[frame % DAMAGE_HISTORY] = *frameDamage;
+
+    uint64_t drawn = history->imageFrames[imageIndex];
+    history->imageFrames[imageIndex] = frame + 1;
+
+    // Never drawn, or the frames it missed are no longer remembered
+    if (drawn == 0 || frame + 1 - drawn > DAMAGE_HISTORY) {
+        damage_set_full(imageDamage);
+        return;
+    }
+
+    damage_clear(imageDamage);
+    for (uint64_t missed = drawn; missed <= frame && !imageDamage->full; missed++) {
+        damage_add_region(imageDamage, &history->frames[missed % DAMAGE_HISTORY], extent);
+    }
+
+    uint64_t area = 0;
+    for (uint32_t i = 0; i < imageDamage->count; i++) {
+        area += rect_area(imageDamage->rects[i]);
+    }
+    if (area * 100 >= (uint64_t)extent.width * extent.height * DAMAGE_FULL_PERCENT) {
+        damage_set_full(imageDamage);
+    }
+}
+
+void damage_chain_present(
+    const DamageRegion* damage, VkPresentInfoKHR* presentInfo, DamagePresentRegions* storage)
+{
+    if (damage->full || damage->count == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < damage->count; i++) {
+        storage->rects[i] = (VkRectLayerKHR) { .offset = damage->rects[i].offset,
+            .extent = damage->rects[i].extent,
+            .layer = 0 };
+    }
+    storage->region
+        = (VkPresentRegionKHR) { .rectangleCount = damage->count, .pRectangles = storage->rects };
+    storage->regions = (VkPresentRegionsKHR) { .sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
+        .pNext = presentInfo->pNext,
+        .swapchainCount = 1,
+        .pRegions = &storage->region };
+    presentInfo->pNext = &storage->regions;
+}
@@ -0,0 +1,279 @@
+#include "debug_utils.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_select.h"
+#include "log.h"
+#include "log_format.h"
+
+#define VALIDATION_LAYER_NAME "VK_LAYER_KHRONOS_validation"
+
+// Loaded once the instance exists, shared by every device of it
+static PFN_vkSetDebugUtilsObjectNameEXT setObjectName;
+
+static bool has_layer(const char* name)
+{
+    uint32_t layerCount = 0;
+    if (vkEnumerateInstanceLayerProperties(&layerCount, NULL) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkLayerProperties* layers = malloc(layerCount * sizeof(VkLayerProperties));
+    if (layers == NULL) {
+        return false;
+    }
+
+    bool found = false;
+    if (vkEnumerateInstanceLayerProperties(&layerCount, layers) == VK_SUCCESS) {
+        for (uint32_t i = 0; i < layerCount && !found; i++) {
+            found = strcmp(layers[i].layerName, name) == 0;
+        }
+    }
+
+    free(layers);
+    return found;
+}
+
+// Validation messages quote handles, VUIDs and spec links and easily outgrow the packed arguments
+// of one record, those are written as numbered parts that each fit whole
+static void log_message(LogLevel level, const char* kind, const char* id, const char* message)
+{
+    // Slots for kind, id, the part numbers, the precision and the part's length
+    uint32_t fixedSize = 8 + log_align8((uint32_t)strlen(kind)) + 8
+        + log_align8((uint32_t)strlen(id)) + 4 * 8;
+    size_t partSize = fixedSize + 64 <= LOG_MAX_ARGS_SIZE ? LOG_MAX_ARGS_SIZE - fixedSize : 64;
+
+    size_t length = strlen(message);
+    if (length <= partSize) {
+        log_write(level, __FILE__, __LINE__, "Vulkan %s [%s]: %s", kind, id, message);
+        return;
+    }
+
+    uint32_t partCount = (uint32_t)((length + partSize - 1) / partSize);
+    for (uint32_t part = 0; part < partCount; part++) {
+        size_t offset = part * partSize;
+        size_t size = length - offset < partSize ? length - offset : partSize;
+        log_write(level,
+            __FILE__,
+            __LINE__,
+            "Vulkan %s [%s] %u/%u: %.*s",
+            kind,
+            id,
+            part + 1,
+            partCount,
+            (int)size,
+            message + offset);
+    }
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL messenger_callback(
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    const VkDebugUtilsMessengerCallbackDataEXT* data,
+    void* userData)
+{
+    (void)userData;
+
+    const char* kind = "general";
+    if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT) {
+        kind = "validation";
+    } else if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) {
+        kind = "performance";
+    }
+    const char* id = data->pMessageIdName != NULL ? data->pMessageIdName : "-";
+
+    LogLevel level = LOG_LEVEL_TRACE;
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        level = LOG_LEVEL_ERROR;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        level = LOG_LEVEL_WARN;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+        level = LOG_LEVEL_DEBUG;
+    }
+
+    // May be called from any thread making Vulkan calls, the logger copes with that. Levels
+    // below the compiled-in threshold are dropped like the LOG_* macros drop them.
+    if (level >= YACW_LOG_LEVEL) {
+        log_message(level, kind, id, data->pMessage != NULL ? data->pMessage : "");
+    }
+
+    // Aborting the call is reserved for layer development
+    return VK_FALSE;
+}
+
+static void add_feature(DebugUtilsConfig* config, VkValidationFeatureEnableEXT feature)
+{
+    if (config->validationFeatures.enabledValidationFeatureCount < DEBUG_UTILS_MAX_FEATURES) {
+        config->enabledFeatures[config->validationFeatures.enabledValidationFeatureCount++]
+            = feature;
+    }
+}
+
+// Parses YACW_VALIDATION, returns false if validation is switched off
+static bool parse_settings(DebugUtilsConfig* config)
+{
+    const char* settings = getenv("YACW_VALIDATION");
+    if (settings == NULL || settings[0] == '\0') {
+        return true;
+    }
+    if (strcmp(settings, "0") == 0) {
+        return false;
+    }
+
+    for (const char* at = settings; *at != '\0';) {
+        size_t length = strcspn(at, ",");
+        if (length == 3 && strncmp(at, "gpu", length) == 0) {
+            add_feature(config, VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_EXT);
+            add_feature(config, VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_RESERVE_BINDING_SLOT_EXT);
+        } else if (length == 4 && strncmp(at, "sync", length) == 0) {
+            add_feature(config, VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT);
+        } else if (length == 4 && strncmp(at, "best", length) == 0) {
+            add_feature(config, VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT);
+        } else if (length > 0) {
+            LOG_WARN("Unknown YACW_VALIDATION setting '%.*s'", (int)length, at);
+        }
+
+        at += length;
+        if (*at == ',') {
+            at++;
+        }
+    }
+
+    return true;
+}
+
+void debug_utils_configure(DebugUtilsConfig* config)
+{
+    *config = (DebugUtilsConfig) { 0 };
+    config->validationFeatures = (VkValidationFeaturesEXT) {
+        .sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT,
+        .pEnabledValidationFeatures = config->enabledFeatures,
+    };
+
+    bool validation = parse_settings(config);
+    if (validation && !has_layer(VALIDATION_LAYER_NAME)) {
+        LOG_WARN("%s is not installed, running without validation", VALIDATION_LAYER_NAME);
+        validation = false;
+    }
+
+    if (validation) {
+        config->layers[config->layerCount++] = VALIDATION_LAYER_NAME;
+
+        if (config->validationFeatures.enabledValidationFeatureCount > 0) {
+            if (instance_has_extension(
+                    VALIDATION_LAYER_NAME, VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME)) {
+                config->extensions[config->extensionCount++]
+                    = VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME;
+                config->validationFeatures.pNext = config->pNext;
+                config->pNext = &config->validationFeatures;
+            } else {
+                LOG_WARN("Validation layer lacks %s, YACW_VALIDATION only has the core checks",
+                    VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+            }
+        }
+    }
+
+    // The validation layer provides debug_utils itself when the loader does not
+    bool debugUtils = instance_has_extension(NULL, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)
+        || (validation
+            && instance_has_extension(VALIDATION_LAYER_NAME, VK_EXT_DEBUG_UTILS_EXTENSION_NAME));
+    if (debugUtils) {
+        config->extensions[config->extensionCount++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+
+        config->messengerInfo = (VkDebugUtilsMessengerCreateInfoEXT) {
+            .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+            .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT
+                | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
+                | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+            .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+                | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+                | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+            .pfnUserCallback = messenger_callback,
+        };
+#if YACW_LOG_LEVEL <= YACW_LOG_LEVEL_TRACE
+        config->messengerInfo.messageSeverity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+#endif
+        // Chained into the instance too, so vkCreateInstance and vkDestroyInstance are covered
+        config->messengerInfo.pNext = config->pNext;
+        config->pNext = &config->messengerInfo;
+    }
+
+    LOG_INFO("Vulkan validation %s, %u extra checks, debug utils %s",
+        validation ? "enabled" : "disabled",
+        config->validationFeatures.enabledValidationFeatureCount,
+        debugUtils ? "available" : "unavailable");
+}
+
+VkResult debug_utils_init(
+    VkInstance instance, const DebugUtilsConfig* config, VkDebugUtilsMessengerEXT* messenger)
+{
+    *messenger = VK_NULL_HANDLE;
+    setObjectName = NULL;
+
+    if (config->messengerInfo.sType == 0) {
+        return VK_SUCCESS;
+    }
+
+    PFN_vkCreateDebugUtilsMessengerEXT createMessenger
+        = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+            instance, "vkCreateDebugUtilsMessengerEXT");
+    if (createMessenger == NULL) {
+        LOG_WARN("vkCreateDebugUtilsMessengerEXT is missing, running without a debug messenger");
+        return VK_SUCCESS;
+    }
+
+    // The instance-only chain must not be passed on
+    VkDebugUtilsMessengerCreateInfoEXT createInfo = config->messengerInfo;
+    createInfo.pNext = NULL;
+
+    VkResult result = createMessenger(instance, &createInfo, NULL, messenger);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create the debug messenger: %d", result);
+        return result;
+    }
+
+    setObjectName = (PFN_vkSetDebugUtilsObjectNameEXT)vkGetInstanceProcAddr(
+        instance, "vkSetDebugUtilsObjectNameEXT");
+
+    return VK_SUCCESS;
+}
+
+void debug_utils_deinit(VkInstance instance, VkDebugUtilsMessengerEXT messenger)
+{
+    setObjectName = NULL;
+
+    if (messenger == VK_NULL_HANDLE) {
+        return;
+    }
+
+    PFN_vkDestroyDebugUtilsMessengerEXT destroyMessenger
+        = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+            instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (destroyMessenger != NULL) {
+        destroyMessenger(instance, messenger, NULL);
+    }
+}
+
+void debug_utils_name(VkDevice device, VkObjectType type, uint64_t handle, const char* format, ...)
+{
+    if (setObjectName == NULL || handle == 0) {
+        return;
+    }
+
+    char name[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(name, sizeof(name), format, args);
+    va_end(args);
+
+    VkDebugUtilsObjectNameInfoEXT nameInfo = { .sType
+        = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+        .objectType = type,
+        .objectHandle = handle,
+        .pObjectName = name };
+    setObjectName(device, &nameInfo);
+}
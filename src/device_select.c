@@ -0,0 +1,434 @@
+#include "device_select.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "asset.h"
+#include "cache_dir.h"
+#include "log.h"
+
+#define DEVICE_CACHE_FILE_NAME "device_uuid.bin"
+
+typedef struct DeviceInfo {
+    VkPhysicalDevice handle;
+    VkPhysicalDeviceProperties properties;
+    uint8_t uuid[VK_UUID_SIZE];
+} DeviceInfo;
+
+static const char* device_type_name(VkPhysicalDeviceType type)
+{
+    switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        return "cpu";
+    default:
+        return "other";
+    }
+}
+
+static void device_info(VkPhysicalDevice handle, DeviceInfo* info)
+{
+    VkPhysicalDeviceIDProperties idProperties
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES };
+    VkPhysicalDeviceProperties2 properties = { .sType
+        = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &idProperties };
+    vkGetPhysicalDeviceProperties2(handle, &properties);
+
+    info->handle = handle;
+    info->properties = properties.properties;
+    memcpy(info->uuid, idProperties.deviceUUID, VK_UUID_SIZE);
+}
+
+bool device_has_extension(VkPhysicalDevice physicalDevice, const char* name)
+{
+    uint32_t extensionCount = 0;
+    if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL)
+        != VK_SUCCESS) {
+        return false;
+    }
+
+    VkExtensionProperties* extensions = malloc(extensionCount * sizeof(VkExtensionProperties));
+    if (extensions == NULL) {
+        return false;
+    }
+
+    bool found = false;
+    if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, extensions)
+        == VK_SUCCESS) {
+        for (uint32_t i = 0; i < extensionCount && !found; i++) {
+            found = strcmp(extensions[i].extensionName, name) == 0;
+        }
+    }
+
+    free(extensions);
+    return found;
+}
+
+bool instance_has_extension(const char* layerName, const char* name)
+{
+    uint32_t extensionCount = 0;
+    if (vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, NULL) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkExtensionProperties* extensions = malloc(extensionCount * sizeof(VkExtensionProperties));
+    if (extensions == NULL) {
+        return false;
+    }
+
+    bool found = false;
+    if (vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, extensions)
+        == VK_SUCCESS) {
+        for (uint32_t i = 0; i < extensionCount && !found; i++) {
+            found = strcmp(extensions[i].extensionName, name) == 0;
+        }
+    }
+
+    free(extensions);
+    return found;
+}
+
+// Returns 0 for a device that cannot run the app, logging why
+static uint64_t device_score(const DeviceInfo* info, VkSurfaceKHR surface)
+{
+    const char* name = info->properties.deviceName;
+
+    if (info->properties.apiVersion < VK_API_VERSION_1_2) {
+        LOG_INFO("GPU %s: Vulkan %u.%u, 1.2 is required",
+            name,
+            VK_API_VERSION_MAJOR(info->properties.apiVersion),
+            VK_API_VERSION_MINOR(info->properties.apiVersion));
+        return 0;
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    VkPhysicalDeviceFeatures2 features
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &vulkan12Features };
+    vkGetPhysicalDeviceFeatures2(info->handle, &features);
+    if (!vulkan12Features.timelineSemaphore) {
+        LOG_INFO("GPU %s: timeline semaphores are not supported", name);
+        return 0;
+    }
+
+    if (surface != VK_NULL_HANDLE
+        && !device_has_extension(info->handle, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+        LOG_INFO("GPU %s: %s is not supported", name, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        return 0;
+    }
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(info->handle, &queueFamilyCount, NULL);
+    VkQueueFamilyProperties* queueFamilies
+        = malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+    if (queueFamilies == NULL) {
+        return 0;
+    }
+    vkGetPhysicalDeviceQueueFamilyProperties(info->handle, &queueFamilyCount, queueFamilies);
+
+    // Same criteria as init_queue_family_index and init_transfer_queue_family_index
+    bool graphicsPresent = false;
+    bool dedicatedTransfer = false;
+    bool asyncCompute = false;
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+
+        if (flags & VK_QUEUE_GRAPHICS_BIT) {
+            VkBool32 presentSupport = surface == VK_NULL_HANDLE;
+            if (!presentSupport
+                && vkGetPhysicalDeviceSurfaceSupportKHR(
+                       info->handle, i, surface, &presentSupport)
+                    != VK_SUCCESS) {
+                presentSupport = VK_FALSE;
+            }
+            graphicsPresent = graphicsPresent || presentSupport;
+        } else if (flags & VK_QUEUE_COMPUTE_BIT) {
+            asyncCompute = true;
+        } else if (flags & VK_QUEUE_TRANSFER_BIT) {
+            dedicatedTransfer = true;
+        }
+    }
+    free(queueFamilies);
+
+    if (!graphicsPresent) {
+        LOG_INFO("GPU %s: no graphics queue family can present to the surface", name);
+        return 0;
+    }
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(info->handle, &memoryProperties);
+
+    VkDeviceSize deviceLocalSize = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        const VkMemoryHeap* heap = &memoryProperties.memoryHeaps[i];
+        if ((heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap->size > deviceLocalSize) {
+            deviceLocalSize = heap->size;
+        }
+    }
+
+    // The type dominates: memory counts up to 16 GiB, which an integrated GPU sharing system
+    // memory easily reports
+    uint64_t score = 1;
+    switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        score += 4000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        score += 2000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        score += 1000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        score += 100;
+        break;
+    default:
+        break;
+    }
+
+    uint64_t deviceLocalMiB = deviceLocalSize / (1024 * 1024);
+    score += (deviceLocalMiB < 16384 ? deviceLocalMiB : 16384) / 16;
+    score += dedicatedTransfer ? 200 : 0;
+    score += asyncCompute ? 100 : 0;
+
+    LOG_DEBUG("GPU %s: %" PRIu64 " MiB device-local, dedicated transfer %s, async compute %s",
+        name,
+        deviceLocalMiB,
+        dedicatedTransfer ? "yes" : "no",
+        asyncCompute ? "yes" : "no");
+
+    return score;
+}
+
+static void format_uuid(const uint8_t* uuid, char* text)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *text++ = '-';
+        }
+        *text++ = hex[uuid[i] >> 4];
+        *text++ = hex[uuid[i] & 0xf];
+    }
+    *text = '\0';
+}
+
+static bool parse_uuid(const char* text, uint8_t* uuid)
+{
+    uint32_t digits = 0;
+    for (; *text != '\0'; text++) {
+        if (*text == '-') {
+            continue;
+        }
+        if (!isxdigit((unsigned char)*text) || digits == 2 * VK_UUID_SIZE) {
+            return false;
+        }
+
+        uint8_t value = (uint8_t)(isdigit((unsigned char)*text)
+                ? *text - '0'
+                : tolower((unsigned char)*text) - 'a' + 10);
+        uuid[digits / 2] = (uint8_t)(digits % 2 == 0 ? value << 4 : uuid[digits / 2] | value);
+        digits++;
+    }
+
+    return digits == 2 * VK_UUID_SIZE;
+}
+
+static bool contains_ignoring_case(const char* haystack, const char* needle)
+{
+    size_t needleLength = strlen(needle);
+    for (; *haystack != '\0'; haystack++) {
+        size_t i = 0;
+        while (i < needleLength
+            && tolower((unsigned char)haystack[i]) == tolower((unsigned char)needle[i])) {
+            i++;
+        }
+        if (i == needleLength) {
+            return true;
+        }
+    }
+    return needleLength == 0;
+}
+
+static bool selector_matches(const char* selector, uint32_t index, const DeviceInfo* info)
+{
+    char* end;
+    unsigned long selectedIndex = strtoul(selector, &end, 10);
+    if (isdigit((unsigned char)selector[0]) && *end == '\0') {
+        return selectedIndex == index;
+    }
+
+    uint8_t uuid[VK_UUID_SIZE];
+    if (parse_uuid(selector, uuid)) {
+        return memcmp(uuid, info->uuid, VK_UUID_SIZE) == 0;
+    }
+
+    return contains_ignoring_case(info->properties.deviceName, selector);
+}
+
+static bool read_cached_uuid(const char* path, uint8_t* uuid)
+{
+    AssetView file;
+    if (!asset_acquire(path, &file)) {
+        return false;
+    }
+
+    bool valid = file.size == VK_UUID_SIZE;
+    if (valid) {
+        memcpy(uuid, file.data, VK_UUID_SIZE);
+    }
+    asset_release(&file);
+
+    return valid;
+}
+
+static void write_cached_uuid(const char* path, const uint8_t* uuid)
+{
+    char tmpPath[4096 + 32];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%ld.tmp", path, (long)getpid());
+
+    FILE* fp = fopen(tmpPath, "wb");
+    if (fp == NULL) {
+        LOG_ERROR("Could not open %s for writing: %s", tmpPath, strerror(errno));
+        return;
+    }
+
+    bool written = fwrite(uuid, 1, VK_UUID_SIZE, fp) == VK_UUID_SIZE;
+    written = (fclose(fp) == 0) && written;
+
+    if (!written || rename(tmpPath, path) != 0) {
+        LOG_ERROR("Could not write %s: %s", path, strerror(errno));
+        unlink(tmpPath);
+    }
+}
+
+VkResult device_select(VkInstance instance,
+    VkSurfaceKHR surface,
+    const char* selector,
+    VkPhysicalDevice* physicalDevice)
+{
+    VkResult result;
+
+    uint32_t deviceCount = 0;
+    result = vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to enumerate physical devices: %d", result);
+        return result;
+    }
+    if (deviceCount == 0) {
+        LOG_ERROR("No physical devices found");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    VkPhysicalDevice* handles = malloc(deviceCount * sizeof(VkPhysicalDevice));
+    DeviceInfo* devices = malloc(deviceCount * sizeof(DeviceInfo));
+    if (handles == NULL || devices == NULL) {
+        LOG_ERROR("Failed to allocate %u physical devices", deviceCount);
+        free(handles);
+        free(devices);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    result = vkEnumeratePhysicalDevices(instance, &deviceCount, handles);
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+        LOG_ERROR("Failed to enumerate physical devices: %d", result);
+        free(handles);
+        free(devices);
+        return result;
+    }
+
+    // Identifying a device is cheap, scoring it is what the cached choice saves
+    for (uint32_t i = 0; i < deviceCount; i++) {
+        device_info(handles[i], &devices[i]);
+    }
+    free(handles);
+
+    char cachePath[4096];
+    bool haveCachePath = cache_dir_path(DEVICE_CACHE_FILE_NAME, cachePath, sizeof(cachePath));
+
+    int64_t chosen = -1;
+    uint8_t cachedUuid[VK_UUID_SIZE];
+    bool haveCachedUuid
+        = selector == NULL && haveCachePath && read_cached_uuid(cachePath, cachedUuid);
+    if (haveCachedUuid) {
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            if (memcmp(devices[i].uuid, cachedUuid, VK_UUID_SIZE) == 0
+                && device_score(&devices[i], surface) > 0) {
+                chosen = i;
+                break;
+            }
+        }
+
+        if (chosen < 0) {
+            LOG_INFO("Previously selected GPU is gone or unsuitable, selecting again");
+        }
+    }
+
+    if (chosen < 0) {
+        uint64_t bestScore = 0;
+        bool matched = false;
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            char uuid[2 * VK_UUID_SIZE + 5];
+            format_uuid(devices[i].uuid, uuid);
+
+            if (selector != NULL && !selector_matches(selector, i, &devices[i])) {
+                LOG_INFO("GPU %u: %s (%s, %s), not selected",
+                    i,
+                    devices[i].properties.deviceName,
+                    device_type_name(devices[i].properties.deviceType),
+                    uuid);
+                continue;
+            }
+            matched = true;
+
+            uint64_t score = device_score(&devices[i], surface);
+            LOG_INFO("GPU %u: %s (%s, %s), score %" PRIu64,
+                i,
+                devices[i].properties.deviceName,
+                device_type_name(devices[i].properties.deviceType),
+                uuid,
+                score);
+
+            if (score > bestScore) {
+                bestScore = score;
+                chosen = i;
+            }
+        }
+
+        if (selector != NULL && !matched) {
+            LOG_ERROR("No GPU matches \"%s\", expected an index, a UUID or part of a name",
+                selector);
+        }
+    }
+
+    if (chosen < 0) {
+        LOG_ERROR("No suitable physical device found");
+        free(devices);
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    // Only automatic choices are remembered, an override applies to its own run
+    if (selector == NULL && haveCachePath
+        && (!haveCachedUuid || memcmp(devices[chosen].uuid, cachedUuid, VK_UUID_SIZE) != 0)) {
+        write_cached_uuid(cachePath, devices[chosen].uuid);
+    }
+
+    *physicalDevice = devices[chosen].handle;
+    LOG_INFO("Selected physical device: %s", devices[chosen].properties.deviceName);
+
+    free(devices);
+    return VK_SUCCESS;
+}
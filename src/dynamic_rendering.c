@@ -0,0 +1,170 @@
+#include "dynamic_rendering.h"
+
+#include "device_select.h"
+#include "log.h"
+
+DynamicRenderingSupport dynamic_rendering_support(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    DynamicRenderingSupport support = DYNAMIC_RENDERING_NONE;
+    if (properties.apiVersion >= VK_API_VERSION_1_3) {
+        support = DYNAMIC_RENDERING_CORE;
+    } else if (device_has_extension(physicalDevice, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+        support = DYNAMIC_RENDERING_EXTENSION;
+    } else {
+        return DYNAMIC_RENDERING_NONE;
+    }
+
+    VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES };
+    VkPhysicalDeviceFeatures2 features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &dynamicRenderingFeatures };
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    return dynamicRenderingFeatures.dynamicRendering ? support : DYNAMIC_RENDERING_NONE;
+}
+
+bool dynamic_rendering_init(DynamicRendering* rendering,
+    VkDevice device,
+    DynamicRenderingSupport support,
+    const Sync2* sync2)
+{
+    *rendering = (DynamicRendering) { 0 };
+    if (support == DYNAMIC_RENDERING_NONE) {
+        return true;
+    }
+
+    bool core = support == DYNAMIC_RENDERING_CORE;
+    PFN_vkCmdBeginRendering begin = (PFN_vkCmdBeginRendering)vkGetDeviceProcAddr(
+        device, core ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+    PFN_vkCmdEndRendering end = (PFN_vkCmdEndRendering)vkGetDeviceProcAddr(
+        device, core ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+    if (begin == NULL || end == NULL) {
+        LOG_WARN("Dynamic rendering entry points are missing");
+        return false;
+    }
+
+    *rendering = (DynamicRendering) { .begin = begin, .end = end, .sync2 = sync2 };
+    return true;
+}
+
+const void* render_target_pipeline_chain(
+    const RenderTarget* target, VkPipelineRenderingCreateInfo* storage)
+{
+    if (target->renderPass != VK_NULL_HANDLE) {
+        return NULL;
+    }
+
+    *storage = (VkPipelineRenderingCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &target->colorFormat,
+    };
+    return storage;
+}
+
+const void* render_target_inheritance_chain(
+    const RenderTarget* target, VkCommandBufferInheritanceRenderingInfo* storage)
+{
+    if (target->renderPass != VK_NULL_HANDLE) {
+        return NULL;
+    }
+
+    *storage = (VkCommandBufferInheritanceRenderingInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &target->colorFormat,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+    };
+    return storage;
+}
+
+static void transition(const DynamicRendering* rendering,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    VkAccessFlags2 srcAccessMask,
+    VkAccessFlags2 dstAccessMask,
+    VkPipelineStageFlags2 srcStageMask,
+    VkPipelineStageFlags2 dstStageMask)
+{
+    VkImageMemoryBarrier2 barrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = srcStageMask,
+        .srcAccessMask = srcAccessMask,
+        .dstStageMask = dstStageMask,
+        .dstAccessMask = dstAccessMask,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1 } };
+
+    sync2_image_barrier(rendering->sync2, commandBuffer, &barrier);
+}
+
+void dynamic_rendering_begin(const DynamicRendering* rendering,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageView imageView,
+    VkImageLayout finalLayout,
+    VkRect2D renderArea,
+    bool clear,
+    const VkClearValue* clearValue)
+{
+    // Also waits for the acquire semaphore and the readback of the image's previous frame
+    transition(rendering,
+        commandBuffer,
+        image,
+        clear ? VK_IMAGE_LAYOUT_UNDEFINED : finalLayout,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_ACCESS_2_NONE,
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+            | (clear ? VK_ACCESS_2_NONE : VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT),
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+    VkRenderingAttachmentInfo colorAttachment
+        = { .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+              .imageView = imageView,
+              .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+              .resolveMode = VK_RESOLVE_MODE_NONE,
+              .loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD,
+              .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+              .clearValue = *clearValue };
+
+    VkRenderingInfo renderingInfo = { .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT,
+        .renderArea = renderArea,
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachment };
+
+    rendering->begin(commandBuffer, &renderingInfo);
+}
+
+void dynamic_rendering_end(const DynamicRendering* rendering,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageLayout finalLayout)
+{
+    rendering->end(commandBuffer);
+
+    // Orders the final layout transition before a readback recorded afterwards
+    transition(rendering,
+        commandBuffer,
+        image,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        finalLayout,
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_ACCESS_2_TRANSFER_READ_BIT,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT);
+}
@@ -0,0 +1,200 @@
+#include "frame_pacing.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include "device_select.h"
+#include "log.h"
+#include "timer.h"
+
+// Present waits give up after this long so a hidden window cannot stall the loop forever
+#define FRAME_PACING_WAIT_TIMEOUT_NS (100 * 1000000ull)
+// The sleep limiter wakes up this early and spins the rest, sleeps overshoot by up to a
+// scheduler tick
+#define FRAME_PACING_SPIN_NS (1000000ull)
+
+static const char* policyNames[PRESENT_POLICY_COUNT] = {
+    [PRESENT_POLICY_VSYNC] = "vsync",
+    [PRESENT_POLICY_LOW_LATENCY] = "low-latency",
+    [PRESENT_POLICY_UNCAPPED] = "uncapped",
+    [PRESENT_POLICY_POWER_SAVE] = "power-save",
+};
+
+const char* present_policy_name(PresentPolicy policy)
+{
+    return policy < PRESENT_POLICY_COUNT ? policyNames[policy] : "unknown";
+}
+
+bool present_policy_parse(const char* name, PresentPolicy* policy)
+{
+    for (uint32_t i = 0; i < PRESENT_POLICY_COUNT; i++) {
+        if (strcmp(name, policyNames[i]) == 0) {
+            *policy = (PresentPolicy)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool frame_pacing_supports_present_wait(VkPhysicalDevice physicalDevice)
+{
+    if (!device_has_extension(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME)
+        || !device_has_extension(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+        return false;
+    }
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+              .pNext = &presentWaitFeatures };
+    VkPhysicalDeviceFeatures2 features
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &presentIdFeatures };
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+}
+
+VkPresentModeKHR frame_pacing_present_mode(
+    PresentPolicy policy, const VkPresentModeKHR* modes, uint32_t modeCount)
+{
+    // In order of preference, FIFO is always supported and ends every list
+    static const VkPresentModeKHR preferences[PRESENT_POLICY_COUNT][4] = {
+        [PRESENT_POLICY_VSYNC] = { VK_PRESENT_MODE_FIFO_KHR },
+        [PRESENT_POLICY_LOW_LATENCY] = { VK_PRESENT_MODE_MAILBOX_KHR,
+            VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+            VK_PRESENT_MODE_FIFO_KHR },
+        [PRESENT_POLICY_UNCAPPED] = { VK_PRESENT_MODE_IMMEDIATE_KHR,
+            VK_PRESENT_MODE_MAILBOX_KHR,
+            VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+            VK_PRESENT_MODE_FIFO_KHR },
+        [PRESENT_POLICY_POWER_SAVE] = { VK_PRESENT_MODE_FIFO_KHR },
+    };
+
+    for (uint32_t i = 0; i < 4; i++) {
+        VkPresentModeKHR preferred = preferences[policy][i];
+        for (uint32_t j = 0; j < modeCount; j++) {
+            if (modes[j] == preferred) {
+                return preferred;
+            }
+        }
+        if (preferred == VK_PRESENT_MODE_FIFO_KHR) {
+            break;
+        }
+    }
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t frame_pacing_image_count(
+    PresentPolicy policy, VkPresentModeKHR mode, const VkSurfaceCapabilitiesKHR* capabilities)
+{
+    uint32_t imageCount = capabilities->minImageCount + 1;
+    if (policy == PRESENT_POLICY_POWER_SAVE) {
+        // Nothing runs ahead, one image on screen and one being rendered is enough
+        imageCount = capabilities->minImageCount > 2 ? capabilities->minImageCount : 2;
+    } else if (mode == VK_PRESENT_MODE_MAILBOX_KHR && imageCount < 3) {
+        // Mailbox only avoids blocking with a spare image to render into
+        imageCount = 3;
+    }
+
+    if (imageCount < capabilities->minImageCount) {
+        imageCount = capabilities->minImageCount;
+    }
+    if (capabilities->maxImageCount > 0 && imageCount > capabilities->maxImageCount) {
+        imageCount = capabilities->maxImageCount;
+    }
+    return imageCount;
+}
+
+void frame_pacing_init(FramePacing* pacing, VkDevice device, bool presentWait, int refreshHz)
+{
+    *pacing = (FramePacing) { .device = device,
+        .refreshNs = 1000000000ull / (uint64_t)(refreshHz > 0 ? refreshHz : 60) };
+
+    if (presentWait) {
+        pacing->waitForPresent
+            = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+    }
+
+    LOG_INFO("Frame pacing: %s, %.3f ms refresh interval",
+        pacing->waitForPresent != NULL ? "present wait" : "sleep limiter",
+        timer_ns_to_ms(pacing->refreshNs));
+}
+
+void frame_pacing_reset(FramePacing* pacing)
+{
+    pacing->presentId = 0;
+    pacing->nextFrameNs = 0;
+}
+
+static void sleep_until(uint64_t deadlineNs)
+{
+    if (deadlineNs > FRAME_PACING_SPIN_NS) {
+        uint64_t wakeNs = deadlineNs - FRAME_PACING_SPIN_NS;
+        struct timespec wake = { .tv_sec = (time_t)(wakeNs / 1000000000ull),
+            .tv_nsec = (long)(wakeNs % 1000000000ull) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) { }
+    }
+
+    while (timer_now_ns() < deadlineNs) {
+        sched_yield();
+    }
+}
+
+static void limit(FramePacing* pacing, uint64_t intervalNs)
+{
+    uint64_t nowNs = timer_now_ns();
+    if (nowNs < pacing->nextFrameNs) {
+        sleep_until(pacing->nextFrameNs);
+        pacing->nextFrameNs += intervalNs;
+    } else {
+        // Running late, start over from now rather than rushing the following frames
+        pacing->nextFrameNs = nowNs + intervalNs;
+    }
+}
+
+void frame_pacing_wait(FramePacing* pacing, PresentPolicy policy, VkSwapchainKHR swapchain)
+{
+    if (policy != PRESENT_POLICY_LOW_LATENCY && policy != PRESENT_POLICY_POWER_SAVE) {
+        return;
+    }
+
+    // Waiting for the previous frame to reach the screen keeps a single frame queued, so input
+    // is sampled as late as possible
+    bool waited = false;
+    if (pacing->waitForPresent != NULL && pacing->presentId > 0) {
+        VkResult result = pacing->waitForPresent(
+            pacing->device, swapchain, pacing->presentId, FRAME_PACING_WAIT_TIMEOUT_NS);
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+            waited = true;
+        } else if (result != VK_TIMEOUT && result != VK_ERROR_OUT_OF_DATE_KHR) {
+            LOG_WARN_LIMITED("Waiting for present %llu failed: %d",
+                (unsigned long long)pacing->presentId,
+                result);
+        }
+    }
+
+    if (policy == PRESENT_POLICY_POWER_SAVE) {
+        limit(pacing, 2 * pacing->refreshNs);
+    } else if (!waited) {
+        limit(pacing, pacing->refreshNs);
+    }
+}
+
+void frame_pacing_present(
+    FramePacing* pacing, VkPresentInfoKHR* presentInfo, VkPresentIdKHR* presentId)
+{
+    if (pacing->waitForPresent == NULL) {
+        return;
+    }
+
+    pacing->presentId++;
+    *presentId = (VkPresentIdKHR) { .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+        .pNext = presentInfo->pNext,
+        .swapchainCount = 1,
+        .pPresentIds = &pacing->presentId };
+    presentInfo->pNext = presentId;
+}
@@ -0,0 +1,162 @@
+#include "frame_timeline.h"
+
+#include "log.h"
+
+VkResult frame_timeline_init(FrameTimeline* timeline, VkDevice device)
+{
+    *timeline = (FrameTimeline) { .device = device };
+
+    VkSemaphoreTypeCreateInfo timelineInfo
+        = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+              .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+              .initialValue = 0 };
+    VkSemaphoreCreateInfo semaphoreInfo
+        = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &timelineInfo };
+
+    VkResult result = vkCreateSemaphore(device, &semaphoreInfo, NULL, &timeline->semaphore);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create frame timeline semaphore: %d", result);
+        return result;
+    }
+
+    return result;
+}
+
+static void run_deletions(FrameTimeline* timeline, uint64_t completed)
+{
+    while (timeline->deletionCount > 0) {
+        FrameDeletion* deletion = &timeline->deletions[timeline->deletionHead];
+        if (deletion->value > completed) {
+            break;
+        }
+
+        deletion->destroy(timeline->device, deletion->handle);
+        timeline->deletionHead = (timeline->deletionHead + 1) % FRAME_TIMELINE_MAX_DELETIONS;
+        timeline->deletionCount--;
+    }
+}
+
+void frame_timeline_deinit(FrameTimeline* timeline)
+{
+    if (timeline->semaphore == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // Should the wait fail the device is lost, nothing still uses the objects then either
+    frame_timeline_wait(timeline, timeline->submitted);
+    run_deletions(timeline, UINT64_MAX);
+
+    vkDestroySemaphore(timeline->device, timeline->semaphore, NULL);
+    timeline->semaphore = VK_NULL_HANDLE;
+}
+
+uint64_t frame_timeline_completed(FrameTimeline* timeline)
+{
+    uint64_t completed;
+    if (timeline->completed < timeline->submitted
+        && vkGetSemaphoreCounterValue(timeline->device, timeline->semaphore, &completed)
+            == VK_SUCCESS) {
+        timeline->completed = completed;
+    }
+
+    return timeline->completed;
+}
+
+VkResult frame_timeline_wait(FrameTimeline* timeline, uint64_t value)
+{
+    if (value <= timeline->completed) {
+        return VK_SUCCESS;
+    }
+
+    VkSemaphoreWaitInfo waitInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &timeline->semaphore,
+        .pValues = &value };
+
+    VkResult result = vkWaitSemaphores(timeline->device, &waitInfo, UINT64_MAX);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to wait for frame timeline value %llu: %d",
+            (unsigned long long)value,
+            result);
+        return result;
+    }
+
+    timeline->completed = value;
+    return result;
+}
+
+VkResult frame_timeline_submit(FrameTimeline* timeline,
+    const Sync2* sync2,
+    VkQueue queue,
+    const VkSemaphoreSubmitInfo* waits,
+    uint32_t waitCount,
+    VkCommandBuffer commandBuffer,
+    VkSemaphore signalSemaphore,
+    uint64_t* value)
+{
+    uint64_t signalValue = timeline->submitted + 1;
+
+    VkSemaphoreSubmitInfo signals[2] = {
+        { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = timeline->semaphore,
+            .value = signalValue,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT },
+        { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = signalSemaphore,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT },
+    };
+
+    VkCommandBufferSubmitInfo commandBufferInfo
+        = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = commandBuffer };
+
+    VkSubmitInfo2 submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .waitSemaphoreInfoCount = waitCount,
+        .pWaitSemaphoreInfos = waits,
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &commandBufferInfo,
+        .signalSemaphoreInfoCount = signalSemaphore != VK_NULL_HANDLE ? 2 : 1,
+        .pSignalSemaphoreInfos = signals };
+
+    VkResult result = sync2_queue_submit(sync2, queue, &submitInfo, VK_NULL_HANDLE);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to submit frame %llu: %d", (unsigned long long)signalValue, result);
+        return result;
+    }
+
+    timeline->submitted = signalValue;
+    *value = signalValue;
+    return result;
+}
+
+void frame_timeline_defer(FrameTimeline* timeline, FrameDeleteFn destroy, uint64_t handle)
+{
+    if (frame_timeline_completed(timeline) >= timeline->submitted) {
+        destroy(timeline->device, handle);
+        return;
+    }
+
+    // Make room by waiting for the oldest, which the GPU is going to finish first anyway
+    if (timeline->deletionCount == FRAME_TIMELINE_MAX_DELETIONS) {
+        LOG_WARN_LIMITED("Frame deletion queue full, waiting for the GPU");
+        // A failed wait means the device is lost, the ring stays full but nothing uses handle
+        if (frame_timeline_wait(timeline, timeline->deletions[timeline->deletionHead].value)
+            != VK_SUCCESS) {
+            destroy(timeline->device, handle);
+            return;
+        }
+        run_deletions(timeline, timeline->completed);
+    }
+
+    uint32_t tail
+        = (timeline->deletionHead + timeline->deletionCount) % FRAME_TIMELINE_MAX_DELETIONS;
+    timeline->deletions[tail]
+        = (FrameDeletion) { .destroy = destroy, .handle = handle, .value = timeline->submitted };
+    timeline->deletionCount++;
+}
+
+void frame_timeline_collect(FrameTimeline* timeline)
+{
+    if (timeline->deletionCount > 0) {
+        run_deletions(timeline, frame_timeline_completed(timeline));
+    }
+}
@@ -0,0 +1,254 @@
+#include "frame_timing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "timer.h"
+
+#define FRAME_TIMING_NO_FRAME UINT64_MAX
+
+static const char* metricNames[FRAME_TIMING_METRIC_COUNT] = {
+    [FRAME_TIMING_PACING] = "pacing",
+    [FRAME_TIMING_EVENTS] = "events",
+    [FRAME_TIMING_WAIT] = "wait",
+    [FRAME_TIMING_ACQUIRE] = "acquire",
+    [FRAME_TIMING_RECORD] = "record",
+    [FRAME_TIMING_SUBMIT] = "submit",
+    [FRAME_TIMING_PRESENT] = "present",
+    [FRAME_TIMING_CPU_FRAME] = "cpu frame",
+    [FRAME_TIMING_GPU] = "gpu",
+};
+
+VkResult frame_timing_init(FrameTiming* timing,
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t queueFamilyIndex,
+    uint32_t slotCount)
+{
+    VkResult result = VK_SUCCESS;
+
+    timing->device = device;
+    timing->queryPool = VK_NULL_HANDLE;
+    timing->slotCount = slotCount;
+    timing->frameCount = 0;
+
+    timing->slotFrames = malloc(sizeof(uint64_t) * slotCount);
+    if (timing->slotFrames == NULL) {
+        LOG_ERROR("Failed to allocate frame timing slots");
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    for (uint32_t i = 0; i < slotCount; i++) {
+        timing->slotFrames[i] = FRAME_TIMING_NO_FRAME;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+
+    VkQueueFamilyProperties* queueFamilies
+        = malloc(sizeof(VkQueueFamilyProperties) * queueFamilyCount);
+    if (queueFamilies == NULL) {
+        LOG_ERROR("Failed to allocate queue family properties");
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
+
+    uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+    free(queueFamilies);
+
+    if (validBits == 0 || properties.limits.timestampPeriod == 0.0f) {
+        LOG_INFO("Queue family %u has no timestamps, GPU frame timing disabled", queueFamilyIndex);
+        return result;
+    }
+
+    timing->timestampPeriod = properties.limits.timestampPeriod;
+    timing->timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolInfo = { .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2 * slotCount };
+
+    result = vkCreateQueryPool(device, &queryPoolInfo, NULL, &timing->queryPool);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create timestamp query pool: %d", result);
+        return result;
+    }
+    LOG_INFO("GPU frame timing enabled: %u valid bits, %.3f ns per tick",
+        validBits,
+        timing->timestampPeriod);
+
+    return result;
+}
+
+void frame_timing_begin_frame(FrameTiming* timing)
+{
+    FrameTimingRecord* record = &timing->records[timing->frameCount % FRAME_TIMING_HISTORY];
+    memset(record, 0, sizeof(*record));
+
+    timing->frameStartNs = timer_now_ns();
+    timing->phaseStartNs = timing->frameStartNs;
+}
+
+void frame_timing_mark(FrameTiming* timing, FrameTimingMetric phase)
+{
+    uint64_t nowNs = timer_now_ns();
+
+    FrameTimingRecord* record = &timing->records[timing->frameCount % FRAME_TIMING_HISTORY];
+    record->ns[phase] += nowNs - timing->phaseStartNs;
+
+    timing->phaseStartNs = nowNs;
+}
+
+void frame_timing_end_frame(FrameTiming* timing)
+{
+    FrameTimingRecord* record = &timing->records[timing->frameCount % FRAME_TIMING_HISTORY];
+    record->ns[FRAME_TIMING_CPU_FRAME] = timer_now_ns() - timing->frameStartNs;
+
+    timing->frameCount++;
+}
+
+void frame_timing_collect(FrameTiming* timing, uint32_t slot)
+{
+    uint64_t frame = timing->slotFrames[slot];
+    if (timing->queryPool == VK_NULL_HANDLE || frame == FRAME_TIMING_NO_FRAME) {
+        return;
+    }
+    timing->slotFrames[slot] = FRAME_TIMING_NO_FRAME;
+
+    // The record may already have been reused by a newer frame
+    if (timing->frameCount - frame >= FRAME_TIMING_HISTORY) {
+        return;
+    }
+
+    // The slot's timeline value has been reached, so the results are normally available and never waited for
+    uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(timing->device,
+        timing->queryPool,
+        2 * slot,
+        2,
+        sizeof(timestamps),
+        timestamps,
+        sizeof(timestamps[0]),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & timing->timestampMask;
+
+    FrameTimingRecord* record = &timing->records[frame % FRAME_TIMING_HISTORY];
+    record->ns[FRAME_TIMING_GPU] = (uint64_t)((double)ticks * timing->timestampPeriod);
+    record->gpuValid = true;
+}
+
+void frame_timing_record_begin(FrameTiming* timing, VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if (timing->queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkCmdResetQueryPool(commandBuffer, timing->queryPool, 2 * slot, 2);
+    vkCmdWriteTimestamp(
+        commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timing->queryPool, 2 * slot);
+
+    timing->slotFrames[slot] = timing->frameCount;
+}
+
+void frame_timing_record_end(FrameTiming* timing, VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if (timing->queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(
+        commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timing->queryPool, 2 * slot + 1);
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t lhs = *(const uint64_t*)a;
+    uint64_t rhs = *(const uint64_t*)b;
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// Nearest-rank percentile of a sorted, non-empty array
+static uint64_t percentile(const uint64_t* sorted, uint32_t count, uint32_t percent)
+{
+    uint32_t rank = (count * percent + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+bool frame_timing_stats(FrameTiming* timing, FrameTimingMetric metric, FrameTimingStats* stats)
+{
+    uint64_t first
+        = timing->frameCount > FRAME_TIMING_HISTORY ? timing->frameCount - FRAME_TIMING_HISTORY : 0;
+
+    uint32_t count = 0;
+    uint64_t totalNs = 0;
+    for (uint64_t frame = first; frame < timing->frameCount; frame++) {
+        FrameTimingRecord* record = &timing->records[frame % FRAME_TIMING_HISTORY];
+        if (metric == FRAME_TIMING_GPU && !record->gpuValid) {
+            continue;
+        }
+
+        timing->scratch[count++] = record->ns[metric];
+        totalNs += record->ns[metric];
+    }
+
+    if (count == 0) {
+        return false;
+    }
+
+    qsort(timing->scratch, count, sizeof(uint64_t), compare_u64);
+
+    *stats = (FrameTimingStats) { .count = count,
+        .minMs = timer_ns_to_ms(timing->scratch[0]),
+        .avgMs = timer_ns_to_ms(totalNs) / count,
+        .p50Ms = timer_ns_to_ms(percentile(timing->scratch, count, 50)),
+        .p99Ms = timer_ns_to_ms(percentile(timing->scratch, count, 99)),
+        .maxMs = timer_ns_to_ms(timing->scratch[count - 1]) };
+
+    return true;
+}
+
+void frame_timing_log_summary(FrameTiming* timing)
+{
+    if (timing->frameCount == 0) {
+        return;
+    }
+
+    LOG_INFO("Frame timing over the last %u of %lu frames:",
+        timing->frameCount < FRAME_TIMING_HISTORY ? (uint32_t)timing->frameCount
+                                                  : FRAME_TIMING_HISTORY,
+        (unsigned long)timing->frameCount);
+
+    for (uint32_t metric = 0; metric < FRAME_TIMING_METRIC_COUNT; metric++) {
+        FrameTimingStats stats;
+        if (!frame_timing_stats(timing, metric, &stats)) {
+            continue;
+        }
+
+        LOG_INFO("  %-9s min %7.3f  avg %7.3f  p50 %7.3f  p99 %7.3f  max %7.3f ms",
+            metricNames[metric],
+            stats.minMs,
+            stats.avgMs,
+            stats.p50Ms,
+            stats.p99Ms,
+            stats.maxMs);
+    }
+}
+
+void frame_timing_deinit(FrameTiming* timing)
+{
+    if (timing->queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(timing->device, timing->queryPool, NULL);
+        timing->queryPool = VK_NULL_HANDLE;
+    }
+
+    free(timing->slotFrames);
+    timing->slotFrames = NULL;
+}
@@ -0,0 +1,707 @@
+#include "gpu_memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_utils.h"
+#include "log.h"
+
+// Requests of more than half a block would waste most of it on buddy rounding
+#define GPU_MEMORY_DEDICATED_THRESHOLD(blockSize) ((blockSize) / 2)
+
+#define GPU_MEMORY_MIN_BLOCK_SIZE (1ull * 1024 * 1024)
+
+static uint8_t size_to_order(VkDeviceSize size)
+{
+    VkDeviceSize minSize = 1ull << GPU_MEMORY_MIN_ALLOC_SHIFT;
+    if (size <= minSize) {
+        return 0;
+    }
+
+    // Round up to a power of two, then measure it in multiples of the smallest buddy
+    uint32_t shift = 64 - (uint32_t)__builtin_clzll(size - 1);
+    return (uint8_t)(shift - GPU_MEMORY_MIN_ALLOC_SHIFT);
+}
+
+static uint8_t max_u8(uint8_t a, uint8_t b) { return a > b ? a : b; }
+
+static void buddy_tree_init(uint8_t* tree, uint8_t maxOrder)
+{
+    uint32_t node = 0;
+    for (uint32_t depth = 0; depth <= maxOrder; depth++) {
+        uint32_t levelCount = 1u << depth;
+        memset(tree + node, maxOrder - depth + 1, levelCount);
+        node += levelCount;
+    }
+}
+
+// Returns the byte offset of a free node of the given order, or -1 if the block cannot fit it
+static int64_t buddy_alloc(uint8_t* tree, uint8_t maxOrder, uint8_t order)
+{
+    if (tree[0] < order + 1) {
+        return -1;
+    }
+
+    uint32_t node = 0;
+    uint32_t depth = 0;
+    while (maxOrder - depth > order) {
+        uint32_t left = 2 * node + 1;
+        node = tree[left] >= order + 1 ? left : left + 1;
+        depth++;
+    }
+
+    tree[node] = 0;
+    int64_t offset = (int64_t)(node - ((1u << depth) - 1)) << (order + GPU_MEMORY_MIN_ALLOC_SHIFT);
+
+    while (node > 0) {
+        node = (node - 1) / 2;
+        tree[node] = max_u8(tree[2 * node + 1], tree[2 * node + 2]);
+    }
+
+    return offset;
+}
+
+static void buddy_free(uint8_t* tree, uint8_t maxOrder, VkDeviceSize offset, uint8_t order)
+{
+    uint32_t depth = maxOrder - order;
+    uint32_t node = (uint32_t)(offset >> (order + GPU_MEMORY_MIN_ALLOC_SHIFT)) + (1u << depth) - 1;
+    tree[node] = order + 1;
+
+    // Merge buddies back up while both halves are entirely free
+    uint8_t childOrder = order;
+    while (node > 0) {
+        node = (node - 1) / 2;
+        uint8_t left = tree[2 * node + 1];
+        uint8_t right = tree[2 * node + 2];
+        if (left == childOrder + 1 && right == childOrder + 1) {
+            tree[node] = childOrder + 2;
+        } else {
+            tree[node] = max_u8(left, right);
+        }
+        childOrder++;
+    }
+}
+
+static int32_t find_memory_type(
+    const VkPhysicalDeviceMemoryProperties* properties, uint32_t typeBits, GpuMemoryUsage usage)
+{
+    VkMemoryPropertyFlags required = 0;
+    VkMemoryPropertyFlags preferred = 0;
+
+    switch (usage) {
+    case GPU_MEMORY_USAGE_GPU_ONLY:
+        preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+    case GPU_MEMORY_USAGE_CPU_TO_GPU:
+        required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        break;
+    case GPU_MEMORY_USAGE_GPU_TO_CPU:
+        required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+    }
+
+    // Memory types are ordered so that the first match carries the fewest extra properties
+    int32_t fallback = -1;
+    for (uint32_t i = 0; i < properties->memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) == 0) {
+            continue;
+        }
+
+        VkMemoryPropertyFlags flags = properties->memoryTypes[i].propertyFlags;
+        if ((flags & required) != required) {
+            continue;
+        }
+
+        if ((flags & preferred) == preferred) {
+            return (int32_t)i;
+        }
+
+        if (fallback < 0) {
+            fallback = (int32_t)i;
+        }
+    }
+
+    return fallback;
+}
+
+static bool is_host_visible(const GpuMemory* gpuMemory, uint32_t memoryTypeIndex)
+{
+    return gpuMemory->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags
+        & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+static GpuHeapStats* heap_stats(GpuMemory* gpuMemory, uint32_t memoryTypeIndex)
+{
+    uint32_t heapIndex = gpuMemory->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    return &gpuMemory->heapStats[heapIndex];
+}
+
+static VkResult allocate_device_memory(GpuMemory* gpuMemory,
+    VkDeviceSize size,
+    uint32_t memoryTypeIndex,
+    const void* pNext,
+    VkDeviceMemory* memory,
+    void** mapped)
+{
+    if (gpuMemory->deviceAllocationCount >= gpuMemory->maxAllocationCount) {
+        LOG_ERROR("Reached maxMemoryAllocationCount (%u)", gpuMemory->maxAllocationCount);
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = pNext,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex,
+    };
+
+    VkResult result = vkAllocateMemory(gpuMemory->device, &allocInfo, NULL, memory);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to allocate %llu bytes from memory type %u",
+            (unsigned long long)size,
+            memoryTypeIndex);
+        return result;
+    }
+    DEBUG_NAME(gpuMemory->device,
+        VK_OBJECT_TYPE_DEVICE_MEMORY,
+        *memory,
+        "memory type %u, %llu bytes",
+        memoryTypeIndex,
+        (unsigned long long)size);
+
+    *mapped = NULL;
+    if (is_host_visible(gpuMemory, memoryTypeIndex)) {
+        result = vkMapMemory(gpuMemory->device, *memory, 0, VK_WHOLE_SIZE, 0, mapped);
+        if (result != VK_SUCCESS) {
+            LOG_ERROR("Failed to map memory type %u", memoryTypeIndex);
+            vkFreeMemory(gpuMemory->device, *memory, NULL);
+            *memory = VK_NULL_HANDLE;
+            return result;
+        }
+    }
+
+    gpuMemory->deviceAllocationCount++;
+    return VK_SUCCESS;
+}
+
+static void free_device_memory(GpuMemory* gpuMemory, VkDeviceMemory memory)
+{
+    // Freeing implicitly unmaps
+    vkFreeMemory(gpuMemory->device, memory, NULL);
+    gpuMemory->deviceAllocationCount--;
+}
+
+static VkResult create_block(
+    GpuMemory* gpuMemory, uint32_t memoryTypeIndex, GpuMemoryPool* pool, uint32_t* blockIndex)
+{
+    uint32_t slot = pool->blockCount;
+    for (uint32_t i = 0; i < pool->blockCount; i++) {
+        if (pool->blocks[i].memory == VK_NULL_HANDLE) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot == pool->blockCount) {
+        GpuMemoryBlock* blocks = realloc(pool->blocks, (pool->blockCount + 1) * sizeof(*blocks));
+        if (blocks == NULL) {
+            LOG_ERROR("Failed to allocate GpuMemoryBlock array");
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        pool->blocks = blocks;
+        pool->blockCount++;
+        memset(&pool->blocks[slot], 0, sizeof(pool->blocks[slot]));
+    }
+
+    GpuMemoryBlock* block = &pool->blocks[slot];
+    uint32_t heapIndex = gpuMemory->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize blockSize = gpuMemory->blockSize[heapIndex];
+    uint8_t maxOrder = size_to_order(blockSize);
+    size_t nodeCount = (2ull << maxOrder) - 1;
+
+    uint8_t* tree = malloc(nodeCount);
+    if (tree == NULL) {
+        LOG_ERROR("Failed to allocate buddy tree");
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void* mapped = NULL;
+    VkResult result
+        = allocate_device_memory(gpuMemory, blockSize, memoryTypeIndex, NULL, &memory, &mapped);
+    if (result != VK_SUCCESS) {
+        free(tree);
+        return result;
+    }
+
+    buddy_tree_init(tree, maxOrder);
+    *block = (GpuMemoryBlock) {
+        .memory = memory,
+        .mapped = mapped,
+        .size = blockSize,
+        .maxOrder = maxOrder,
+        .tree = tree,
+        .allocationCount = 0,
+    };
+
+    GpuHeapStats* stats = heap_stats(gpuMemory, memoryTypeIndex);
+    stats->blockBytes += blockSize;
+    stats->blockCount++;
+
+    *blockIndex = slot;
+    return VK_SUCCESS;
+}
+
+static void destroy_block(GpuMemory* gpuMemory, uint32_t memoryTypeIndex, GpuMemoryBlock* block)
+{
+    GpuHeapStats* stats = heap_stats(gpuMemory, memoryTypeIndex);
+    stats->blockBytes -= block->size;
+    stats->blockCount--;
+
+    free_device_memory(gpuMemory, block->memory);
+    free(block->tree);
+    memset(block, 0, sizeof(*block));
+}
+
+static VkResult allocate_dedicated(GpuMemory* gpuMemory,
+    const VkMemoryRequirements* requirements,
+    uint32_t memoryTypeIndex,
+    VkBuffer buffer,
+    VkImage image,
+    GpuAllocation* allocation)
+{
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+        .image = image,
+        .buffer = buffer,
+    };
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void* mapped = NULL;
+    VkResult result = allocate_device_memory(
+        gpuMemory, requirements->size, memoryTypeIndex, &dedicatedInfo, &memory, &mapped);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    GpuHeapStats* stats = heap_stats(gpuMemory, memoryTypeIndex);
+    stats->dedicatedBytes += requirements->size;
+    stats->dedicatedCount++;
+
+    *allocation = (GpuAllocation) {
+        .memory = memory,
+        .offset = 0,
+        .size = requirements->size,
+        .mapped = mapped,
+        .memoryTypeIndex = memoryTypeIndex,
+        .blockIndex = -1,
+    };
+
+    return VK_SUCCESS;
+}
+
+static VkResult allocate_from_pool(GpuMemory* gpuMemory,
+    const VkMemoryRequirements* requirements,
+    uint32_t memoryTypeIndex,
+    bool optimal,
+    GpuAllocation* allocation)
+{
+    GpuMemoryPool* pool = &gpuMemory->pools[memoryTypeIndex][optimal];
+
+    // Buddy nodes are aligned to their own size, which covers any power-of-two alignment
+    VkDeviceSize size = requirements->size > requirements->alignment ? requirements->size
+                                                                      : requirements->alignment;
+    uint8_t order = size_to_order(size);
+
+    int64_t offset = -1;
+    uint32_t blockIndex = 0;
+    for (; blockIndex < pool->blockCount; blockIndex++) {
+        GpuMemoryBlock* block = &pool->blocks[blockIndex];
+        if (block->memory == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        offset = buddy_alloc(block->tree, block->maxOrder, order);
+        if (offset >= 0) {
+            break;
+        }
+    }
+
+    if (offset < 0) {
+        VkResult result = create_block(gpuMemory, memoryTypeIndex, pool, &blockIndex);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+
+        GpuMemoryBlock* block = &pool->blocks[blockIndex];
+        offset = buddy_alloc(block->tree, block->maxOrder, order);
+        if (offset < 0) {
+            LOG_ERROR("Allocation of %llu bytes does not fit a %llu byte block",
+                (unsigned long long)size,
+                (unsigned long long)block->size);
+            destroy_block(gpuMemory, memoryTypeIndex, block);
+            return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+        }
+    }
+
+    GpuMemoryBlock* block = &pool->blocks[blockIndex];
+    block->allocationCount++;
+
+    VkDeviceSize roundedSize = 1ull << (order + GPU_MEMORY_MIN_ALLOC_SHIFT);
+    GpuHeapStats* stats = heap_stats(gpuMemory, memoryTypeIndex);
+    stats->usedBytes += roundedSize;
+    stats->allocationCount++;
+
+    *allocation = (GpuAllocation) {
+        .memory = block->memory,
+        .offset = (VkDeviceSize)offset,
+        .size = requirements->size,
+        .mapped = block->mapped ? (uint8_t*)block->mapped + offset : NULL,
+        .memoryTypeIndex = memoryTypeIndex,
+        .blockIndex = (int32_t)blockIndex,
+        .order = order,
+        .optimal = optimal,
+    };
+
+    return VK_SUCCESS;
+}
+
+static VkResult allocate(GpuMemory* gpuMemory,
+    const VkMemoryRequirements2* requirements,
+    const VkMemoryDedicatedRequirements* dedicatedRequirements,
+    GpuMemoryUsage usage,
+    bool optimal,
+    VkBuffer buffer,
+    VkImage image,
+    GpuAllocation* allocation)
+{
+    const VkMemoryRequirements* memReqs = &requirements->memoryRequirements;
+
+    int32_t memoryTypeIndex
+        = find_memory_type(&gpuMemory->memoryProperties, memReqs->memoryTypeBits, usage);
+    if (memoryTypeIndex < 0) {
+        LOG_ERROR("No memory type for bits 0x%x and usage %d", memReqs->memoryTypeBits, usage);
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    // Pooled allocations take up a buddy node of at least the alignment
+    uint32_t heapIndex = gpuMemory->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize poolSize = memReqs->size > memReqs->alignment ? memReqs->size : memReqs->alignment;
+    bool dedicated = dedicatedRequirements->requiresDedicatedAllocation
+        || dedicatedRequirements->prefersDedicatedAllocation
+        || poolSize > GPU_MEMORY_DEDICATED_THRESHOLD(gpuMemory->blockSize[heapIndex]);
+
+    pthread_mutex_lock(&gpuMemory->mutex);
+
+    VkResult result;
+    if (dedicated) {
+        result = allocate_dedicated(
+            gpuMemory, memReqs, (uint32_t)memoryTypeIndex, buffer, image, allocation);
+    } else {
+        result = allocate_from_pool(
+            gpuMemory, memReqs, (uint32_t)memoryTypeIndex, optimal, allocation);
+    }
+
+    pthread_mutex_unlock(&gpuMemory->mutex);
+
+    return result;
+}
+
+static void release(GpuMemory* gpuMemory, GpuAllocation* allocation)
+{
+    if (allocation->memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    pthread_mutex_lock(&gpuMemory->mutex);
+
+    GpuHeapStats* stats = heap_stats(gpuMemory, allocation->memoryTypeIndex);
+
+    if (allocation->blockIndex < 0) {
+        stats->dedicatedBytes -= allocation->size;
+        stats->dedicatedCount--;
+        free_device_memory(gpuMemory, allocation->memory);
+    } else {
+        GpuMemoryPool* pool = &gpuMemory->pools[allocation->memoryTypeIndex][allocation->optimal];
+        GpuMemoryBlock* block = &pool->blocks[allocation->blockIndex];
+
+        buddy_free(block->tree, block->maxOrder, allocation->offset, allocation->order);
+        block->allocationCount--;
+
+        stats->usedBytes -= 1ull << (allocation->order + GPU_MEMORY_MIN_ALLOC_SHIFT);
+        stats->allocationCount--;
+
+        // Keep one block per pool around so that churn does not hit vkAllocateMemory
+        if (block->allocationCount == 0) {
+            uint32_t liveBlocks = 0;
+            for (uint32_t i = 0; i < pool->blockCount; i++) {
+                liveBlocks += pool->blocks[i].memory != VK_NULL_HANDLE;
+            }
+            if (liveBlocks > 1) {
+                destroy_block(gpuMemory, allocation->memoryTypeIndex, block);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&gpuMemory->mutex);
+
+    memset(allocation, 0, sizeof(*allocation));
+}
+
+VkResult gpu_memory_init(GpuMemory* gpuMemory, VkPhysicalDevice physicalDevice, VkDevice device)
+{
+    memset(gpuMemory, 0, sizeof(*gpuMemory));
+    gpuMemory->device = device;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &gpuMemory->memoryProperties);
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    gpuMemory->maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+    gpuMemory->nonCoherentAtomSize = deviceProperties.limits.nonCoherentAtomSize;
+
+    for (uint32_t i = 0; i < gpuMemory->memoryProperties.memoryHeapCount; i++) {
+        VkDeviceSize heapSize = gpuMemory->memoryProperties.memoryHeaps[i].size;
+
+        // Small heaps (e.g. the 256 MiB BAR window) get blocks of an eighth of their size
+        VkDeviceSize blockSize = GPU_MEMORY_BLOCK_SIZE;
+        while (blockSize > GPU_MEMORY_MIN_BLOCK_SIZE && blockSize > heapSize / 8) {
+            blockSize /= 2;
+        }
+
+        gpuMemory->blockSize[i] = blockSize;
+        gpuMemory->heapStats[i].heapSize = heapSize;
+    }
+
+    if (pthread_mutex_init(&gpuMemory->mutex, NULL) != 0) {
+        LOG_ERROR("Failed to create GpuMemory mutex");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    gpuMemory->initialized = true;
+    return VK_SUCCESS;
+}
+
+void gpu_memory_deinit(GpuMemory* gpuMemory)
+{
+    if (!gpuMemory->initialized) {
+        return;
+    }
+
+    for (uint32_t type = 0; type < gpuMemory->memoryProperties.memoryTypeCount; type++) {
+        for (uint32_t optimal = 0; optimal < 2; optimal++) {
+            GpuMemoryPool* pool = &gpuMemory->pools[type][optimal];
+
+            for (uint32_t i = 0; i < pool->blockCount; i++) {
+                GpuMemoryBlock* block = &pool->blocks[i];
+                if (block->memory == VK_NULL_HANDLE) {
+                    continue;
+                }
+
+                if (block->allocationCount > 0) {
+                    LOG_ERROR("Memory type %u block %u still has %u allocations",
+                        type,
+                        i,
+                        block->allocationCount);
+                }
+                destroy_block(gpuMemory, type, block);
+            }
+
+            free(pool->blocks);
+            pool->blocks = NULL;
+            pool->blockCount = 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < gpuMemory->memoryProperties.memoryHeapCount; i++) {
+        if (gpuMemory->heapStats[i].dedicatedCount > 0) {
+            LOG_ERROR("Heap %u still has %u dedicated allocations",
+                i,
+                gpuMemory->heapStats[i].dedicatedCount);
+        }
+    }
+
+    pthread_mutex_destroy(&gpuMemory->mutex);
+    gpuMemory->initialized = false;
+}
+
+VkResult gpu_memory_create_buffer(GpuMemory* gpuMemory,
+    const VkBufferCreateInfo* createInfo,
+    GpuMemoryUsage usage,
+    VkBuffer* buffer,
+    GpuAllocation* allocation)
+{
+    VkResult result = vkCreateBuffer(gpuMemory->device, createInfo, NULL, buffer);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create buffer of %llu bytes", (unsigned long long)createInfo->size);
+        return result;
+    }
+
+    VkBufferMemoryRequirementsInfo2 requirementsInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+        .buffer = *buffer,
+    };
+    VkMemoryDedicatedRequirements dedicatedRequirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
+    VkMemoryRequirements2 requirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+        .pNext = &dedicatedRequirements,
+    };
+    vkGetBufferMemoryRequirements2(gpuMemory->device, &requirementsInfo, &requirements);
+
+    result = allocate(gpuMemory,
+        &requirements,
+        &dedicatedRequirements,
+        usage,
+        false,
+        *buffer,
+        VK_NULL_HANDLE,
+        allocation);
+    if (result != VK_SUCCESS) {
+        vkDestroyBuffer(gpuMemory->device, *buffer, NULL);
+        *buffer = VK_NULL_HANDLE;
+        return result;
+    }
+
+    result = vkBindBufferMemory(gpuMemory->device, *buffer, allocation->memory, allocation->offset);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to bind buffer memory");
+        gpu_memory_destroy_buffer(gpuMemory, *buffer, allocation);
+        *buffer = VK_NULL_HANDLE;
+        return result;
+    }
+
+    return VK_SUCCESS;
+}
+
+void gpu_memory_destroy_buffer(GpuMemory* gpuMemory, VkBuffer buffer, GpuAllocation* allocation)
+{
+    vkDestroyBuffer(gpuMemory->device, buffer, NULL);
+    release(gpuMemory, allocation);
+}
+
+VkResult gpu_memory_create_image(GpuMemory* gpuMemory,
+    const VkImageCreateInfo* createInfo,
+    GpuMemoryUsage usage,
+    VkImage* image,
+    GpuAllocation* allocation)
+{
+    VkResult result = vkCreateImage(gpuMemory->device, createInfo, NULL, image);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create %ux%u image",
+            createInfo->extent.width,
+            createInfo->extent.height);
+        return result;
+    }
+
+    VkImageMemoryRequirementsInfo2 requirementsInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+        .image = *image,
+    };
+    VkMemoryDedicatedRequirements dedicatedRequirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
+    VkMemoryRequirements2 requirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+        .pNext = &dedicatedRequirements,
+    };
+    vkGetImageMemoryRequirements2(gpuMemory->device, &requirementsInfo, &requirements);
+
+    bool optimal = createInfo->tiling == VK_IMAGE_TILING_OPTIMAL;
+    result = allocate(gpuMemory,
+        &requirements,
+        &dedicatedRequirements,
+        usage,
+        optimal,
+        VK_NULL_HANDLE,
+        *image,
+        allocation);
+    if (result != VK_SUCCESS) {
+        vkDestroyImage(gpuMemory->device, *image, NULL);
+        *image = VK_NULL_HANDLE;
+        return result;
+    }
+
+    result = vkBindImageMemory(gpuMemory->device, *image, allocation->memory, allocation->offset);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to bind image memory");
+        gpu_memory_destroy_image(gpuMemory, *image, allocation);
+        *image = VK_NULL_HANDLE;
+        return result;
+    }
+
+    return VK_SUCCESS;
+}
+
+void gpu_memory_destroy_image(GpuMemory* gpuMemory, VkImage image, GpuAllocation* allocation)
+{
+    vkDestroyImage(gpuMemory->device, image, NULL);
+    release(gpuMemory, allocation);
+}
+
+VkResult gpu_memory_invalidate(GpuMemory* gpuMemory, const GpuAllocation* allocation)
+{
+    VkMemoryPropertyFlags flags
+        = gpuMemory->memoryProperties.memoryTypes[allocation->memoryTypeIndex].propertyFlags;
+    if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+        return VK_SUCCESS;
+    }
+
+    // Buddy nodes are aligned to their own size, which normally covers nonCoherentAtomSize.
+    // Otherwise fall back to the rest of the memory object.
+    VkMappedMemoryRange range = { .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = allocation->memory,
+        .offset = allocation->offset,
+        .size = allocation->blockIndex < 0
+            ? VK_WHOLE_SIZE
+            : 1ull << (allocation->order + GPU_MEMORY_MIN_ALLOC_SHIFT) };
+
+    if (range.offset % gpuMemory->nonCoherentAtomSize != 0
+        || (range.size != VK_WHOLE_SIZE && range.size % gpuMemory->nonCoherentAtomSize != 0)) {
+        range.offset -= range.offset % gpuMemory->nonCoherentAtomSize;
+        range.size = VK_WHOLE_SIZE;
+    }
+
+    VkResult result = vkInvalidateMappedMemoryRanges(gpuMemory->device, 1, &range);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to invalidate mapped memory: %d", result);
+    }
+
+    return result;
+}
+
+void gpu_memory_get_heap_stats(GpuMemory* gpuMemory, uint32_t heapIndex, GpuHeapStats* stats)
+{
+    pthread_mutex_lock(&gpuMemory->mutex);
+    *stats = gpuMemory->heapStats[heapIndex];
+    pthread_mutex_unlock(&gpuMemory->mutex);
+}
+
+void gpu_memory_log_stats(GpuMemory* gpuMemory)
+{
+    for (uint32_t i = 0; i < gpuMemory->memoryProperties.memoryHeapCount; i++) {
+        GpuHeapStats stats;
+        gpu_memory_get_heap_stats(gpuMemory, i, &stats);
+
+        if (stats.blockCount == 0 && stats.dedicatedCount == 0) {
+            continue;
+        }
+
+        LOG_INFO("Heap %u (%llu MiB): %u blocks %.2f MiB, %u allocations %.2f MiB, "
+                 "%u dedicated %.2f MiB",
+            i,
+            (unsigned long long)(stats.heapSize >> 20),
+            stats.blockCount,
+            (double)stats.blockBytes / (1024.0 * 1024.0),
+            stats.allocationCount,
+            (double)stats.usedBytes / (1024.0 * 1024.0),
+            stats.dedicatedCount,
+            (double)stats.dedicatedBytes / (1024.0 * 1024.0));
+    }
+
+    LOG_INFO("%u / %u device memory allocations in use",
+        gpuMemory->deviceAllocationCount,
+        gpuMemory->maxAllocationCount);
+}
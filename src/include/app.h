@@ -1,41 +1,152 @@
 #ifndef APP_H
 #define APP_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
+
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan_core.h>
 
+#include "damage.h"
+#include "dynamic_rendering.h"
+#include "frame_pacing.h"
+#include "frame_timeline.h"
+#include "frame_timing.h"
+#include "gpu_memory.h"
+#include "input_queue.h"
+#include "job.h"
+#include "nk_vulkan.h"
+#include "readback.h"
+#ifdef YACW_SHADER_HOT_RELOAD
+#include "shader_reload.h"
+#endif
+#include "upload.h"
+
+// Number of frames the CPU may record ahead of the GPU. Overridable from CMake.
+#ifndef YACW_FRAMES_IN_FLIGHT
+#define YACW_FRAMES_IN_FLIGHT 2
+#endif
+
+// Frames rendered on demand after something changed. Nuklear resolves hover and active states
+// against the previous frame's layout, the second frame lets them settle.
+#define YACW_REDRAW_FRAMES 2
+
 typedef struct SwapChainMetadata {
     VkSurfaceFormatKHR surfaceFormat;
     VkPresentModeKHR presentMode;
     VkExtent2D swapchainExtent;
     VkSurfaceTransformFlagBitsKHR swapChainTransform;
     uint32_t swapChainImageCount;
+    VkImageUsageFlags imageUsage;
 } SwapchainMetadata;
 
+// Parts of the render pass recorded in parallel into secondary command buffers, executed in
+// this order
+typedef enum FramePass {
+    FRAME_PASS_SCENE,
+    FRAME_PASS_UI,
+    FRAME_PASS_COUNT,
+} FramePass;
+
+// Per-frame resources, cycled through in a ring of YACW_FRAMES_IN_FLIGHT slots
+typedef struct FrameCtx {
+    // Pools are reset as a whole once the timeline has reached timelineValue. Each pass has its
+    // own, a pool may only be used by one thread at a time.
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkCommandPool passPools[FRAME_PASS_COUNT];
+    VkCommandBuffer passBuffers[FRAME_PASS_COUNT];
+    VkSemaphore imageAvailableSemaphore;
+    uint64_t timelineValue; // Frame timeline value of the slot's last frame, 0 if never submitted
+    uint64_t uploadWaitValue; // Upload timeline value the frame's submission waits on, or 0
+    VkPipelineStageFlags uploadWaitStageMask;
+} FrameCtx;
+
 typedef struct AppCtx {
-    GLFWwindow* window;
+    GLFWwindow* window; // NULL when running headless
+    VkExtent2D framebufferExtent; // Of the window, as last reported through input
+    InputQueue input; // Window events for the render thread, only set up with a window
+    VkExtent2D headlessExtent;
+    const char* gpuSelector; // Forces a physical device, see device_select, NULL to pick one
+    PresentPolicy presentPolicy; // Set before appCtx_init, then through appCtx_set_present_policy
+    bool forceRenderPass; // Set before appCtx_init, ignores dynamic rendering support
     VkInstance instance;
+    VkDebugUtilsMessengerEXT debugMessenger; // VK_NULL_HANDLE unless built with validation
     VkSurfaceKHR surface;
     VkPhysicalDevice physicalDevice;
     int32_t queueFamilyIndex;
+    int32_t transferQueueFamilyIndex;
     VkDevice device;
+    GpuMemory gpuMemory;
+    UploadCtx upload;
     SwapchainMetadata swapchainMetadata;
     VkSwapchainKHR swapchain;
     VkImage* swapchainImages;
     VkImageView* swapchainImageViews;
-    VkRenderPass renderPass;
+    GpuAllocation* offscreenAllocations; // Only without any surface, the images are ours then
+    VkImageLayout swapchainFinalLayout;
+    VkPipelineCache pipelineCache;
+    // Both VK_NULL_HANDLE, and the framebuffers NULL, when rendering dynamically
+    VkRenderPass renderPass; // Clears, used for full redraws and to build everything against
+    VkRenderPass loadRenderPass; // Keeps the image, used to redraw only the damage
+    RenderTarget renderTarget; // What pipelines and pass command buffers are built against
+    DynamicRendering dynamicRendering;
     VkPipelineLayout pipelineLayout;
     VkPipeline pipeline;
     VkFramebuffer* swapchainFramebuffers;
-    VkCommandPool commandPool;
-    VkCommandBuffer* commandBuffers;
-    VkSemaphore imageAvailableSemaphore;
+    FrameCtx frames[YACW_FRAMES_IN_FLIGHT];
+    uint32_t currentFrame;
+    Sync2 sync2;
+    FrameTimeline timeline; // Completed frames, also delays destroying what they may still use
+    FrameTiming timing;
+    FramePacing pacing;
     VkSemaphore* renderFinishedSemaphore;
-    VkFence inFlightFence;
+    uint64_t* imageTimelineValues; // Frame timeline value of the last frame drawing each image
+    NkVulkan ui;
+    JobSystem jobs;
+#ifdef YACW_SHADER_HOT_RELOAD
+    ShaderReload shaderReload;
+#endif
+    DamageHistory damage;
+    DamageRegion frameDamage; // What changed since the previous frame, handed to present
+    DamageRegion imageDamage; // What the frame being recorded redraws in its image
+    bool sceneDamaged; // The scene changed, the next frame is redrawn completely
+    bool incrementalPresent; // VK_KHR_incremental_present is enabled
+    atomic_uint redrawFrames; // Still to render on demand, see appCtx_request_redraw
+    bool framebufferResized;
+    uint64_t lastResizeNs; // Time of the last framebuffer size event, used to debounce
 } AppCtx;
 
+VkResult create_shader_module(VkDevice device, const char* path, VkShaderModule* shaderModule);
+// Builds the triangle pipeline from the given modules. Only reads its arguments, so it may be
+// called from any thread.
+VkResult create_graphics_pipeline(VkDevice device,
+    VkPipelineCache pipelineCache,
+    const RenderTarget* target,
+    VkPipelineLayout pipelineLayout,
+    VkShaderModule vertShaderModule,
+    VkShaderModule fragShaderModule,
+    VkPipeline* pipeline);
+
 VkResult appCtx_init(AppCtx* appCtx);
+// Leaves framebufferResized set and the swapchain alone while the window is minimized
+VkResult appCtx_recreate_swapchain(AppCtx* appCtx);
+// Switches present mode and swapchain image count, recreating the swapchain. Call between frames.
+VkResult appCtx_set_present_policy(AppCtx* appCtx, PresentPolicy policy);
+// Marks the window content stale so rendering on demand draws it again. Thread safe.
+void appCtx_request_redraw(AppCtx* appCtx);
+bool appCtx_needs_redraw(AppCtx* appCtx);
+// Counts a rendered frame against the pending redraws
+void appCtx_frame_drawn(AppCtx* appCtx);
+// Call once the current slot's previous frame has executed. Destroys whatever no frame in flight
+// uses anymore and swaps in a reloaded pipeline if one is ready.
+void appCtx_begin_frame(AppCtx* appCtx);
+// Records the frame for imageIndex. With readback the rendered image is also copied out.
+VkResult appCtx_record_frame(
+    AppCtx* appCtx, VkCommandBuffer commandBuffer, uint32_t imageIndex, Readback* readback);
+// Submits the current frame slot, waiting on its acquire and upload semaphores as needed
+VkResult appCtx_submit_frame(AppCtx* appCtx, VkQueue queue, uint32_t imageIndex);
 void appCtx_deinit(AppCtx* appCtx);
 
 #endif // APP_H
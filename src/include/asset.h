@@ -0,0 +1,35 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Read-only, memory-mapped files shared through a process-wide cache keyed by path. A view keeps
+// its mapping alive until released, so the data is never copied. Files must be replaced by
+// renaming over them, not rewritten in place, while they are mapped.
+
+typedef struct AssetEntry AssetEntry;
+
+typedef struct AssetView {
+    const void* data; // Page aligned, NULL for an empty file
+    size_t size;
+    AssetEntry* entry;
+} AssetView;
+
+// Maps path, or takes another reference to the cached mapping if the file has not changed since.
+// Thread safe. On failure errno is left as the failing open or stat set it.
+bool asset_acquire(const char* path, AssetView* view);
+
+void asset_release(AssetView* view);
+
+// Maps path into the cache and asks the kernel to start reading it in the background, for files
+// that are going to be acquired soon. Missing files are ignored.
+void asset_prefetch(const char* path);
+
+// Unmaps cached files that have no views left
+void asset_cache_trim(void);
+
+// Unmaps everything, all views must have been released
+void asset_cache_deinit(void);
+
+#endif // ASSET_H
@@ -0,0 +1,11 @@
+#ifndef CACHE_DIR_H
+#define CACHE_DIR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Builds the path of fileName inside the per-user cache directory ($XDG_CACHE_HOME/yacw, or
+// ~/.cache/yacw), creating the directory if needed
+bool cache_dir_path(const char* fileName, char* path, size_t pathSize);
+
+#endif // CACHE_DIR_H
@@ -0,0 +1,71 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Rectangles kept per region, more are merged into the one growing the least
+#define DAMAGE_MAX_RECTS 16
+// Frames of damage remembered to bring an older swapchain image up to date
+#define DAMAGE_HISTORY 8
+
+// Part of the framebuffer that changed. Rects do not overlap and lie within the extent they were
+// added with.
+typedef struct DamageRegion {
+    VkRect2D rects[DAMAGE_MAX_RECTS];
+    uint32_t count;
+    bool full; // Everything changed, rects are meaningless
+} DamageRegion;
+
+// Damage of the recent frames and which of them each swapchain image has seen
+typedef struct DamageHistory {
+    DamageRegion frames[DAMAGE_HISTORY];
+    uint64_t frameCount;
+    uint64_t* imageFrames; // Per image, one past the frame last drawn into it, 0 if never drawn
+    uint32_t imageCount;
+} DamageHistory;
+
+static inline void damage_clear(DamageRegion* region) { *region = (DamageRegion) { 0 }; }
+static inline void damage_set_full(DamageRegion* region)
+{
+    *region = (DamageRegion) { .full = true };
+}
+static inline bool damage_is_empty(const DamageRegion* region)
+{
+    return !region->full && region->count == 0;
+}
+
+// Clips rect to extent and merges it with the rects it overlaps
+void damage_add(DamageRegion* region, VkRect2D rect, VkExtent2D extent);
+void damage_add_region(DamageRegion* region, const DamageRegion* other, VkExtent2D extent);
+// Returns false if a and b do not overlap
+bool damage_intersect(VkRect2D a, VkRect2D b, VkRect2D* intersection);
+// Smallest rect containing the whole region
+VkRect2D damage_bounds(const DamageRegion* region, VkExtent2D extent);
+
+// Every image starts out fully damaged. Call again whenever the swapchain is recreated.
+bool damage_history_init(DamageHistory* history, uint32_t imageCount);
+void damage_history_deinit(DamageHistory* history);
+
+// Records the damage of the frame about to be drawn into imageIndex and returns what has to be
+// redrawn in that image for it to show the frame
+void damage_history_push(DamageHistory* history,
+    const DamageRegion* frameDamage,
+    uint32_t imageIndex,
+    VkExtent2D extent,
+    DamageRegion* imageDamage);
+
+// Storage for the VK_KHR_incremental_present structures of one present
+typedef struct DamagePresentRegions {
+    VkPresentRegionsKHR regions;
+    VkPresentRegionKHR region;
+    VkRectLayerKHR rects[DAMAGE_MAX_RECTS];
+} DamagePresentRegions;
+
+// Tells the presentation engine which parts of the image changed. Nothing is chained for full or
+// empty damage, both mean the whole image to the presentation engine.
+void damage_chain_present(
+    const DamageRegion* damage, VkPresentInfoKHR* presentInfo, DamagePresentRegions* storage);
+
+#endif // DAMAGE_H
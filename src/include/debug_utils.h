@@ -0,0 +1,82 @@
+#ifndef DEBUG_UTILS_H
+#define DEBUG_UTILS_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Validation layers, the debug messenger and object names. Only compiled in with
+// YACW_ENABLE_VALIDATION (Debug builds, or the CMake option), otherwise everything below is a
+// no-op and the instance is created without any layer.
+//
+// At runtime YACW_VALIDATION selects what the layer checks: "0" disables it, otherwise a comma
+// separated list of "gpu" (GPU-assisted validation), "sync" (synchronization validation) and
+// "best" (best practices) is enabled on top of the core checks.
+
+#define DEBUG_UTILS_MAX_EXTENSIONS 2
+#define DEBUG_UTILS_MAX_FEATURES 4
+
+// Layers, extensions and pNext chain to create the instance with. Points into itself, so it must
+// stay where debug_utils_configure filled it in until vkCreateInstance returns.
+typedef struct DebugUtilsConfig {
+    const char* layers[1];
+    uint32_t layerCount;
+    const char* extensions[DEBUG_UTILS_MAX_EXTENSIONS];
+    uint32_t extensionCount;
+    const void* pNext;
+    VkDebugUtilsMessengerCreateInfoEXT messengerInfo;
+    VkValidationFeaturesEXT validationFeatures;
+    VkValidationFeatureEnableEXT enabledFeatures[DEBUG_UTILS_MAX_FEATURES];
+} DebugUtilsConfig;
+
+#ifdef YACW_ENABLE_VALIDATION
+
+void debug_utils_configure(DebugUtilsConfig* config);
+
+// Creates the messenger if config enabled VK_EXT_debug_utils, messenger is VK_NULL_HANDLE
+// otherwise
+VkResult debug_utils_init(
+    VkInstance instance, const DebugUtilsConfig* config, VkDebugUtilsMessengerEXT* messenger);
+void debug_utils_deinit(VkInstance instance, VkDebugUtilsMessengerEXT messenger);
+
+// Names show up in validation messages and graphics debuggers. Ignored without VK_EXT_debug_utils.
+void debug_utils_name(VkDevice device, VkObjectType type, uint64_t handle, const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+#else
+
+static inline void debug_utils_configure(DebugUtilsConfig* config)
+{
+    *config = (DebugUtilsConfig) { 0 };
+}
+
+static inline VkResult debug_utils_init(
+    VkInstance instance, const DebugUtilsConfig* config, VkDebugUtilsMessengerEXT* messenger)
+{
+    (void)instance;
+    (void)config;
+    *messenger = VK_NULL_HANDLE;
+    return VK_SUCCESS;
+}
+
+static inline void debug_utils_deinit(VkInstance instance, VkDebugUtilsMessengerEXT messenger)
+{
+    (void)instance;
+    (void)messenger;
+}
+
+static inline __attribute__((format(printf, 4, 5))) void debug_utils_name(
+    VkDevice device, VkObjectType type, uint64_t handle, const char* format, ...)
+{
+    (void)device;
+    (void)type;
+    (void)handle;
+    (void)format;
+}
+
+#endif
+
+// Handles are pointers or 64-bit integers depending on the platform
+#define DEBUG_NAME(device, type, handle, ...)                                                      \
+    debug_utils_name(device, type, (uint64_t)(handle), __VA_ARGS__)
+
+#endif // DEBUG_UTILS_H
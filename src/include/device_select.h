@@ -0,0 +1,24 @@
+#ifndef DEVICE_SELECT_H
+#define DEVICE_SELECT_H
+
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+// Picks the physical device to run on. Devices lacking Vulkan 1.2, timeline semaphores, a
+// graphics queue family that can present to surface, or VK_KHR_swapchain when there is a surface
+// are never chosen. The rest are scored on device type, device-local memory and dedicated
+// transfer and compute families.
+//
+// selector, if not NULL, forces a device: an index into the enumeration order, a device UUID as
+// 32 hex digits (dashes allowed), or part of the device name. Without one, the device chosen last
+// time is reused if it is still present and suitable, and the others are not examined.
+VkResult device_select(VkInstance instance,
+    VkSurfaceKHR surface,
+    const char* selector,
+    VkPhysicalDevice* physicalDevice);
+
+bool device_has_extension(VkPhysicalDevice physicalDevice, const char* name);
+// layerName NULL looks at the loader and implicit layers
+bool instance_has_extension(const char* layerName, const char* name);
+
+#endif // DEVICE_SELECT_H
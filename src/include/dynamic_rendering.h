@@ -0,0 +1,70 @@
+#ifndef DYNAMIC_RENDERING_H
+#define DYNAMIC_RENDERING_H
+
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+#include "sync2.h"
+
+typedef enum DynamicRenderingSupport {
+    DYNAMIC_RENDERING_NONE,
+    DYNAMIC_RENDERING_EXTENSION, // VK_KHR_dynamic_rendering on a 1.2 device
+    DYNAMIC_RENDERING_CORE, // Vulkan 1.3
+} DynamicRenderingSupport;
+
+// What graphics pipelines and secondary command buffers are built against: a render pass, or
+// with dynamic rendering only the attachment formats
+typedef struct RenderTarget {
+    VkRenderPass renderPass; // VK_NULL_HANDLE with dynamic rendering
+    VkFormat colorFormat;
+} RenderTarget;
+
+// Entry points, NULL when frames go through render passes
+typedef struct DynamicRendering {
+    PFN_vkCmdBeginRendering begin;
+    PFN_vkCmdEndRendering end;
+    const Sync2* sync2; // Records the layout transitions around rendering
+} DynamicRendering;
+
+// Whether the device has the extension or the core version, and the feature
+DynamicRenderingSupport dynamic_rendering_support(VkPhysicalDevice physicalDevice);
+
+// The device must have been created with the feature, and the extension for
+// DYNAMIC_RENDERING_EXTENSION. Returns false if the entry points are missing. sync2 must outlive
+// rendering.
+bool dynamic_rendering_init(DynamicRendering* rendering,
+    VkDevice device,
+    DynamicRenderingSupport support,
+    const Sync2* sync2);
+
+static inline bool dynamic_rendering_enabled(const DynamicRendering* rendering)
+{
+    return rendering->begin != NULL;
+}
+
+// pNext for VkGraphicsPipelineCreateInfo, NULL with a render pass. storage has to outlive the
+// pipeline creation.
+const void* render_target_pipeline_chain(
+    const RenderTarget* target, VkPipelineRenderingCreateInfo* storage);
+// pNext for VkCommandBufferInheritanceInfo, NULL with a render pass
+const void* render_target_inheritance_chain(
+    const RenderTarget* target, VkCommandBufferInheritanceRenderingInfo* storage);
+
+// Transitions image into the attachment layout and begins rendering with secondary command
+// buffers. With clear the contents are discarded, otherwise kept from finalLayout, where the
+// previous frame of the image left them. Mirrors the render pass dependencies.
+void dynamic_rendering_begin(const DynamicRendering* rendering,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageView imageView,
+    VkImageLayout finalLayout,
+    VkRect2D renderArea,
+    bool clear,
+    const VkClearValue* clearValue);
+// Ends rendering and transitions image into finalLayout, for presenting or a readback
+void dynamic_rendering_end(const DynamicRendering* rendering,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageLayout finalLayout);
+
+#endif // DYNAMIC_RENDERING_H
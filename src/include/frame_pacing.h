@@ -0,0 +1,52 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Trade-off between latency, throughput and power, switchable while running
+typedef enum PresentPolicy {
+    PRESENT_POLICY_VSYNC, // FIFO, the CPU runs ahead as far as the swapchain allows
+    PRESENT_POLICY_LOW_LATENCY, // MAILBOX if available, frames start once the previous is shown
+    PRESENT_POLICY_UNCAPPED, // IMMEDIATE if available, tearing allowed, no pacing
+    PRESENT_POLICY_POWER_SAVE, // FIFO with the fewest images, capped at half the refresh rate
+    PRESENT_POLICY_COUNT,
+} PresentPolicy;
+
+typedef struct FramePacing {
+    VkDevice device;
+    PFN_vkWaitForPresentKHR waitForPresent; // NULL without VK_KHR_present_wait
+    uint64_t refreshNs; // Display refresh interval the sleep limiter paces to
+    uint64_t presentId; // Last id handed to a present, 0 before the first on a swapchain
+    uint64_t nextFrameNs; // Deadline of the sleep limiter
+} FramePacing;
+
+const char* present_policy_name(PresentPolicy policy);
+// Accepts the names returned by present_policy_name
+bool present_policy_parse(const char* name, PresentPolicy* policy);
+
+// Whether the device has VK_KHR_present_id and VK_KHR_present_wait with both features
+bool frame_pacing_supports_present_wait(VkPhysicalDevice physicalDevice);
+
+VkPresentModeKHR frame_pacing_present_mode(
+    PresentPolicy policy, const VkPresentModeKHR* modes, uint32_t modeCount);
+uint32_t frame_pacing_image_count(
+    PresentPolicy policy, VkPresentModeKHR mode, const VkSurfaceCapabilitiesKHR* capabilities);
+
+// presentWait says whether the device was created with VK_KHR_present_id and
+// VK_KHR_present_wait enabled. refreshHz of 0 assumes 60 Hz.
+void frame_pacing_init(FramePacing* pacing, VkDevice device, bool presentWait, int refreshHz);
+
+// Call whenever the swapchain is replaced, present ids do not carry over
+void frame_pacing_reset(FramePacing* pacing);
+
+// Blocks until the next frame should start, before input is sampled
+void frame_pacing_wait(FramePacing* pacing, PresentPolicy policy, VkSwapchainKHR swapchain);
+
+// Chains presentId into presentInfo so frame_pacing_wait can wait for it. presentId must stay
+// alive until vkQueuePresentKHR.
+void frame_pacing_present(
+    FramePacing* pacing, VkPresentInfoKHR* presentInfo, VkPresentIdKHR* presentId);
+
+#endif // FRAME_PACING_H
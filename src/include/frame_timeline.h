@@ -0,0 +1,59 @@
+#ifndef FRAME_TIMELINE_H
+#define FRAME_TIMELINE_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "sync2.h"
+
+// Objects waiting for the frames that may use them, more make frame_timeline_defer block
+#define FRAME_TIMELINE_MAX_DELETIONS 64
+
+// Destroys handle, e.g. through vkDestroyPipeline
+typedef void (*FrameDeleteFn)(VkDevice device, uint64_t handle);
+
+typedef struct FrameDeletion {
+    FrameDeleteFn destroy;
+    uint64_t handle;
+    uint64_t value; // Destroyed once the timeline reaches it
+} FrameDeletion;
+
+// One timeline semaphore counting submitted frames. Frame n signals value n once it has executed,
+// so anything can wait for or poll a frame without a fence of its own. Only used by the thread
+// submitting frames.
+typedef struct FrameTimeline {
+    VkDevice device;
+    VkSemaphore semaphore;
+    uint64_t submitted; // Signaled by the newest frame, 0 before the first
+    uint64_t completed; // Newest value seen signaled
+    FrameDeletion deletions[FRAME_TIMELINE_MAX_DELETIONS]; // Ring, in timeline order
+    uint32_t deletionHead;
+    uint32_t deletionCount;
+} FrameTimeline;
+
+VkResult frame_timeline_init(FrameTimeline* timeline, VkDevice device);
+// Waits for every submitted frame and runs the deletions still pending
+void frame_timeline_deinit(FrameTimeline* timeline);
+
+// Polls the semaphore, returns the newest executed frame
+uint64_t frame_timeline_completed(FrameTimeline* timeline);
+// Returns immediately for values already seen signaled, 0 included
+VkResult frame_timeline_wait(FrameTimeline* timeline, uint64_t value);
+
+// Submits commandBuffer after waits, then signals signalSemaphore, if not VK_NULL_HANDLE, and the
+// frame's timeline value. value receives the latter.
+VkResult frame_timeline_submit(FrameTimeline* timeline,
+    const Sync2* sync2,
+    VkQueue queue,
+    const VkSemaphoreSubmitInfo* waits,
+    uint32_t waitCount,
+    VkCommandBuffer commandBuffer,
+    VkSemaphore signalSemaphore,
+    uint64_t* value);
+
+// Destroys handle once every frame submitted so far has executed, right away if they have
+void frame_timeline_defer(FrameTimeline* timeline, FrameDeleteFn destroy, uint64_t handle);
+// Runs the deletions whose frames have executed
+void frame_timeline_collect(FrameTimeline* timeline);
+
+#endif // FRAME_TIMELINE_H
@@ -0,0 +1,83 @@
+#ifndef FRAME_TIMING_H
+#define FRAME_TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Per-frame records kept for the summaries, older frames are overwritten
+#define FRAME_TIMING_HISTORY 1024
+
+// The CPU phases come first, each in the order the frame loop runs them
+typedef enum FrameTimingMetric {
+    FRAME_TIMING_PACING, // Held back by the present policy, see frame_pacing
+    FRAME_TIMING_EVENTS, // Window events and deferred swapchain recreation
+    FRAME_TIMING_WAIT, // Timeline waits for the frame slot and the swapchain image
+    FRAME_TIMING_ACQUIRE,
+    FRAME_TIMING_RECORD, // UI and command buffer recording
+    FRAME_TIMING_SUBMIT,
+    FRAME_TIMING_PRESENT,
+    FRAME_TIMING_PHASE_COUNT,
+    FRAME_TIMING_CPU_FRAME = FRAME_TIMING_PHASE_COUNT, // Whole loop iteration
+    FRAME_TIMING_GPU, // Render pass execution, from timestamp queries
+    FRAME_TIMING_METRIC_COUNT
+} FrameTimingMetric;
+
+typedef struct FrameTimingRecord {
+    uint64_t ns[FRAME_TIMING_METRIC_COUNT];
+    bool gpuValid; // GPU results arrive a few frames late, or not at all without timestamps
+} FrameTimingRecord;
+
+typedef struct FrameTimingStats {
+    uint32_t count;
+    double minMs;
+    double avgMs;
+    double p50Ms;
+    double p99Ms;
+    double maxMs;
+} FrameTimingStats;
+
+typedef struct FrameTiming {
+    VkDevice device;
+    VkQueryPool queryPool; // Two timestamps per frame slot, VK_NULL_HANDLE if unsupported
+    double timestampPeriod; // Nanoseconds per timestamp tick
+    uint64_t timestampMask;
+    uint32_t slotCount;
+    uint64_t* slotFrames; // Frame whose timestamps were last written into each slot
+
+    FrameTimingRecord records[FRAME_TIMING_HISTORY];
+    uint64_t frameCount; // Completed frames, the current one is records[frameCount % HISTORY]
+    uint64_t frameStartNs;
+    uint64_t phaseStartNs;
+
+    uint64_t scratch[FRAME_TIMING_HISTORY]; // Sorted copy for the percentiles
+} FrameTiming;
+
+// slotCount is the number of frame slots whose command buffers may be pending at once. GPU timing
+// is silently disabled when queueFamilyIndex does not support timestamps.
+VkResult frame_timing_init(FrameTiming* timing,
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t queueFamilyIndex,
+    uint32_t slotCount);
+
+void frame_timing_begin_frame(FrameTiming* timing);
+// Charges the time since the previous mark, or the frame start, to phase
+void frame_timing_mark(FrameTiming* timing, FrameTimingMetric phase);
+void frame_timing_end_frame(FrameTiming* timing);
+
+// Reads the timestamps the slot's previous command buffer wrote, without waiting. Call after the
+// slot's timeline value has been waited for and before recording into it again.
+void frame_timing_collect(FrameTiming* timing, uint32_t slot);
+
+// Bracket the render pass of the slot's command buffer, both outside of the render pass
+void frame_timing_record_begin(FrameTiming* timing, VkCommandBuffer commandBuffer, uint32_t slot);
+void frame_timing_record_end(FrameTiming* timing, VkCommandBuffer commandBuffer, uint32_t slot);
+
+// Summarizes the metric over the frames still in the history. Returns false without samples.
+bool frame_timing_stats(FrameTiming* timing, FrameTimingMetric metric, FrameTimingStats* stats);
+void frame_timing_log_summary(FrameTiming* timing);
+
+void frame_timing_deinit(FrameTiming* timing);
+
+#endif // FRAME_TIMING_H
@@ -0,0 +1,92 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+// Upper bound for the blocks sub-allocated from, smaller heaps get smaller blocks
+#define GPU_MEMORY_BLOCK_SIZE (64ull * 1024 * 1024)
+// Smallest buddy size, log2
+#define GPU_MEMORY_MIN_ALLOC_SHIFT 10
+
+typedef enum GpuMemoryUsage {
+    GPU_MEMORY_USAGE_GPU_ONLY, // Device local, not mapped
+    GPU_MEMORY_USAGE_CPU_TO_GPU, // Host visible and coherent, persistently mapped
+    GPU_MEMORY_USAGE_GPU_TO_CPU, // Host visible, preferably cached, persistently mapped
+} GpuMemoryUsage;
+
+typedef struct GpuAllocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* mapped; // NULL unless the memory type is host visible
+    uint32_t memoryTypeIndex;
+    int32_t blockIndex; // -1 for dedicated allocations
+    uint8_t order;
+    uint8_t optimal; // Pool of optimally tiled images
+} GpuAllocation;
+
+typedef struct GpuMemoryBlock {
+    VkDeviceMemory memory; // VK_NULL_HANDLE when the slot is unused
+    void* mapped;
+    VkDeviceSize size;
+    uint8_t maxOrder;
+    uint8_t* tree; // Buddy tree, each node holds the largest free order in its subtree plus one
+    uint32_t allocationCount;
+} GpuMemoryBlock;
+
+typedef struct GpuMemoryPool {
+    GpuMemoryBlock* blocks;
+    uint32_t blockCount;
+} GpuMemoryPool;
+
+typedef struct GpuHeapStats {
+    VkDeviceSize heapSize;
+    VkDeviceSize blockBytes; // Reserved by blocks
+    VkDeviceSize usedBytes; // Handed out from blocks, rounded to buddy sizes
+    VkDeviceSize dedicatedBytes;
+    uint32_t blockCount;
+    uint32_t allocationCount;
+    uint32_t dedicatedCount;
+} GpuHeapStats;
+
+typedef struct GpuMemory {
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    uint32_t maxAllocationCount;
+    VkDeviceSize nonCoherentAtomSize;
+    uint32_t deviceAllocationCount;
+    VkDeviceSize blockSize[VK_MAX_MEMORY_HEAPS];
+    // Buffers and linear images never share a block with optimal images, so
+    // bufferImageGranularity never has to be honored inside a block
+    GpuMemoryPool pools[VK_MAX_MEMORY_TYPES][2];
+    GpuHeapStats heapStats[VK_MAX_MEMORY_HEAPS];
+    pthread_mutex_t mutex;
+    bool initialized;
+} GpuMemory;
+
+VkResult gpu_memory_init(GpuMemory* gpuMemory, VkPhysicalDevice physicalDevice, VkDevice device);
+void gpu_memory_deinit(GpuMemory* gpuMemory);
+
+VkResult gpu_memory_create_buffer(GpuMemory* gpuMemory,
+    const VkBufferCreateInfo* createInfo,
+    GpuMemoryUsage usage,
+    VkBuffer* buffer,
+    GpuAllocation* allocation);
+void gpu_memory_destroy_buffer(GpuMemory* gpuMemory, VkBuffer buffer, GpuAllocation* allocation);
+
+VkResult gpu_memory_create_image(GpuMemory* gpuMemory,
+    const VkImageCreateInfo* createInfo,
+    GpuMemoryUsage usage,
+    VkImage* image,
+    GpuAllocation* allocation);
+void gpu_memory_destroy_image(GpuMemory* gpuMemory, VkImage image, GpuAllocation* allocation);
+
+// Makes device writes visible to the host, a no-op for host-coherent memory
+VkResult gpu_memory_invalidate(GpuMemory* gpuMemory, const GpuAllocation* allocation);
+
+void gpu_memory_get_heap_stats(GpuMemory* gpuMemory, uint32_t heapIndex, GpuHeapStats* stats);
+void gpu_memory_log_stats(GpuMemory* gpuMemory);
+
+#endif // GPU_MEMORY_H
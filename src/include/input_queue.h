@@ -0,0 +1,75 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Events buffered between the event and the render thread, a power of two
+#define INPUT_QUEUE_CAPACITY 1024
+
+typedef enum InputEventType {
+    INPUT_EVENT_CURSOR_POS,
+    INPUT_EVENT_MOUSE_BUTTON,
+    INPUT_EVENT_SCROLL,
+    INPUT_EVENT_CHAR,
+    INPUT_EVENT_FRAMEBUFFER_SIZE,
+    INPUT_EVENT_REFRESH, // The window system lost the content, e.g. after being uncovered
+} InputEventType;
+
+// Copied out of the GLFW callbacks, buttons are GLFW codes
+typedef struct InputEvent {
+    InputEventType type;
+    uint64_t timeNs; // When the event thread received it
+    union {
+        struct {
+            double x, y;
+        } cursor;
+        struct {
+            int button;
+            bool pressed;
+            double x, y;
+        } mouseButton;
+        struct {
+            double x, y;
+        } scroll;
+        uint32_t codepoint;
+        struct {
+            int width, height;
+        } framebufferSize;
+    };
+} InputEvent;
+
+// Lock-free ring with a single producer and a single consumer. The mutex is only taken to wake a
+// consumer sleeping in input_queue_wait.
+typedef struct InputQueue {
+    alignas(64) _Atomic uint64_t head; // Events pushed by the producer
+    uint64_t cachedTail; // Producer's last view of tail, refreshed only when it looks full
+    alignas(64) _Atomic uint64_t tail; // Events popped by the consumer
+    _Atomic uint64_t dropped;
+    atomic_bool sleeping; // The consumer is in input_queue_wait
+    atomic_bool woken; // input_queue_wake was called since the consumer last waited
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    InputEvent events[INPUT_QUEUE_CAPACITY];
+} InputQueue;
+
+bool input_queue_init(InputQueue* queue);
+void input_queue_deinit(InputQueue* queue);
+
+// Producer only. Drops the event and returns false when the consumer has fallen this far behind.
+bool input_queue_push(InputQueue* queue, const InputEvent* event);
+// Consumer only, returns false when empty
+bool input_queue_pop(InputQueue* queue, InputEvent* event);
+// Consumer only, events dropped since the last call
+uint64_t input_queue_take_dropped(InputQueue* queue);
+
+// Consumer only. Sleeps until an event is pushed, input_queue_wake is called or timeoutNs has
+// passed, UINT64_MAX waits without a timeout.
+void input_queue_wait(InputQueue* queue, uint64_t timeoutNs);
+// Any thread, ends the consumer's current or next input_queue_wait
+void input_queue_wake(InputQueue* queue);
+
+#endif // INPUT_QUEUE_H
@@ -0,0 +1,57 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Upper bound on the worker pool, jobs are coarse (pipeline builds, command recording)
+#define JOB_MAX_WORKERS 8
+#define JOB_MAX_DEPENDENTS 8
+
+typedef void (*JobFunction)(void* arg);
+
+// Owned by the caller and must stay alive until job_wait returns for it. Fields are managed by
+// the job system.
+typedef struct Job {
+    JobFunction function;
+    void* arg;
+    struct Job* next; // Ready queue link
+    struct Job* dependents[JOB_MAX_DEPENDENTS];
+    uint32_t dependentCount;
+    uint32_t unfinishedDependencies;
+    bool submitted;
+    bool done;
+} Job;
+
+// Fixed pool of worker threads running jobs once all their dependencies have finished
+typedef struct JobSystem {
+    pthread_t workers[JOB_MAX_WORKERS];
+    uint32_t workerCount;
+    pthread_mutex_t mutex;
+    pthread_cond_t workAvailable;
+    pthread_cond_t jobDone;
+    Job* head;
+    Job* tail;
+    bool stopping;
+} JobSystem;
+
+// A workerCount of 0 uses one worker per CPU beyond the calling thread's, at least one
+bool job_system_init(JobSystem* jobs, uint32_t workerCount);
+
+void job_init(Job* job, JobFunction function, void* arg);
+
+// Makes job wait for dependency, which may already be submitted or even finished. Must be called
+// before job is submitted.
+bool job_depends_on(JobSystem* jobs, Job* job, Job* dependency);
+
+// Queues the job, or leaves it to be queued by its last dependency to finish
+void job_submit(JobSystem* jobs, Job* job);
+
+// Blocks until the job has run. Only for threads outside the pool.
+void job_wait(JobSystem* jobs, Job* job);
+
+// Runs everything already queued, then joins the workers
+void job_system_deinit(JobSystem* jobs);
+
+#endif // JOB_H
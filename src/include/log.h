@@ -1,58 +1,159 @@
 #ifndef LOG_H
 #define LOG_H
 
-#include <stdarg.h>
-#include <stdio.h>
-#include <string.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
-static inline const char* curr_time(void)
-{
-    static _Thread_local char buffer[64];
+// Numeric so the compile-time threshold can be compared in #if
+#define YACW_LOG_LEVEL_TRACE 0
+#define YACW_LOG_LEVEL_DEBUG 1
+#define YACW_LOG_LEVEL_INFO 2
+#define YACW_LOG_LEVEL_WARN 3
+#define YACW_LOG_LEVEL_ERROR 4
 
-    struct timespec ts;
-    struct tm tm_info;
-
-    clock_gettime(CLOCK_REALTIME, &ts);
-    localtime_r(&ts.tv_sec, &tm_info);
-
-    snprintf(buffer,
-        sizeof(buffer),
-        "%04d-%02d-%02d %02d:%02d:%02d.%03ld",
-        tm_info.tm_year + 1900,
-        tm_info.tm_mon + 1,
-        tm_info.tm_mday,
-        tm_info.tm_hour,
-        tm_info.tm_min,
-        tm_info.tm_sec,
-        ts.tv_nsec / 1000000);
-
-    return buffer;
-}
+// Lowest level compiled in. Overridable from CMake.
+#ifndef YACW_LOG_LEVEL
+#define YACW_LOG_LEVEL YACW_LOG_LEVEL_INFO
+#endif
+
+typedef enum LogLevel {
+    LOG_LEVEL_TRACE = YACW_LOG_LEVEL_TRACE,
+    LOG_LEVEL_DEBUG = YACW_LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO = YACW_LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN = YACW_LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR = YACW_LOG_LEVEL_ERROR,
+} LogLevel;
+
+// What a thread does when its ring has no room for another record
+typedef enum LogFullPolicy {
+    LOG_FULL_DROP, // Discard the record and count it, the count is reported by the writer thread
+    LOG_FULL_BLOCK, // Wait for the writer thread to make room
+} LogFullPolicy;
+
+// Starts the background writer thread and registers log_shutdown with atexit. Before that, and
+// after log_shutdown, records are formatted and written synchronously on the calling thread.
+bool log_init(LogFullPolicy policy);
+
+// Mirrors every record the writer thread handles into a memory-mapped binary file, decoded by the
+// yacw_log_decode tool. Records below consoleLevel are then only written there. Requires
+// log_init and a build with YACW_LOG_BINARY_SINK.
+bool log_open_binary(const char* path, LogLevel consoleLevel);
+
+// Writes everything still queued and joins the writer thread. No other thread may be logging.
+void log_shutdown(void);
+
+// Packs the arguments into the calling thread's ring, formatting happens on the writer thread.
+// fmt and file must outlive the writer thread, which string literals and __FILE__ do; %s
+// arguments are copied.
+void log_write(LogLevel level, const char* file, int line, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// A disabled level still type-checks its arguments but never evaluates them
+#define LOG_DISABLED(format, ...)                                                                  \
+    do {                                                                                           \
+        if (0) {                                                                                   \
+            log_write(LOG_LEVEL_TRACE, __FILE__, __LINE__, format, ##__VA_ARGS__);                 \
+        }                                                                                          \
+    } while (0)
 
-static inline void log_print(
-    FILE* out, const char* level, const char* filepath, int line, const char* fmt, ...)
+#if YACW_LOG_LEVEL <= YACW_LOG_LEVEL_TRACE
+#define LOG_TRACE(format, ...) log_write(LOG_LEVEL_TRACE, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#else
+#define LOG_TRACE(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
+
+#if YACW_LOG_LEVEL <= YACW_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) log_write(LOG_LEVEL_DEBUG, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
+
+#if YACW_LOG_LEVEL <= YACW_LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) log_write(LOG_LEVEL_INFO, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
+
+#if YACW_LOG_LEVEL <= YACW_LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) log_write(LOG_LEVEL_WARN, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
+
+// Errors are always compiled in
+#define LOG_ERROR(format, ...) log_write(LOG_LEVEL_ERROR, __FILE__, __LINE__, format, ##__VA_ARGS__)
+
+// Token bucket of one call site, zero-initialized. Holds the time at which the bucket will be
+// full again. Every call reads the coarse monotonic clock, served from the vDSO without a
+// syscall; a suppressed message then costs a relaxed increment and a granted one a
+// compare-and-swap, retried if another thread took a token in between.
+typedef struct LogRateLimiter {
+    _Atomic uint64_t fullAtNs;
+    atomic_uint suppressed;
+} LogRateLimiter;
+
+// Takes a token, allowing burst messages at once and perSecond (> 0) after that. On success
+// *suppressed is the number of messages dropped since the last one that got through.
+static inline bool log_rate_limit(
+    LogRateLimiter* limiter, uint32_t burst, uint32_t perSecond, uint32_t* suppressed)
 {
-    size_t offset = (size_t)YACW_BASE_DIR_LEN;
-    const char* fileptr = filepath;
+    // Coarse clock ticks are plenty for rates of a few messages per second
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    uint64_t nowNs = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+    uint64_t intervalNs = 1000000000ull / perSecond;
+    uint64_t fullAtNs = atomic_load_explicit(&limiter->fullAtNs, memory_order_relaxed);
+    for (;;) {
+        uint64_t startNs = fullAtNs > nowNs ? fullAtNs : nowNs;
+        if (startNs - nowNs >= intervalNs * burst) {
+            atomic_fetch_add_explicit(&limiter->suppressed, 1, memory_order_relaxed);
+            return false;
+        }
 
-    size_t flen = strlen(filepath);
-    if (offset < flen) {
-        fileptr = filepath + offset;
+        if (atomic_compare_exchange_weak_explicit(&limiter->fullAtNs,
+                &fullAtNs,
+                startNs + intervalNs,
+                memory_order_relaxed,
+                memory_order_relaxed)) {
+            break;
+        }
     }
 
-    fprintf(out, "%23s %5s | %15s:%4d: ", curr_time(), level, fileptr, line);
+    *suppressed = atomic_exchange_explicit(&limiter->suppressed, 0, memory_order_relaxed);
+    return true;
+}
 
-    va_list ap;
-    va_start(ap, fmt);
-    vfprintf(out, fmt, ap);
-    va_end(ap);
+// LOG_MACRO is one of the level macros above, so compile-time filtering still applies. Every
+// expansion gets its own static limiter, i.e. one per __FILE__/__LINE__ call site.
+#define LOG_RATE_LIMITED(LOG_MACRO, burst, perSecond, format, ...)                                 \
+    do {                                                                                           \
+        static LogRateLimiter logRateLimiter;                                                      \
+        uint32_t logSuppressed;                                                                    \
+        if (log_rate_limit(&logRateLimiter, burst, perSecond, &logSuppressed)) {                   \
+            if (logSuppressed > 0) {                                                               \
+                LOG_MACRO("Suppressed %u similar messages", logSuppressed);                        \
+            }                                                                                      \
+            LOG_MACRO(format, ##__VA_ARGS__);                                                      \
+        }                                                                                          \
+    } while (0)
 
-    fprintf(out, "\n");
-}
+// Defaults for hot paths: a burst of 5, then one message per second. Disabled levels skip the
+// limiter as well.
+#if YACW_LOG_LEVEL <= YACW_LOG_LEVEL_INFO
+#define LOG_INFO_LIMITED(format, ...) LOG_RATE_LIMITED(LOG_INFO, 5, 1, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO_LIMITED(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
 
-#define LOG_INFO(format, ...) log_print(stdout, "INFO", __FILE__, __LINE__, format, ##__VA_ARGS__)
+#if YACW_LOG_LEVEL <= YACW_LOG_LEVEL_WARN
+#define LOG_WARN_LIMITED(format, ...) LOG_RATE_LIMITED(LOG_WARN, 5, 1, format, ##__VA_ARGS__)
+#else
+#define LOG_WARN_LIMITED(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
 
-#define LOG_ERROR(format, ...) log_print(stderr, "ERROR", __FILE__, __LINE__, format, ##__VA_ARGS__)
+#define LOG_ERROR_LIMITED(format, ...) LOG_RATE_LIMITED(LOG_ERROR, 5, 1, format, ##__VA_ARGS__)
 
 #endif // LOG_H
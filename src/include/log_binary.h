@@ -0,0 +1,69 @@
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "log.h"
+
+// Memory-mapped binary log. The file starts with a LogBinaryHeader, followed by 8-byte aligned
+// entries that all start with a type and a size. A call site is described once, by a site entry
+// carrying its level, file, line and format; records then only refer to it by id and carry the
+// packed arguments (see log_format.h). A zero type marks the end of a file that was not closed.
+
+#define LOG_BINARY_MAGIC "YACWLOG1"
+#define LOG_BINARY_VERSION 1
+
+typedef enum LogBinaryEntryType {
+    LOG_BINARY_END = 0,
+    LOG_BINARY_SITE = 1,
+    LOG_BINARY_RECORD = 2,
+} LogBinaryEntryType;
+
+typedef struct LogBinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} LogBinaryHeader;
+
+// Followed by the file and format strings, without terminators
+typedef struct LogBinarySite {
+    uint32_t type;
+    uint32_t size;
+    uint32_t id; // Sites are numbered from 0 in the order they appear
+    uint16_t level;
+    uint16_t reserved;
+    int32_t line;
+    uint32_t fileLength;
+    uint32_t fmtLength;
+    uint32_t reserved2;
+} LogBinarySite;
+
+// Followed by the packed arguments
+typedef struct LogBinaryRecord {
+    uint32_t type;
+    uint32_t size;
+    uint32_t site;
+    uint16_t truncated;
+    uint16_t reserved;
+    uint64_t timestampNs;
+    uint32_t argsSize;
+    uint32_t reserved2;
+} LogBinaryRecord;
+
+bool log_binary_open(const char* path);
+
+// Not thread safe, only the log writer thread calls this
+void log_binary_write(LogLevel level,
+    const char* file,
+    int line,
+    const char* fmt,
+    uint64_t timestampNs,
+    const uint8_t* args,
+    uint32_t argsSize,
+    bool truncated);
+
+// Truncates the file to what was written and unmaps it
+void log_binary_close(void);
+
+#endif // LOG_BINARY_H
@@ -0,0 +1,48 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "log.h"
+
+// Argument packing and line formatting, shared by the log writer and the binary log decoder.
+// Packed arguments are 8-byte slots for numbers and a length slot plus padded bytes for strings.
+
+// Packed arguments of one record, longer %s arguments are truncated
+#define LOG_MAX_ARGS_SIZE 512
+// One formatted line, including the prefix and the newline
+#define LOG_LINE_MAX 2048
+
+// The formatted "YYYY-MM-DD HH:MM:SS" part only changes once per second
+typedef struct LogDateCache {
+    int64_t second;
+    char prefix[32];
+} LogDateCache;
+
+#define LOG_DATE_CACHE_INIT { .second = -1 }
+
+static inline uint32_t log_align8(uint32_t size) { return (size + 7) & ~7u; }
+
+const char* log_level_name(LogLevel level);
+
+// Copies every argument fmt consumes into args. Returns false if they did not all fit, args then
+// holds as many as did.
+bool log_pack_args(uint8_t* args, uint32_t* size, const char* fmt, va_list ap);
+
+// Formats a complete line ending in a newline, not NUL terminated, into line, which must hold
+// LOG_LINE_MAX bytes. Returns its length.
+size_t log_format_line(LogDateCache* cache,
+    LogLevel level,
+    const char* file,
+    int lineNumber,
+    uint64_t timestampNs,
+    const char* fmt,
+    const uint8_t* args,
+    uint32_t argsSize,
+    bool truncated,
+    char* line);
+
+#endif // LOG_FORMAT_H
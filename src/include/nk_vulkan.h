@@ -0,0 +1,94 @@
+#ifndef NK_VULKAN_H
+#define NK_VULKAN_H
+
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+#include "damage.h"
+#include "dynamic_rendering.h"
+#include "gpu_memory.h"
+#include "nuklear.h"
+#include "upload.h"
+
+// Per frame-in-flight slice of the streaming buffer
+#define NK_VULKAN_VERTEX_BUFFER_SIZE (512 * 1024)
+#define NK_VULKAN_INDEX_BUFFER_SIZE (128 * 1024)
+// Every recorded command has at least one triangle, which bounds the commands per frame
+#define NK_VULKAN_MAX_DRAWS (NK_VULKAN_INDEX_BUFFER_SIZE / (3 * sizeof(nk_draw_index)))
+
+// A Nuklear draw command, its scissor clipped to the framebuffer and empty when offscreen
+typedef struct NkVulkanDraw {
+    VkRect2D scissor;
+    uint32_t firstIndex;
+    uint32_t elemCount;
+} NkVulkanDraw;
+
+// Host copy of a converted frame, the next one is diffed against it
+typedef struct NkVulkanFrame {
+    uint8_t* vertices;
+    uint8_t* indices;
+    NkVulkanDraw* draws;
+    uint32_t drawCount;
+    bool valid;
+} NkVulkanFrame;
+
+typedef struct NkVulkan {
+    struct nk_context ctx;
+    struct nk_font_atlas atlas;
+    struct nk_draw_null_texture nullTexture;
+    struct nk_buffer commands;
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+
+    GpuMemory* gpuMemory;
+
+    VkImage fontImage;
+    GpuAllocation fontAllocation;
+    VkImageView fontImageView;
+    VkSampler fontSampler;
+
+    // Host-coherent vertex/index ring, persistently mapped and partitioned per frame in flight
+    VkBuffer streamBuffer;
+    GpuAllocation streamAllocation;
+    uint8_t* streamMapped;
+    uint32_t frameCount;
+
+    NkVulkanFrame frames[2];
+    uint32_t currentFrame;
+} NkVulkan;
+
+// Everything but the pipeline, which nk_vulkan_create_pipeline builds
+VkResult nk_vulkan_init(NkVulkan* ui,
+    GpuMemory* gpuMemory,
+    UploadCtx* upload,
+    VkDevice device,
+    uint32_t frameCount);
+
+// Builds the pipeline from SHADER_UI_VERT and SHADER_UI_FRAG modules. Only writes ui->pipeline, so
+// it may run on another thread once nk_vulkan_init has returned.
+VkResult nk_vulkan_create_pipeline(NkVulkan* ui,
+    VkDevice device,
+    VkPipelineCache pipelineCache,
+    const RenderTarget* target,
+    VkShaderModule vertShaderModule,
+    VkShaderModule fragShaderModule);
+
+// Converts the current Nuklear frame into the slice of frameIndex and adds whatever changed since
+// the previous call to damage. Clears the Nuklear context.
+void nk_vulkan_prepare(NkVulkan* ui, uint32_t frameIndex, VkExtent2D extent, DamageRegion* damage);
+
+// Records the frame of the last nk_vulkan_prepare, limited to damage. Must be called inside the
+// render pass.
+void nk_vulkan_render(NkVulkan* ui,
+    VkCommandBuffer commandBuffer,
+    uint32_t frameIndex,
+    VkExtent2D extent,
+    const DamageRegion* damage);
+
+void nk_vulkan_deinit(NkVulkan* ui, VkDevice device);
+
+#endif // NK_VULKAN_H
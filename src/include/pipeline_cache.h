@@ -0,0 +1,17 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <vulkan/vulkan_core.h>
+
+// Creates a pipeline cache seeded from the on-disk cache, if it was written by the same driver
+// and device. A missing or stale file yields an empty cache, not an error.
+VkResult pipeline_cache_init(
+    VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache* pipelineCache);
+
+// Starts reading the on-disk cache in the background, ahead of pipeline_cache_init
+void pipeline_cache_prefetch(void);
+
+// Writes the cache back to disk atomically and destroys it
+void pipeline_cache_deinit(VkDevice device, VkPipelineCache pipelineCache);
+
+#endif // PIPELINE_CACHE_H
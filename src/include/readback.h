@@ -0,0 +1,34 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+#include "gpu_memory.h"
+#include "sync2.h"
+
+// Host-readable copy of a color image, e.g. the final frame of a headless run
+typedef struct Readback {
+    VkBuffer buffer;
+    GpuAllocation allocation;
+    VkExtent2D extent;
+    VkFormat format;
+} Readback;
+
+VkResult readback_init(
+    Readback* readback, GpuMemory* gpuMemory, VkExtent2D extent, VkFormat format);
+
+// Records a copy of image, currently in layout, into the readback buffer. Must be called outside
+// of a render pass. The image is left in the same layout.
+void readback_record(Readback* readback,
+    const Sync2* sync2,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageLayout layout);
+
+// Writes the copied image as a binary PPM once the recording command buffer has completed
+bool readback_write_ppm(Readback* readback, GpuMemory* gpuMemory, const char* path);
+
+void readback_deinit(Readback* readback, GpuMemory* gpuMemory);
+
+#endif // READBACK_H
@@ -0,0 +1,52 @@
+#ifndef SHADER_RELOAD_H
+#define SHADER_RELOAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+#include "dynamic_rendering.h"
+
+// Development mode, built with YACW_SHADER_HOT_RELOAD. A background thread watches the shader
+// sources with inotify, recompiles them with glslc when they change and builds the replacement
+// triangle pipeline, which the render thread picks up without ever waiting on any of it.
+
+// Called on the watcher thread once a rebuilt pipeline is ready to be taken
+typedef void (*ShaderReloadReadyFn)(void* arg);
+
+typedef struct ShaderReload {
+    VkDevice device;
+    VkPipelineCache pipelineCache;
+    RenderTarget target;
+    VkPipelineLayout pipelineLayout;
+    ShaderReloadReadyFn onReady;
+    void* onReadyArg;
+
+    int inotifyFd;
+    pthread_t thread;
+    bool threadStarted;
+    atomic_bool stop;
+
+    pthread_mutex_t mutex;
+    VkPipeline ready; // Built but not taken yet, guarded by mutex
+} ShaderReload;
+
+// The target's render pass and the layout must outlive the reloader. Failing to watch the sources
+// only disables reloading, it is not an error. onReady may be NULL.
+VkResult shader_reload_init(ShaderReload* reload,
+    VkDevice device,
+    VkPipelineCache pipelineCache,
+    const RenderTarget* target,
+    VkPipelineLayout pipelineLayout,
+    ShaderReloadReadyFn onReady,
+    void* onReadyArg);
+
+// Returns the newest rebuilt pipeline, now owned by the caller, or VK_NULL_HANDLE. Never blocks
+// on a build in progress.
+VkPipeline shader_reload_take(ShaderReload* reload);
+
+// Stops the watcher thread, waiting for a build in progress, and destroys an untaken pipeline
+void shader_reload_deinit(ShaderReload* reload);
+
+#endif // SHADER_RELOAD_H
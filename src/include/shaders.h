@@ -0,0 +1,34 @@
+#ifndef SHADERS_H
+#define SHADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+typedef enum ShaderId {
+    SHADER_TRIANGLE_VERT,
+    SHADER_TRIANGLE_FRAG,
+    SHADER_UI_VERT,
+    SHADER_UI_FRAG,
+    SHADER_COUNT,
+} ShaderId;
+
+// SPIR-V compiled into the executable at build time
+typedef struct ShaderCode {
+    const uint32_t* code;
+    size_t size; // In bytes
+} ShaderCode;
+
+ShaderCode shader_code(ShaderId id);
+
+// File name of the shader's SPIR-V, e.g. "ui.frag.spv"
+const char* shader_file_name(ShaderId id);
+
+// Starts reading the YACW_SHADER_DIR files in the background, if that is set
+void shader_prefetch(void);
+
+// Creates the module from the embedded SPIR-V. If YACW_SHADER_DIR is set, the .spv file of the
+// same name in that directory is loaded instead.
+VkResult shader_create_module(VkDevice device, ShaderId id, VkShaderModule* shaderModule);
+
+#endif // SHADERS_H
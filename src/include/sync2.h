@@ -0,0 +1,47 @@
+#ifndef SYNC2_H
+#define SYNC2_H
+
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+// Semaphores and command buffers sync2_queue_submit can translate for the fallback
+#define SYNC2_MAX_SEMAPHORES 4
+#define SYNC2_MAX_COMMAND_BUFFERS 4
+
+typedef enum Sync2Support {
+    SYNC2_NONE,
+    SYNC2_EXTENSION, // VK_KHR_synchronization2 on a 1.2 device
+    SYNC2_CORE, // Vulkan 1.3
+} Sync2Support;
+
+// Entry points, NULL when everything is translated to the original commands
+typedef struct Sync2 {
+    PFN_vkQueueSubmit2 queueSubmit2;
+    PFN_vkCmdPipelineBarrier2 pipelineBarrier2;
+} Sync2;
+
+// Whether the device has the extension or the core version, and the feature
+Sync2Support sync2_support(VkPhysicalDevice physicalDevice);
+
+// The device must have been created with the feature, and the extension for SYNC2_EXTENSION.
+// Returns false if the entry points are missing.
+bool sync2_init(Sync2* sync2, VkDevice device, Sync2Support support);
+
+static inline bool sync2_enabled(const Sync2* sync2)
+{
+    return sync2->queueSubmit2 != NULL;
+}
+
+// Without synchronization2 every barrier is recorded with its own vkCmdPipelineBarrier, so their
+// stages and accesses must be ones that exist there
+void sync2_pipeline_barrier(
+    const Sync2* sync2, VkCommandBuffer commandBuffer, const VkDependencyInfo* dependencyInfo);
+void sync2_image_barrier(
+    const Sync2* sync2, VkCommandBuffer commandBuffer, const VkImageMemoryBarrier2* barrier);
+
+// A single submission. The fallback goes through vkQueueSubmit with the timeline values chained,
+// which signals at the end of all commands whatever stage is given.
+VkResult sync2_queue_submit(
+    const Sync2* sync2, VkQueue queue, const VkSubmitInfo2* submit, VkFence fence);
+
+#endif // SYNC2_H
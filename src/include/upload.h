@@ -0,0 +1,105 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stdbool.h>
+#include <vulkan/vulkan_core.h>
+
+#include "gpu_memory.h"
+#include "sync2.h"
+
+// Host-visible staging ring shared by all uploads
+#define UPLOAD_STAGING_SIZE (8ull * 1024 * 1024)
+// Transfer command buffers that may be in flight at once
+#define UPLOAD_BATCH_COUNT 4
+
+typedef struct UploadBatch {
+    VkCommandBuffer commandBuffer;
+    uint64_t timelineValue; // Signaled once the batch has executed, 0 if never submitted
+    VkDeviceSize stagingEnd; // Ring position that becomes reusable once the batch has executed
+} UploadBatch;
+
+typedef struct UploadCtx {
+    VkDevice device;
+    GpuMemory* gpuMemory;
+    VkQueue queue;
+    uint32_t transferQueueFamilyIndex;
+    uint32_t graphicsQueueFamilyIndex;
+    VkCommandPool commandPool;
+    UploadBatch batches[UPLOAD_BATCH_COUNT];
+    uint32_t currentBatch;
+    bool recording;
+    uint32_t copyCount; // Copies recorded into the current batch
+
+    VkSemaphore timeline;
+    uint64_t nextTimelineValue;
+
+    VkBuffer stagingBuffer;
+    GpuAllocation stagingAllocation;
+    VkDeviceSize stagingHead; // Monotonic, wrapped modulo UPLOAD_STAGING_SIZE
+    VkDeviceSize stagingTail;
+
+    // Release barriers of the batch being recorded
+    VkBufferMemoryBarrier* recordingBuffers;
+    uint32_t recordingBufferCount;
+    uint32_t recordingBufferCapacity;
+    VkImageMemoryBarrier* recordingImages;
+    uint32_t recordingImageCount;
+    uint32_t recordingImageCapacity;
+    VkPipelineStageFlags recordingStageMask;
+    VkAccessFlags recordingAccessMask;
+
+    // Acquire barriers and wait for the next graphics submission
+    VkBufferMemoryBarrier2* pendingBuffers;
+    uint32_t pendingBufferCount;
+    uint32_t pendingBufferCapacity;
+    VkImageMemoryBarrier2* pendingImages;
+    uint32_t pendingImageCount;
+    uint32_t pendingImageCapacity;
+    uint64_t waitValue;
+    VkPipelineStageFlags waitStageMask;
+} UploadCtx;
+
+// queue must be a queue of transferQueueFamilyIndex. When both families are the same no ownership
+// transfer is needed and the copies only synchronize through the timeline semaphore.
+VkResult upload_init(UploadCtx* upload,
+    VkDevice device,
+    GpuMemory* gpuMemory,
+    VkQueue queue,
+    uint32_t transferQueueFamilyIndex,
+    uint32_t graphicsQueueFamilyIndex);
+
+// Stages data and records a copy into the current batch. The buffer must have been created with
+// VK_SHARING_MODE_EXCLUSIVE; after the copy it belongs to the graphics queue family and is visible
+// to dstStageMask/dstAccessMask once the frame that waits on the batch starts.
+VkResult upload_buffer(UploadCtx* upload,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    const void* data,
+    VkDeviceSize size,
+    VkPipelineStageFlags dstStageMask,
+    VkAccessFlags dstAccessMask);
+
+// Same for the first mip level and layer of a color image, whose previous contents are discarded.
+// The image ends up in finalLayout.
+VkResult upload_image(UploadCtx* upload,
+    VkImage image,
+    VkExtent3D extent,
+    const void* data,
+    VkDeviceSize size,
+    VkImageLayout finalLayout,
+    VkPipelineStageFlags dstStageMask,
+    VkAccessFlags dstAccessMask);
+
+// Submits the recorded copies, if any, as one batch signaling the timeline semaphore
+VkResult upload_flush(UploadCtx* upload);
+
+// Records the pending acquire barriers into a graphics command buffer, outside of a render pass.
+// Returns the timeline value its submission has to wait on at waitStageMask, or 0.
+uint64_t upload_record_acquire(UploadCtx* upload,
+    const Sync2* sync2,
+    VkCommandBuffer commandBuffer,
+    VkPipelineStageFlags* waitStageMask);
+
+void upload_deinit(UploadCtx* upload);
+
+#endif // UPLOAD_H
@@ -0,0 +1,124 @@
+#include "input_queue.h"
+
+#include <time.h>
+
+#include "log.h"
+#include "timer.h"
+
+bool input_queue_init(InputQueue* queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->cachedTail = 0;
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->sleeping, false);
+    atomic_init(&queue->woken, false);
+
+    if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
+        LOG_ERROR("Failed to create the input queue mutex");
+        return false;
+    }
+
+    // Timeouts are measured against the same clock as timer_now_ns
+    pthread_condattr_t condAttr;
+    bool condCreated = pthread_condattr_init(&condAttr) == 0;
+    if (condCreated) {
+        condCreated = pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC) == 0
+            && pthread_cond_init(&queue->wake, &condAttr) == 0;
+        pthread_condattr_destroy(&condAttr);
+    }
+    if (!condCreated) {
+        LOG_ERROR("Failed to create the input queue condition variable");
+        pthread_mutex_destroy(&queue->mutex);
+        return false;
+    }
+
+    return true;
+}
+
+void input_queue_deinit(InputQueue* queue)
+{
+    pthread_cond_destroy(&queue->wake);
+    pthread_mutex_destroy(&queue->mutex);
+}
+
+// The store the caller just made and the load of sleeping are both sequentially consistent,
+// pairing with the store of sleeping and the load of head or woken in input_queue_wait. Either
+// the consumer sees the change or this sees it sleeping and signals under the mutex it holds
+// until it is waiting.
+static void wake_consumer(InputQueue* queue)
+{
+    if (atomic_load(&queue->sleeping)) {
+        pthread_mutex_lock(&queue->mutex);
+        pthread_cond_signal(&queue->wake);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+}
+
+bool input_queue_push(InputQueue* queue, const InputEvent* event)
+{
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (head - queue->cachedTail == INPUT_QUEUE_CAPACITY) {
+        queue->cachedTail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head - queue->cachedTail == INPUT_QUEUE_CAPACITY) {
+            atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+    }
+
+    queue->events[head & (INPUT_QUEUE_CAPACITY - 1)] = *event;
+    atomic_store(&queue->head, head + 1);
+
+    wake_consumer(queue);
+    return true;
+}
+
+bool input_queue_pop(InputQueue* queue, InputEvent* event)
+{
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return false;
+    }
+
+    *event = queue->events[tail & (INPUT_QUEUE_CAPACITY - 1)];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint64_t input_queue_take_dropped(InputQueue* queue)
+{
+    return atomic_exchange_explicit(&queue->dropped, 0, memory_order_relaxed);
+}
+
+void input_queue_wait(InputQueue* queue, uint64_t timeoutNs)
+{
+    struct timespec deadline = { 0 };
+    if (timeoutNs != UINT64_MAX) {
+        uint64_t deadlineNs = timer_now_ns() + timeoutNs;
+        deadline = (struct timespec) { .tv_sec = (time_t)(deadlineNs / 1000000000ull),
+            .tv_nsec = (long)(deadlineNs % 1000000000ull) };
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    atomic_store(&queue->sleeping, true);
+
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    while (!atomic_load(&queue->woken) && tail == atomic_load(&queue->head)) {
+        if (timeoutNs == UINT64_MAX) {
+            pthread_cond_wait(&queue->wake, &queue->mutex);
+        } else if (pthread_cond_timedwait(&queue->wake, &queue->mutex, &deadline) != 0) {
+            break;
+        }
+    }
+
+    atomic_store(&queue->sleeping, false);
+    atomic_store_explicit(&queue->woken, false, memory_order_relaxed);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+void input_queue_wake(InputQueue* queue)
+{
+    atomic_store(&queue->woken, true);
+    wake_consumer(queue);
+}
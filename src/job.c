@@ -0,0 +1,174 @@
+#include "job.h"
+
+#include <unistd.h>
+
+#include "log.h"
+
+// Needs the mutex
+static void enqueue(JobSystem* jobs, Job* job)
+{
+    job->next = NULL;
+    if (jobs->tail != NULL) {
+        jobs->tail->next = job;
+    } else {
+        jobs->head = job;
+    }
+    jobs->tail = job;
+    pthread_cond_signal(&jobs->workAvailable);
+}
+
+static void* worker_main(void* arg)
+{
+    JobSystem* jobs = arg;
+
+    pthread_mutex_lock(&jobs->mutex);
+    for (;;) {
+        while (jobs->head == NULL && !jobs->stopping) {
+            pthread_cond_wait(&jobs->workAvailable, &jobs->mutex);
+        }
+        if (jobs->head == NULL) {
+            break;
+        }
+
+        Job* job = jobs->head;
+        jobs->head = job->next;
+        if (jobs->head == NULL) {
+            jobs->tail = NULL;
+        }
+
+        pthread_mutex_unlock(&jobs->mutex);
+        job->function(job->arg);
+        pthread_mutex_lock(&jobs->mutex);
+
+        job->done = true;
+        for (uint32_t i = 0; i < job->dependentCount; i++) {
+            Job* dependent = job->dependents[i];
+            if (--dependent->unfinishedDependencies == 0 && dependent->submitted) {
+                enqueue(jobs, dependent);
+            }
+        }
+        pthread_cond_broadcast(&jobs->jobDone);
+    }
+    pthread_mutex_unlock(&jobs->mutex);
+
+    return NULL;
+}
+
+bool job_system_init(JobSystem* jobs, uint32_t workerCount)
+{
+    *jobs = (JobSystem) { 0 };
+
+    if (workerCount == 0) {
+        long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = cpuCount > 1 ? (uint32_t)(cpuCount - 1) : 1;
+    }
+    if (workerCount > JOB_MAX_WORKERS) {
+        workerCount = JOB_MAX_WORKERS;
+    }
+
+    if (pthread_mutex_init(&jobs->mutex, NULL) != 0) {
+        LOG_ERROR("Failed to create job system mutex");
+        return false;
+    }
+
+    if (pthread_cond_init(&jobs->workAvailable, NULL) != 0) {
+        LOG_ERROR("Failed to create job system condition variable");
+        pthread_mutex_destroy(&jobs->mutex);
+        return false;
+    }
+
+    if (pthread_cond_init(&jobs->jobDone, NULL) != 0) {
+        LOG_ERROR("Failed to create job system condition variable");
+        pthread_cond_destroy(&jobs->workAvailable);
+        pthread_mutex_destroy(&jobs->mutex);
+        return false;
+    }
+
+    for (; jobs->workerCount < workerCount; jobs->workerCount++) {
+        if (pthread_create(&jobs->workers[jobs->workerCount], NULL, worker_main, jobs) != 0) {
+            break;
+        }
+    }
+
+    // Fewer workers only cost parallelism
+    if (jobs->workerCount == 0) {
+        LOG_ERROR("Failed to start any job worker");
+        pthread_cond_destroy(&jobs->jobDone);
+        pthread_cond_destroy(&jobs->workAvailable);
+        pthread_mutex_destroy(&jobs->mutex);
+        return false;
+    }
+    if (jobs->workerCount < workerCount) {
+        LOG_WARN("Started only %u of %u job workers", jobs->workerCount, workerCount);
+    }
+
+    LOG_DEBUG("Job system started with %u workers", jobs->workerCount);
+    return true;
+}
+
+void job_init(Job* job, JobFunction function, void* arg)
+{
+    *job = (Job) { .function = function, .arg = arg };
+}
+
+bool job_depends_on(JobSystem* jobs, Job* job, Job* dependency)
+{
+    pthread_mutex_lock(&jobs->mutex);
+
+    if (dependency->done) {
+        pthread_mutex_unlock(&jobs->mutex);
+        return true;
+    }
+
+    if (dependency->dependentCount == JOB_MAX_DEPENDENTS) {
+        pthread_mutex_unlock(&jobs->mutex);
+        LOG_ERROR("Job already has %u dependents", JOB_MAX_DEPENDENTS);
+        return false;
+    }
+
+    dependency->dependents[dependency->dependentCount++] = job;
+    job->unfinishedDependencies++;
+
+    pthread_mutex_unlock(&jobs->mutex);
+    return true;
+}
+
+void job_submit(JobSystem* jobs, Job* job)
+{
+    pthread_mutex_lock(&jobs->mutex);
+    job->submitted = true;
+    if (job->unfinishedDependencies == 0) {
+        enqueue(jobs, job);
+    }
+    pthread_mutex_unlock(&jobs->mutex);
+}
+
+void job_wait(JobSystem* jobs, Job* job)
+{
+    pthread_mutex_lock(&jobs->mutex);
+    while (!job->done) {
+        pthread_cond_wait(&jobs->jobDone, &jobs->mutex);
+    }
+    pthread_mutex_unlock(&jobs->mutex);
+}
+
+void job_system_deinit(JobSystem* jobs)
+{
+    if (jobs->workerCount == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&jobs->mutex);
+    jobs->stopping = true;
+    pthread_cond_broadcast(&jobs->workAvailable);
+    pthread_mutex_unlock(&jobs->mutex);
+
+    for (uint32_t i = 0; i < jobs->workerCount; i++) {
+        pthread_join(jobs->workers[i], NULL);
+    }
+    jobs->workerCount = 0;
+
+    pthread_cond_destroy(&jobs->jobDone);
+    pthread_cond_destroy(&jobs->workAvailable);
+    pthread_mutex_destroy(&jobs->mutex);
+}
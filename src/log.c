@@ -0,0 +1,370 @@
+#include "log.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log_format.h"
+
+#ifdef YACW_LOG_BINARY_SINK
+#include "log_binary.h"
+#endif
+
+// Per-thread ring capacity in bytes, a power of two
+#define LOG_RING_SIZE (64 * 1024)
+// How long the writer thread sleeps when every ring is empty
+#define LOG_IDLE_SLEEP_NS (1000 * 1000)
+
+// Records are 8-byte aligned and followed by their packed arguments: 8-byte slots for numbers,
+// a length slot plus padded bytes for strings
+typedef struct LogRecord {
+    uint32_t size; // Including the arguments; 0 marks the unused end of the ring before a wrap
+    uint16_t level;
+    uint16_t truncated;
+    int32_t line;
+    uint32_t argsSize;
+    uint64_t timestampNs;
+    const char* file;
+    const char* fmt;
+} LogRecord;
+
+typedef struct LogRing {
+    alignas(64) _Atomic uint64_t head; // Bytes written by the owning thread
+    uint64_t cachedTail; // Owning thread's last view of tail, refreshed only when it looks full
+    alignas(64) _Atomic uint64_t tail; // Bytes consumed by the writer thread
+    _Atomic uint64_t dropped;
+    atomic_bool owned; // Released when the owning thread exits so another thread can reuse it
+    struct LogRing* next;
+    alignas(64) uint8_t data[LOG_RING_SIZE];
+} LogRing;
+
+static struct {
+    atomic_bool running;
+    LogFullPolicy policy;
+    pthread_t thread;
+    pthread_key_t ringKey;
+    bool ringKeyCreated;
+    _Atomic(LogRing*) rings; // Only ever pushed to and never freed
+    LogDateCache dateCache;
+    atomic_int consoleLevel; // Records below it are only mirrored to the binary sink
+    atomic_bool binaryOpen;
+} logState = { .dateCache = LOG_DATE_CACHE_INIT };
+
+static _Thread_local LogRing* threadRing;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static const char* relative_path(const char* file)
+{
+    size_t offset = (size_t)YACW_BASE_DIR_LEN;
+    return offset < strlen(file) ? file + offset : file;
+}
+
+static void write_record(
+    LogDateCache* cache, const LogRecord* record, const uint8_t* args, char* line)
+{
+    if (record->level < atomic_load_explicit(&logState.consoleLevel, memory_order_relaxed)) {
+        return;
+    }
+
+    size_t length = log_format_line(cache,
+        record->level,
+        relative_path(record->file),
+        record->line,
+        record->timestampNs,
+        record->fmt,
+        args,
+        record->argsSize,
+        record->truncated,
+        line);
+
+    fwrite(line, 1, length, record->level >= LOG_LEVEL_WARN ? stderr : stdout);
+}
+
+static void ring_release(void* ring)
+{
+    atomic_store_explicit(&((LogRing*)ring)->owned, false, memory_order_release);
+}
+
+// Claims a ring left behind by an exited thread, or registers a new one
+static LogRing* ring_acquire(void)
+{
+    LogRing* rings = atomic_load_explicit(&logState.rings, memory_order_acquire);
+    for (LogRing* ring = rings; ring != NULL; ring = ring->next) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong_explicit(
+                &ring->owned, &expected, true, memory_order_acquire, memory_order_relaxed)) {
+            pthread_setspecific(logState.ringKey, ring);
+            return ring;
+        }
+    }
+
+    LogRing* ring = aligned_alloc(alignof(LogRing), sizeof(LogRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->cachedTail = 0;
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->owned, true);
+
+    ring->next = atomic_load_explicit(&logState.rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &logState.rings, &ring->next, ring, memory_order_release, memory_order_relaxed)) {
+    }
+
+    pthread_setspecific(logState.ringKey, ring);
+    return ring;
+}
+
+static bool ring_push(LogRing* ring, const LogRecord* record, const uint8_t* args)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t position = (uint32_t)(head & (LOG_RING_SIZE - 1));
+    uint32_t contiguous = LOG_RING_SIZE - position;
+
+    // A record never straddles the end, the rest of the ring is skipped instead
+    uint32_t needed = record->size + (contiguous < record->size ? contiguous : 0);
+
+    while (LOG_RING_SIZE - (head - ring->cachedTail) < needed) {
+        ring->cachedTail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (LOG_RING_SIZE - (head - ring->cachedTail) >= needed) {
+            break;
+        }
+
+        if (logState.policy == LOG_FULL_DROP
+            || !atomic_load_explicit(&logState.running, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        sched_yield();
+    }
+
+    if (contiguous < record->size) {
+        uint32_t wrap = 0;
+        memcpy(ring->data + position, &wrap, sizeof(wrap));
+        position = 0;
+    }
+
+    memcpy(ring->data + position, record, sizeof(*record));
+    memcpy(ring->data + position + sizeof(*record), args, record->argsSize);
+
+    atomic_store_explicit(&ring->head, head + needed, memory_order_release);
+    return true;
+}
+
+// Returns the number of records written
+static uint32_t ring_drain(LogRing* ring, char* line)
+{
+    uint32_t count = 0;
+
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while (tail != head) {
+        uint32_t position = (uint32_t)(tail & (LOG_RING_SIZE - 1));
+
+        uint32_t size;
+        memcpy(&size, ring->data + position, sizeof(size));
+        if (size == 0) {
+            tail += LOG_RING_SIZE - position;
+            continue;
+        }
+
+        LogRecord record;
+        memcpy(&record, ring->data + position, sizeof(record));
+        const uint8_t* args = ring->data + position + sizeof(record);
+
+#ifdef YACW_LOG_BINARY_SINK
+        // The writer thread is the binary sink's only producer
+        if (atomic_load_explicit(&logState.binaryOpen, memory_order_acquire)) {
+            log_binary_write(record.level,
+                relative_path(record.file),
+                record.line,
+                record.fmt,
+                record.timestampNs,
+                args,
+                record.argsSize,
+                record.truncated);
+        }
+#endif
+
+        write_record(&logState.dateCache, &record, args, line);
+
+        tail += size;
+        count++;
+
+        // Hand space back in batches, publishing every record would bounce the cache line
+        if (count % 64 == 0) {
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        }
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+    uint64_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        LogRecord report = { .level = LOG_LEVEL_WARN,
+            .line = __LINE__,
+            .argsSize = sizeof(dropped),
+            .timestampNs = now_ns(),
+            .file = __FILE__,
+            .fmt = "Dropped %llu log messages, the ring was full" };
+        write_record(&logState.dateCache, &report, (const uint8_t*)&dropped, line);
+    }
+
+    return count;
+}
+
+static uint32_t drain_all(char* line)
+{
+    uint32_t count = 0;
+
+    LogRing* rings = atomic_load_explicit(&logState.rings, memory_order_acquire);
+    for (LogRing* ring = rings; ring != NULL; ring = ring->next) {
+        count += ring_drain(ring, line);
+    }
+
+    if (count > 0) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+
+    return count;
+}
+
+static void* writer_main(void* arg)
+{
+    (void)arg;
+
+    char* line = malloc(LOG_LINE_MAX);
+    if (line == NULL) {
+        return NULL;
+    }
+
+    while (atomic_load_explicit(&logState.running, memory_order_acquire)) {
+        if (drain_all(line) == 0) {
+            nanosleep(&(struct timespec) { .tv_nsec = LOG_IDLE_SLEEP_NS }, NULL);
+        }
+    }
+    drain_all(line);
+
+    free(line);
+    return NULL;
+}
+
+bool log_init(LogFullPolicy policy)
+{
+    if (atomic_load(&logState.running)) {
+        return true;
+    }
+
+    logState.policy = policy;
+
+    if (!logState.ringKeyCreated) {
+        if (pthread_key_create(&logState.ringKey, ring_release) != 0) {
+            return false;
+        }
+        logState.ringKeyCreated = true;
+        atexit(log_shutdown);
+    }
+
+    atomic_store(&logState.running, true);
+    if (pthread_create(&logState.thread, NULL, writer_main, NULL) != 0) {
+        atomic_store(&logState.running, false);
+        return false;
+    }
+
+    return true;
+}
+
+void log_shutdown(void)
+{
+    if (!atomic_exchange(&logState.running, false)) {
+        return;
+    }
+
+    // Rings stay registered, threads keep pointing at theirs in case logging is started again
+    pthread_join(logState.thread, NULL);
+
+#ifdef YACW_LOG_BINARY_SINK
+    if (atomic_exchange(&logState.binaryOpen, false)) {
+        log_binary_close();
+    }
+#endif
+    atomic_store(&logState.consoleLevel, LOG_LEVEL_TRACE);
+}
+
+bool log_open_binary(const char* path, LogLevel consoleLevel)
+{
+#ifdef YACW_LOG_BINARY_SINK
+    if (!atomic_load(&logState.running)) {
+        LOG_ERROR("The binary log sink needs the writer thread, call log_init first");
+        return false;
+    }
+    if (atomic_load(&logState.binaryOpen)) {
+        LOG_ERROR("A binary log is already open");
+        return false;
+    }
+
+    if (!log_binary_open(path)) {
+        return false;
+    }
+
+    atomic_store(&logState.consoleLevel, consoleLevel);
+    atomic_store_explicit(&logState.binaryOpen, true, memory_order_release);
+
+    LOG_INFO("Binary log opened at %s, console shows %s and above",
+        path,
+        log_level_name(consoleLevel));
+    return true;
+#else
+    (void)consoleLevel;
+    LOG_ERROR("Cannot log to %s, built without YACW_LOG_BINARY_SINK", path);
+    return false;
+#endif
+}
+
+void log_write(LogLevel level, const char* file, int line, const char* fmt, ...)
+{
+    uint8_t args[LOG_MAX_ARGS_SIZE];
+    LogRecord record = { .level = (uint16_t)level,
+        .line = line,
+        .timestampNs = now_ns(),
+        .file = file,
+        .fmt = fmt };
+
+    va_list ap;
+    va_start(ap, fmt);
+    record.truncated = !log_pack_args(args, &record.argsSize, fmt, ap);
+    va_end(ap);
+
+    record.size = log_align8(sizeof(record) + record.argsSize);
+
+    if (atomic_load_explicit(&logState.running, memory_order_relaxed)) {
+        if (threadRing == NULL) {
+            threadRing = ring_acquire();
+        }
+        if (threadRing != NULL) {
+            ring_push(threadRing, &record, args);
+            return;
+        }
+    }
+
+    // No writer thread, format right here with a date cache of our own
+    static _Thread_local LogDateCache dateCache = LOG_DATE_CACHE_INIT;
+    char buffer[LOG_LINE_MAX];
+    write_record(&dateCache, &record, args, buffer);
+}
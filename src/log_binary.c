@@ -0,0 +1,231 @@
+#include "log_binary.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "log_format.h"
+
+// The mapping grows by at least this much whenever it runs out
+#define LOG_BINARY_GROW_SIZE (16ull * 1024 * 1024)
+
+// Call sites are identified by their string pointers, which are unique per site
+typedef struct LogBinarySiteSlot {
+    const char* file;
+    const char* fmt;
+    int line;
+    uint32_t id;
+    bool used;
+} LogBinarySiteSlot;
+
+static struct {
+    int fd;
+    uint8_t* map;
+    size_t mapSize;
+    size_t used;
+    LogBinarySiteSlot* sites;
+    uint32_t siteCapacity; // A power of two
+    uint32_t siteCount;
+    bool failed; // Set after a write error, later records are dropped
+} binaryLog = { .fd = -1 };
+
+static uint32_t site_hash(const char* file, const char* fmt, int line)
+{
+    uint64_t key = ((uintptr_t)fmt ^ ((uintptr_t)file << 17)) + (uint64_t)line;
+    return (uint32_t)((key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static bool sites_grow(void)
+{
+    uint32_t capacity = binaryLog.siteCapacity * 2;
+    LogBinarySiteSlot* sites = calloc(capacity, sizeof(LogBinarySiteSlot));
+    if (sites == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < binaryLog.siteCapacity; i++) {
+        LogBinarySiteSlot* slot = &binaryLog.sites[i];
+        if (!slot->used) {
+            continue;
+        }
+
+        uint32_t index = site_hash(slot->file, slot->fmt, slot->line) & (capacity - 1);
+        while (sites[index].used) {
+            index = (index + 1) & (capacity - 1);
+        }
+        sites[index] = *slot;
+    }
+
+    free(binaryLog.sites);
+    binaryLog.sites = sites;
+    binaryLog.siteCapacity = capacity;
+    return true;
+}
+
+// Returns space for size more bytes, growing the file and the mapping as needed
+static uint8_t* reserve(size_t size)
+{
+    if (binaryLog.used + size > binaryLog.mapSize) {
+        size_t mapSize = binaryLog.mapSize
+            + (size > LOG_BINARY_GROW_SIZE ? size : LOG_BINARY_GROW_SIZE);
+
+        if (ftruncate(binaryLog.fd, (off_t)mapSize) != 0) {
+            return NULL;
+        }
+
+        munmap(binaryLog.map, binaryLog.mapSize);
+        binaryLog.map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, binaryLog.fd, 0);
+        if (binaryLog.map == MAP_FAILED) {
+            binaryLog.map = NULL;
+            binaryLog.mapSize = 0;
+            return NULL;
+        }
+        binaryLog.mapSize = mapSize;
+    }
+
+    uint8_t* entry = binaryLog.map + binaryLog.used;
+    binaryLog.used += size;
+    return entry;
+}
+
+// Looks the call site up, writing its description the first time it is seen
+static bool site_id(LogLevel level, const char* file, int line, const char* fmt, uint32_t* id)
+{
+    if (binaryLog.siteCount * 4 >= binaryLog.siteCapacity * 3 && !sites_grow()) {
+        return false;
+    }
+
+    uint32_t mask = binaryLog.siteCapacity - 1;
+    uint32_t index = site_hash(file, fmt, line) & mask;
+    for (;; index = (index + 1) & mask) {
+        LogBinarySiteSlot* slot = &binaryLog.sites[index];
+        if (!slot->used) {
+            break;
+        }
+        if (slot->fmt == fmt && slot->file == file && slot->line == line) {
+            *id = slot->id;
+            return true;
+        }
+    }
+
+    uint32_t fileLength = (uint32_t)strlen(file);
+    uint32_t fmtLength = (uint32_t)strlen(fmt);
+    uint32_t size = log_align8(sizeof(LogBinarySite) + fileLength + fmtLength);
+
+    uint8_t* entry = reserve(size);
+    if (entry == NULL) {
+        return false;
+    }
+
+    LogBinarySite site = { .type = LOG_BINARY_SITE,
+        .size = size,
+        .id = binaryLog.siteCount,
+        .level = (uint16_t)level,
+        .line = line,
+        .fileLength = fileLength,
+        .fmtLength = fmtLength };
+    memcpy(entry, &site, sizeof(site));
+    memcpy(entry + sizeof(site), file, fileLength);
+    memcpy(entry + sizeof(site) + fileLength, fmt, fmtLength);
+
+    binaryLog.sites[index] = (LogBinarySiteSlot) {
+        .file = file, .fmt = fmt, .line = line, .id = site.id, .used = true
+    };
+    *id = binaryLog.siteCount++;
+    return true;
+}
+
+bool log_binary_open(const char* path)
+{
+    binaryLog.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (binaryLog.fd < 0) {
+        LOG_ERROR("Could not open binary log %s", path);
+        return false;
+    }
+
+    binaryLog.siteCapacity = 256;
+    binaryLog.sites = calloc(binaryLog.siteCapacity, sizeof(LogBinarySiteSlot));
+    if (binaryLog.sites == NULL) {
+        LOG_ERROR("Failed to allocate binary log call sites");
+        log_binary_close();
+        return false;
+    }
+
+    uint8_t* entry = reserve(sizeof(LogBinaryHeader));
+    if (entry == NULL) {
+        LOG_ERROR("Failed to map binary log %s", path);
+        log_binary_close();
+        return false;
+    }
+
+    LogBinaryHeader header = { .version = LOG_BINARY_VERSION };
+    memcpy(header.magic, LOG_BINARY_MAGIC, sizeof(header.magic));
+    memcpy(entry, &header, sizeof(header));
+
+    binaryLog.failed = false;
+    return true;
+}
+
+void log_binary_write(LogLevel level,
+    const char* file,
+    int line,
+    const char* fmt,
+    uint64_t timestampNs,
+    const uint8_t* args,
+    uint32_t argsSize,
+    bool truncated)
+{
+    if (binaryLog.failed) {
+        return;
+    }
+
+    uint32_t site;
+    uint32_t size = log_align8(sizeof(LogBinaryRecord) + argsSize);
+    uint8_t* entry = NULL;
+    if (site_id(level, file, line, fmt, &site)) {
+        entry = reserve(size);
+    }
+
+    // Logging from here would feed back into the writer thread, report straight to stderr
+    if (entry == NULL) {
+        fprintf(stderr, "Binary log write failed, further records are dropped\n");
+        binaryLog.failed = true;
+        return;
+    }
+
+    LogBinaryRecord record = { .type = LOG_BINARY_RECORD,
+        .size = size,
+        .site = site,
+        .truncated = truncated,
+        .timestampNs = timestampNs,
+        .argsSize = argsSize };
+    memcpy(entry, &record, sizeof(record));
+    memcpy(entry + sizeof(record), args, argsSize);
+}
+
+void log_binary_close(void)
+{
+    if (binaryLog.map != NULL) {
+        munmap(binaryLog.map, binaryLog.mapSize);
+        binaryLog.map = NULL;
+        binaryLog.mapSize = 0;
+    }
+
+    if (binaryLog.fd >= 0) {
+        if (ftruncate(binaryLog.fd, (off_t)binaryLog.used) != 0) {
+            fprintf(stderr, "Failed to trim the binary log\n");
+        }
+        close(binaryLog.fd);
+        binaryLog.fd = -1;
+    }
+    binaryLog.used = 0;
+
+    free(binaryLog.sites);
+    binaryLog.sites = NULL;
+    binaryLog.siteCapacity = 0;
+    binaryLog.siteCount = 0;
+}
@@ -0,0 +1,458 @@
+#include "log_format.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum LogArgType {
+    LOG_ARG_NONE,
+    LOG_ARG_INT, // int and everything promoted to it
+    LOG_ARG_WIDE_INT, // l, ll, z, j and t, stored and formatted as long long
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LONG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+} LogArgType;
+
+// One printf conversion, split up so it can be rebuilt around a single argument
+typedef struct LogSpec {
+    const char* flags;
+    uint32_t flagCount;
+    const char* length;
+    uint32_t lengthCount;
+    bool widthStar;
+    bool precisionStar;
+    int width; // -1 if absent
+    int precision; // -1 if absent
+    char conversion;
+    LogArgType type;
+} LogSpec;
+
+static int parse_int(const char** p)
+{
+    int value = 0;
+    while (**p >= '0' && **p <= '9') {
+        value = value * 10 + (**p - '0');
+        (*p)++;
+    }
+    return value;
+}
+
+// p points just past the '%', returns the character after the conversion
+static const char* parse_spec(const char* p, LogSpec* spec)
+{
+    spec->flags = p;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+        p++;
+    }
+    spec->flagCount = (uint32_t)(p - spec->flags);
+
+    spec->widthStar = false;
+    spec->width = -1;
+    if (*p == '*') {
+        spec->widthStar = true;
+        p++;
+    } else if (*p >= '0' && *p <= '9') {
+        spec->width = parse_int(&p);
+    }
+
+    spec->precisionStar = false;
+    spec->precision = -1;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->precisionStar = true;
+            p++;
+        } else {
+            spec->precision = parse_int(&p);
+        }
+    }
+
+    bool wide = false;
+    bool longDouble = false;
+    spec->length = p;
+    for (;; p++) {
+        if (*p == 'l' || *p == 'q' || *p == 'j' || *p == 'z' || *p == 't') {
+            wide = true;
+        } else if (*p == 'L') {
+            longDouble = true;
+        } else if (*p != 'h') {
+            break;
+        }
+    }
+    spec->lengthCount = (uint32_t)(p - spec->length);
+
+    spec->conversion = *p;
+    switch (*p) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+        spec->type = wide ? LOG_ARG_WIDE_INT : LOG_ARG_INT;
+        break;
+    case 'c':
+        spec->type = LOG_ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        spec->type = longDouble ? LOG_ARG_LONG_DOUBLE : LOG_ARG_DOUBLE;
+        break;
+    case 's':
+        // Wide strings are not copied, only their address is kept
+        spec->type = wide ? LOG_ARG_POINTER : LOG_ARG_STRING;
+        break;
+    case 'p':
+    case 'n':
+        spec->type = LOG_ARG_POINTER;
+        break;
+    case '\0':
+        spec->type = LOG_ARG_NONE;
+        return p;
+    default:
+        spec->type = LOG_ARG_NONE;
+        break;
+    }
+
+    return p + 1;
+}
+
+static bool pack_slot(uint8_t* args, uint32_t* size, const void* value, uint32_t valueSize)
+{
+    uint32_t slotSize = log_align8(valueSize);
+    if (*size + slotSize > LOG_MAX_ARGS_SIZE) {
+        return false;
+    }
+
+    memcpy(args + *size, value, valueSize);
+    *size += slotSize;
+    return true;
+}
+
+bool log_pack_args(uint8_t* args, uint32_t* size, const char* fmt, va_list ap)
+{
+    *size = 0;
+
+    for (const char* p = strchr(fmt, '%'); p != NULL; p = strchr(p, '%')) {
+        LogSpec spec;
+        p = parse_spec(p + 1, &spec);
+
+        int64_t precision = spec.precision;
+        if (spec.widthStar) {
+            int64_t width = va_arg(ap, int);
+            if (!pack_slot(args, size, &width, sizeof(width))) {
+                return false;
+            }
+        }
+        if (spec.precisionStar) {
+            precision = va_arg(ap, int);
+            if (!pack_slot(args, size, &precision, sizeof(precision))) {
+                return false;
+            }
+        }
+
+        bool packed = true;
+        switch (spec.type) {
+        case LOG_ARG_NONE:
+            break;
+        case LOG_ARG_INT: {
+            int64_t value = va_arg(ap, int);
+            packed = pack_slot(args, size, &value, sizeof(value));
+        } break;
+        case LOG_ARG_WIDE_INT: {
+            // Every wide integer type is 64 bits on the targets this builds for
+            int64_t value = va_arg(ap, long long);
+            packed = pack_slot(args, size, &value, sizeof(value));
+        } break;
+        case LOG_ARG_DOUBLE: {
+            double value = va_arg(ap, double);
+            packed = pack_slot(args, size, &value, sizeof(value));
+        } break;
+        case LOG_ARG_LONG_DOUBLE: {
+            long double value = va_arg(ap, long double);
+            packed = pack_slot(args, size, &value, sizeof(value));
+        } break;
+        case LOG_ARG_POINTER: {
+            void* value = va_arg(ap, void*);
+            packed = pack_slot(args, size, &value, sizeof(value));
+        } break;
+        case LOG_ARG_STRING: {
+            const char* value = va_arg(ap, const char*);
+            if (value == NULL) {
+                value = "(null)";
+            }
+
+            // A precision may bound a string that is not terminated
+            uint64_t length = precision >= 0 ? strnlen(value, (size_t)precision) : strlen(value);
+            if (*size + 8 > LOG_MAX_ARGS_SIZE) {
+                return false;
+            }
+
+            // Keep what fits of an overlong string, the record is marked truncated
+            uint32_t available = LOG_MAX_ARGS_SIZE - *size - 8;
+            if (length > available) {
+                length = available;
+                packed = false;
+            }
+
+            memcpy(args + *size, &length, sizeof(length));
+            memcpy(args + *size + 8, value, length);
+            *size += 8 + log_align8((uint32_t)length);
+        } break;
+        }
+
+        if (!packed) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool unpack_slot(
+    const uint8_t* args, uint32_t size, uint32_t* offset, void* value, uint32_t valueSize)
+{
+    if (*offset + log_align8(valueSize) > size) {
+        return false;
+    }
+
+    memcpy(value, args + *offset, valueSize);
+    *offset += log_align8(valueSize);
+    return true;
+}
+
+static size_t append(char* out, size_t capacity, size_t length, const char* data, size_t count)
+{
+    if (length + count >= capacity) {
+        count = length + 1 < capacity ? capacity - length - 1 : 0;
+    }
+
+    memcpy(out + length, data, count);
+    return length + count;
+}
+
+// Advances past what snprintf wrote, clamped to what actually fit
+static size_t advance(size_t capacity, size_t length, int written)
+{
+    if (written < 0) {
+        return length;
+    }
+
+    return length + (size_t)written >= capacity ? capacity - 1 : length + (size_t)written;
+}
+
+// Expands fmt against the packed arguments, stopping at the first argument that did not fit
+static size_t format_args(char* out,
+    size_t capacity,
+    size_t length,
+    const char* fmt,
+    const uint8_t* args,
+    uint32_t argsSize,
+    bool truncated)
+{
+    uint32_t offset = 0;
+
+    for (const char* p = fmt; *p != '\0';) {
+        const char* literal = p;
+        while (*p != '\0' && *p != '%') {
+            p++;
+        }
+        length = append(out, capacity, length, literal, (size_t)(p - literal));
+        if (*p == '\0') {
+            break;
+        }
+
+        LogSpec spec;
+        p = parse_spec(p + 1, &spec);
+
+        if (spec.conversion == '%') {
+            length = append(out, capacity, length, "%", 1);
+            continue;
+        }
+
+        int64_t width = spec.width;
+        int64_t precision = spec.precision;
+        if ((spec.widthStar && !unpack_slot(args, argsSize, &offset, &width, sizeof(width)))
+            || (spec.precisionStar
+                && !unpack_slot(args, argsSize, &offset, &precision, sizeof(precision)))) {
+            truncated = true;
+            break;
+        }
+
+        union {
+            int64_t integer;
+            double real;
+            long double longReal;
+            void* pointer;
+            uint64_t stringLength;
+        } value;
+
+        bool unpacked = true;
+        switch (spec.type) {
+        case LOG_ARG_NONE:
+            break;
+        case LOG_ARG_INT:
+        case LOG_ARG_WIDE_INT:
+            unpacked = unpack_slot(args, argsSize, &offset, &value.integer, sizeof(int64_t));
+            break;
+        case LOG_ARG_DOUBLE:
+            unpacked = unpack_slot(args, argsSize, &offset, &value.real, sizeof(double));
+            break;
+        case LOG_ARG_LONG_DOUBLE:
+            unpacked = unpack_slot(args, argsSize, &offset, &value.longReal, sizeof(long double));
+            break;
+        case LOG_ARG_POINTER:
+            unpacked = unpack_slot(args, argsSize, &offset, &value.pointer, sizeof(void*));
+            break;
+        case LOG_ARG_STRING:
+            unpacked
+                = unpack_slot(args, argsSize, &offset, &value.stringLength, sizeof(uint64_t))
+                && offset + value.stringLength <= argsSize;
+            // The copy is not terminated, its length becomes the precision
+            precision = (int64_t)value.stringLength;
+            break;
+        }
+        if (!unpacked) {
+            truncated = true;
+            break;
+        }
+
+        // Rebuild the conversion with the star arguments resolved, so it takes exactly one value
+        char conversion[64];
+        size_t specLength = 0;
+        conversion[specLength++] = '%';
+        memcpy(conversion + specLength, spec.flags, spec.flagCount);
+        specLength += spec.flagCount;
+        if (width >= 0 || spec.widthStar) {
+            specLength += (size_t)snprintf(
+                conversion + specLength, sizeof(conversion) - specLength, "%d", (int)width);
+        }
+        if (precision >= 0) {
+            specLength += (size_t)snprintf(
+                conversion + specLength, sizeof(conversion) - specLength, ".%d", (int)precision);
+        }
+        if (spec.type == LOG_ARG_WIDE_INT) {
+            memcpy(conversion + specLength, "ll", 2);
+            specLength += 2;
+        } else if (spec.type == LOG_ARG_INT || spec.type == LOG_ARG_DOUBLE
+            || spec.type == LOG_ARG_LONG_DOUBLE) {
+            memcpy(conversion + specLength, spec.length, spec.lengthCount);
+            specLength += spec.lengthCount;
+        }
+        conversion[specLength++] = spec.type == LOG_ARG_POINTER ? 'p' : spec.conversion;
+        conversion[specLength] = '\0';
+
+        char* dst = out + length;
+        size_t remaining = capacity - length;
+        int written = 0;
+
+        switch (spec.type) {
+        case LOG_ARG_NONE:
+            break;
+        case LOG_ARG_INT:
+            written = snprintf(dst, remaining, conversion, (int)value.integer);
+            break;
+        case LOG_ARG_WIDE_INT:
+            written = snprintf(dst, remaining, conversion, (long long)value.integer);
+            break;
+        case LOG_ARG_DOUBLE:
+            written = snprintf(dst, remaining, conversion, value.real);
+            break;
+        case LOG_ARG_LONG_DOUBLE:
+            written = snprintf(dst, remaining, conversion, value.longReal);
+            break;
+        case LOG_ARG_POINTER:
+            if (spec.conversion != 'n') {
+                written = snprintf(dst, remaining, conversion, value.pointer);
+            }
+            break;
+        case LOG_ARG_STRING:
+            written = snprintf(dst, remaining, conversion, (const char*)(args + offset));
+            offset += log_align8((uint32_t)value.stringLength);
+            break;
+        }
+
+        length = advance(capacity, length, written);
+    }
+
+    if (truncated) {
+        const char marker[] = " [truncated]";
+        length = append(out, capacity, length, marker, sizeof(marker) - 1);
+    }
+
+    return length;
+}
+
+static const char* date_prefix(LogDateCache* cache, uint64_t timestampNs)
+{
+    int64_t second = (int64_t)(timestampNs / 1000000000ull);
+    if (second != cache->second) {
+        time_t seconds = (time_t)second;
+        struct tm tmInfo;
+        localtime_r(&seconds, &tmInfo);
+        strftime(cache->prefix, sizeof(cache->prefix), "%Y-%m-%d %H:%M:%S", &tmInfo);
+        cache->second = second;
+    }
+
+    return cache->prefix;
+}
+
+const char* log_level_name(LogLevel level)
+{
+    switch (level) {
+    case LOG_LEVEL_TRACE:
+        return "TRACE";
+    case LOG_LEVEL_DEBUG:
+        return "DEBUG";
+    case LOG_LEVEL_INFO:
+        return "INFO";
+    case LOG_LEVEL_WARN:
+        return "WARN";
+    case LOG_LEVEL_ERROR:
+        return "ERROR";
+    }
+
+    return "?";
+}
+
+size_t log_format_line(LogDateCache* cache,
+    LogLevel level,
+    const char* file,
+    int lineNumber,
+    uint64_t timestampNs,
+    const char* fmt,
+    const uint8_t* args,
+    uint32_t argsSize,
+    bool truncated,
+    char* line)
+{
+    char timestamp[48];
+    snprintf(timestamp,
+        sizeof(timestamp),
+        "%s.%03u",
+        date_prefix(cache, timestampNs),
+        (unsigned)(timestampNs / 1000000ull % 1000));
+
+    // One byte is kept back for the newline
+    size_t length = advance(LOG_LINE_MAX - 1,
+        0,
+        snprintf(line,
+            LOG_LINE_MAX - 1,
+            "%23s %5s | %15s:%4d: ",
+            timestamp,
+            log_level_name(level),
+            file,
+            lineNumber));
+
+    length = format_args(line, LOG_LINE_MAX - 1, length, fmt, args, argsSize, truncated);
+    line[length++] = '\n';
+
+    return length;
+}
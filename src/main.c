@@ -1,114 +1,800 @@
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define NK_IMPLEMENTATION
 #include "nuklear.h"
 
 #include "app.h"
+#include "asset.h"
 #include "log.h"
+#include "timer.h"
+
+// Swapchain recreation is deferred until the framebuffer size has been stable for this long
+#define YACW_RESIZE_DEBOUNCE_NS (100 * 1000000ull)
+// Rendering on demand still redraws this often, so the stats do not go stale
+#define YACW_IDLE_REDRAW_NS (1000 * 1000000ull)
+// A headless surface has a fixed extent, failing to acquire after recreating it is not retried
+// forever
+#define YACW_HEADLESS_ACQUIRE_ATTEMPTS 3
 
 void glfw_error_callback(int error, const char* description)
 {
     LOG_ERROR("[%d] %s", error, description);
 }
 
-int main(void)
+// The callbacks run on the event thread and only queue what happened for the render thread
+static void push_event(GLFWwindow* window, InputEvent event)
+{
+    AppCtx* appCtx = glfwGetWindowUserPointer(window);
+    event.timeNs = timer_now_ns();
+    input_queue_push(&appCtx->input, &event);
+}
+
+void glfw_cursor_pos_callback(GLFWwindow* window, double x, double y)
+{
+    push_event(window, (InputEvent) { .type = INPUT_EVENT_CURSOR_POS, .cursor = { x, y } });
+}
+
+void glfw_mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    (void)mods;
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    push_event(window,
+        (InputEvent) { .type = INPUT_EVENT_MOUSE_BUTTON,
+            .mouseButton = { button, action == GLFW_PRESS, x, y } });
+}
+
+void glfw_scroll_callback(GLFWwindow* window, double xOffset, double yOffset)
+{
+    push_event(
+        window, (InputEvent) { .type = INPUT_EVENT_SCROLL, .scroll = { xOffset, yOffset } });
+}
+
+void glfw_char_callback(GLFWwindow* window, unsigned int codepoint)
+{
+    push_event(window, (InputEvent) { .type = INPUT_EVENT_CHAR, .codepoint = codepoint });
+}
+
+void glfw_window_refresh_callback(GLFWwindow* window)
+{
+    push_event(window, (InputEvent) { .type = INPUT_EVENT_REFRESH });
+}
+
+// Settings changed from the UI, applied by the caller before the next frame
+typedef struct UiSettings {
+    PresentPolicy presentPolicy;
+    bool onDemand; // Only render when something changed
+} UiSettings;
+
+void draw_ui(struct nk_context* ctx,
+    double avgFrameMs,
+    double p99FrameMs,
+    double gpuFrameMs,
+    UiSettings* settings)
+{
+    const char* policyNames[PRESENT_POLICY_COUNT];
+    for (int i = 0; i < PRESENT_POLICY_COUNT; i++) {
+        policyNames[i] = present_policy_name((PresentPolicy)i);
+    }
+
+    if (nk_begin(ctx,
+            "Stats",
+            nk_rect(10, 10, 220, 180),
+            NK_WINDOW_BORDER | NK_WINDOW_MOVABLE | NK_WINDOW_TITLE | NK_WINDOW_MINIMIZABLE)) {
+        nk_layout_row_dynamic(ctx, 18, 1);
+        nk_labelf(ctx, NK_TEXT_LEFT, "Frame time: %.3f ms", avgFrameMs);
+        nk_labelf(ctx, NK_TEXT_LEFT, "p99 frame time: %.3f ms", p99FrameMs);
+        nk_labelf(ctx, NK_TEXT_LEFT, "GPU time: %.3f ms", gpuFrameMs);
+        nk_labelf(ctx, NK_TEXT_LEFT, "Frames in flight: %u", YACW_FRAMES_IN_FLIGHT);
+        settings->presentPolicy = (PresentPolicy)nk_combo(ctx,
+            policyNames,
+            PRESENT_POLICY_COUNT,
+            (int)settings->presentPolicy,
+            18,
+            nk_vec2(200, 100));
+        settings->onDemand = nk_check_label(ctx, "Render on demand", settings->onDemand);
+    }
+    nk_end(ctx);
+}
+
+typedef struct Options {
+    bool headless;
+    uint32_t frameCount; // Frames rendered before exiting when headless
+    VkExtent2D extent;
+    const char* dumpPath; // Final headless frame is written here as PPM, if set
+    const char* gpu; // Physical device selector, overrides YACW_GPU
+    PresentPolicy presentPolicy;
+    bool onDemand;
+    bool renderPass;
+} Options;
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [--headless] [--frames N] [--size WxH] [--dump file.ppm] [--gpu GPU]\n"
+        "          [--present POLICY] [--on-demand] [--render-pass]\n"
+        "  --headless     render without a window, into offscreen images\n"
+        "  --frames N     number of frames to render when headless (default 100)\n"
+        "  --size WxH     headless image size (default 640x480)\n"
+        "  --dump FILE    write the last headless frame to FILE as binary PPM\n"
+        "  --gpu GPU      use the GPU with this index, UUID or name (default from YACW_GPU,\n"
+        "                 otherwise the best one)\n"
+        "  --present POLICY  vsync, low-latency, uncapped or power-save (default low-latency),\n"
+        "                    can be changed from the UI\n"
+        "  --on-demand    only render when input, a resize or a reload changed something,\n"
+        "                 and once a second for the stats\n"
+        "  --render-pass  use render passes even where dynamic rendering is supported\n",
+        program);
+}
+
+static bool parse_options(int argc, char** argv, Options* options)
+{
+    *options = (Options) { .headless = false,
+        .frameCount = 100,
+        .extent = { 640, 480 },
+        .presentPolicy = PRESENT_POLICY_LOW_LATENCY };
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--headless") == 0) {
+            options->headless = true;
+        } else if (strcmp(arg, "--on-demand") == 0) {
+            options->onDemand = true;
+        } else if (strcmp(arg, "--render-pass") == 0) {
+            options->renderPass = true;
+        } else if (strcmp(arg, "--frames") == 0 && value != NULL) {
+            char* end;
+            unsigned long frames = strtoul(value, &end, 10);
+            if (*end != '\0' || frames == 0 || frames > UINT32_MAX) {
+                LOG_ERROR("Invalid frame count: %s", value);
+                return false;
+            }
+            options->frameCount = (uint32_t)frames;
+            i++;
+        } else if (strcmp(arg, "--size") == 0 && value != NULL) {
+            unsigned int width, height;
+            if (sscanf(value, "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+                LOG_ERROR("Invalid size: %s", value);
+                return false;
+            }
+            options->extent = (VkExtent2D) { width, height };
+            i++;
+        } else if (strcmp(arg, "--dump") == 0 && value != NULL) {
+            options->dumpPath = value;
+            i++;
+        } else if (strcmp(arg, "--gpu") == 0 && value != NULL) {
+            options->gpu = value;
+            i++;
+        } else if (strcmp(arg, "--present") == 0 && value != NULL) {
+            if (!present_policy_parse(value, &options->presentPolicy)) {
+                LOG_ERROR("Unknown present policy: %s", value);
+                return false;
+            }
+            i++;
+        } else {
+            return false;
+        }
+    }
+
+    if (options->dumpPath != NULL && !options->headless) {
+        LOG_ERROR("--dump is only supported together with --headless");
+        return false;
+    }
+
+    return true;
+}
+
+// Out of date is handled as in the windowed loop, by recreating the swapchain and acquiring again
+static VkResult acquire_headless_image(AppCtx* appCtx, FrameCtx* frame, uint32_t* imageIndex)
 {
     VkResult result;
-    AppCtx appCtx = { 0 };
 
-    // Glfw setup
-    {
-        glfwSetErrorCallback(glfw_error_callback);
+    for (uint32_t attempt = 0; attempt < YACW_HEADLESS_ACQUIRE_ATTEMPTS; attempt++) {
+        result = vkAcquireNextImageKHR(appCtx->device,
+            appCtx->swapchain,
+            UINT64_MAX,
+            frame->imageAvailableSemaphore,
+            VK_NULL_HANDLE,
+            imageIndex);
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+            return VK_SUCCESS;
+        }
+        if (result != VK_ERROR_OUT_OF_DATE_KHR) {
+            LOG_ERROR("Failed to acquire headless swapchain image: %d", result);
+            return result;
+        }
 
-        if (glfwInit() != GLFW_TRUE) {
-            LOG_ERROR("Failed to initialize GLFW");
-            goto cleanup_glfw;
+        LOG_INFO_LIMITED("Headless swapchain out of date, recreating...");
+        result = appCtx_recreate_swapchain(appCtx);
+        if (result != VK_SUCCESS) {
+            return result;
         }
-        LOG_INFO("GLFW initialized successfully");
+    }
 
-        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    LOG_ERROR("Headless swapchain still out of date after recreating it");
+    return VK_ERROR_OUT_OF_DATE_KHR;
+}
 
-        appCtx.window = glfwCreateWindow(640, 480, "Hello Vulkan", NULL, NULL);
-        if (appCtx.window == NULL) {
-            LOG_ERROR("Failed to create GLFW window");
-            goto cleanup_glfw;
+// Renders a fixed number of frames without any window, then optionally dumps the last one
+static VkResult run_headless(AppCtx* appCtx, VkQueue graphicsQueue, const Options* options)
+{
+    VkResult result = VK_SUCCESS;
+
+    Readback readback = { 0 };
+    if (options->dumpPath != NULL) {
+        if (!(appCtx->swapchainMetadata.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+            LOG_ERROR("Swapchain images cannot be copied from, cannot dump");
+            return VK_RESULT_MAX_ENUM;
         }
-        LOG_INFO("GLFW window created successfully");
 
-        glfwSetWindowUserPointer(appCtx.window, &appCtx);
+        result = readback_init(&readback,
+            &appCtx->gpuMemory,
+            appCtx->swapchainMetadata.swapchainExtent,
+            appCtx->swapchainMetadata.surfaceFormat.format);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
     }
 
-    result = appCtx_init(&appCtx);
-    if (result != VK_SUCCESS) {
-        goto cleanup_glfw;
+    FrameTiming* timing = &appCtx->timing;
+    uint64_t startNs = timer_now_ns();
+    uint32_t framesRendered = 0; // Short of frameCount if the loop failed
+
+    for (uint32_t i = 0; i < options->frameCount; i++) {
+        FrameCtx* frame = &appCtx->frames[appCtx->currentFrame];
+        bool lastFrame = i + 1 == options->frameCount;
+
+        frame_timing_begin_frame(timing);
+
+        result = frame_timeline_wait(&appCtx->timeline, frame->timelineValue);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        frame_timing_collect(timing, appCtx->currentFrame);
+        appCtx_begin_frame(appCtx);
+        frame_timing_mark(timing, FRAME_TIMING_WAIT);
+
+        // A headless surface still goes through acquire and present, plain images are used in
+        // lockstep with the frame slots
+        uint32_t imageIndex = appCtx->currentFrame;
+        if (appCtx->swapchain != VK_NULL_HANDLE) {
+            result = acquire_headless_image(appCtx, frame, &imageIndex);
+            if (result != VK_SUCCESS) {
+                break;
+            }
+        }
+        frame_timing_mark(timing, FRAME_TIMING_ACQUIRE);
+
+        result = frame_timeline_wait(&appCtx->timeline, appCtx->imageTimelineValues[imageIndex]);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        frame_timing_mark(timing, FRAME_TIMING_WAIT);
+
+        // Settings are ignored, every headless frame is rendered and the surface keeps its mode
+        UiSettings settings = { .presentPolicy = appCtx->presentPolicy };
+
+        // A recreated swapchain may have been clamped to another extent than the readback's
+        VkExtent2D extent = appCtx->swapchainMetadata.swapchainExtent;
+        if (lastFrame && options->dumpPath != NULL
+            && (extent.width != readback.extent.width
+                || extent.height != readback.extent.height)) {
+            LOG_ERROR("Headless swapchain extent changed to %ux%u, cannot dump",
+                extent.width,
+                extent.height);
+            result = VK_RESULT_MAX_ENUM;
+            break;
+        }
+        draw_ui(&appCtx->ui.ctx,
+            timer_ns_to_ms(timer_now_ns() - startNs) / (i + 1),
+            0.0,
+            0.0,
+            &settings);
+
+        result = appCtx_record_frame(appCtx,
+            frame->commandBuffer,
+            imageIndex,
+            lastFrame && options->dumpPath != NULL ? &readback : NULL);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        frame_timing_mark(timing, FRAME_TIMING_RECORD);
+
+        result = appCtx_submit_frame(appCtx, graphicsQueue, imageIndex);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        frame_timing_mark(timing, FRAME_TIMING_SUBMIT);
+
+        appCtx->currentFrame = (appCtx->currentFrame + 1) % YACW_FRAMES_IN_FLIGHT;
+
+        if (appCtx->swapchain != VK_NULL_HANDLE) {
+            VkPresentInfoKHR presentInfo = { .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &appCtx->renderFinishedSemaphore[imageIndex],
+                .swapchainCount = 1,
+                .pSwapchains = &appCtx->swapchain,
+                .pImageIndices = &imageIndex };
+
+            // Out of date is picked up by the next acquire
+            result = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+            if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR
+                && result != VK_ERROR_OUT_OF_DATE_KHR) {
+                LOG_ERROR("Failed to present headless swapchain image: %d", result);
+                break;
+            }
+        }
+        frame_timing_mark(timing, FRAME_TIMING_PRESENT);
+        frame_timing_end_frame(timing);
+        framesRendered++;
+        result = VK_SUCCESS;
     }
 
-    VkQueue graphicsQueue = VK_NULL_HANDLE;
-    vkGetDeviceQueue(appCtx.device, appCtx.queueFamilyIndex, 0, &graphicsQueue);
-    LOG_INFO("Graphics queue obtained");
+    vkDeviceWaitIdle(appCtx->device);
 
-    // Main render loop
-    while (!glfwWindowShouldClose(appCtx.window)) {
-        glfwPollEvents();
+    // Pick up the GPU times of the frames still in flight when the loop ended
+    for (uint32_t slot = 0; slot < YACW_FRAMES_IN_FLIGHT; slot++) {
+        frame_timing_collect(timing, slot);
+    }
+    frame_timing_log_summary(timing);
+
+    uint64_t elapsedNs = timer_now_ns() - startNs;
+    if (framesRendered > 0) {
+        LOG_INFO("Rendered %u of %u headless frames in %.3f ms: avg %.3f ms, %.1f fps",
+            framesRendered,
+            options->frameCount,
+            timer_ns_to_ms(elapsedNs),
+            timer_ns_to_ms(elapsedNs) / framesRendered,
+            framesRendered * 1e9 / (double)elapsedNs);
+    }
+
+    if (result == VK_SUCCESS && options->dumpPath != NULL
+        && !readback_write_ppm(&readback, &appCtx->gpuMemory, options->dumpPath)) {
+        result = VK_RESULT_MAX_ENUM;
+    }
+
+    readback_deinit(&readback, &appCtx->gpuMemory);
+
+    return result;
+}
+
+void glfw_framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    push_event(window,
+        (InputEvent) { .type = INPUT_EVENT_FRAMEBUFFER_SIZE,
+            .framebufferSize = { width, height } });
+}
+
+// State of the render thread, which owns the AppCtx while the window is open
+typedef struct RenderLoop {
+    AppCtx* appCtx;
+    VkQueue graphicsQueue;
+    bool onDemand;
+    atomic_bool quit; // Set by the event thread once the window should close
+    VkResult result;
+    uint64_t oldestInputNs; // Earliest input applied since the last present, 0 without any
+} RenderLoop;
+
+static bool nk_button_from_glfw(int button, enum nk_buttons* nkButton)
+{
+    switch (button) {
+    case GLFW_MOUSE_BUTTON_LEFT:
+        *nkButton = NK_BUTTON_LEFT;
+        return true;
+    case GLFW_MOUSE_BUTTON_RIGHT:
+        *nkButton = NK_BUTTON_RIGHT;
+        return true;
+    case GLFW_MOUSE_BUTTON_MIDDLE:
+        *nkButton = NK_BUTTON_MIDDLE;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Applies the events queued by the event thread to Nuklear and the swapchain state
+static void apply_input(RenderLoop* loop)
+{
+    AppCtx* appCtx = loop->appCtx;
+    struct nk_context* ctx = &appCtx->ui.ctx;
+
+    uint64_t dropped = input_queue_take_dropped(&appCtx->input);
+    if (dropped > 0) {
+        LOG_WARN_LIMITED("Input queue full, dropped %llu events", (unsigned long long)dropped);
+    }
 
-        vkWaitForFences(appCtx.device, 1, &appCtx.inFlightFence, VK_TRUE, UINT64_MAX);
-        vkResetFences(appCtx.device, 1, &appCtx.inFlightFence);
+    InputEvent event;
+    while (input_queue_pop(&appCtx->input, &event)) {
+        enum nk_buttons nkButton;
+
+        switch (event.type) {
+        case INPUT_EVENT_CURSOR_POS:
+            nk_input_motion(ctx, (int)event.cursor.x, (int)event.cursor.y);
+            break;
+        case INPUT_EVENT_MOUSE_BUTTON:
+            if (!nk_button_from_glfw(event.mouseButton.button, &nkButton)) {
+                continue;
+            }
+            nk_input_button(ctx,
+                nkButton,
+                (int)event.mouseButton.x,
+                (int)event.mouseButton.y,
+                event.mouseButton.pressed);
+            break;
+        case INPUT_EVENT_SCROLL:
+            nk_input_scroll(ctx, nk_vec2((float)event.scroll.x, (float)event.scroll.y));
+            break;
+        case INPUT_EVENT_CHAR:
+            nk_input_unicode(ctx, event.codepoint);
+            break;
+        case INPUT_EVENT_FRAMEBUFFER_SIZE:
+            // Debounced, the swapchain is recreated once the size has settled
+            appCtx->framebufferExtent = (VkExtent2D) { (uint32_t)event.framebufferSize.width,
+                (uint32_t)event.framebufferSize.height };
+            appCtx->framebufferResized = true;
+            appCtx->lastResizeNs = event.timeNs;
+            continue;
+        case INPUT_EVENT_REFRESH:
+            break;
+        }
+
+        if (loop->oldestInputNs == 0) {
+            loop->oldestInputNs = event.timeNs;
+        }
+        appCtx_request_redraw(appCtx);
+    }
+}
+
+static void* render_thread_main(void* arg)
+{
+    RenderLoop* loop = arg;
+    AppCtx* appCtx = loop->appCtx;
+    VkResult result = VK_SUCCESS;
+
+    // Frame-time summary, reported once per second over the timing history
+    uint64_t statsStartNs = timer_now_ns();
+    FrameTimingStats cpuStats = { 0 };
+    FrameTimingStats gpuStats = { 0 };
+    uint64_t inputLatencySumNs = 0;
+    uint64_t inputLatencyMaxNs = 0;
+    uint32_t inputLatencyCount = 0;
+    UiSettings settings = { .presentPolicy = appCtx->presentPolicy, .onDemand = loop->onDemand };
+    uint64_t lastDrawNs = 0;
+    appCtx_request_redraw(appCtx);
+
+    while (!atomic_load(&loop->quit)) {
+        // Input arriving while idle belongs to the frame it wakes up. Every path through an
+        // iteration drains the queue between this and exactly one nk_input_end.
+        nk_input_begin(&appCtx->ui.ctx);
+
+        // Minimized, nothing can be presented until the window reports a size again
+        if (appCtx->framebufferExtent.width == 0 || appCtx->framebufferExtent.height == 0) {
+            input_queue_wait(&appCtx->input, UINT64_MAX);
+            apply_input(loop);
+            nk_input_end(&appCtx->ui.ctx);
+            continue;
+        }
+
+        // Sleeps until an event, a redraw request from another thread or the idle redraw. A
+        // pending resize keeps the loop running so the debounced recreation happens on time.
+        if (settings.onDemand) {
+            apply_input(loop);
+            while (!appCtx_needs_redraw(appCtx) && !appCtx->framebufferResized
+                && !atomic_load(&loop->quit)) {
+                uint64_t nowNs = timer_now_ns();
+                if (nowNs - lastDrawNs >= YACW_IDLE_REDRAW_NS) {
+                    break;
+                }
+                input_queue_wait(&appCtx->input, lastDrawNs + YACW_IDLE_REDRAW_NS - nowNs);
+                apply_input(loop);
+            }
+        }
+
+        frame_timing_begin_frame(&appCtx->timing);
+
+        // Before taking the input, so the frame starts from the freshest
+        frame_pacing_wait(&appCtx->pacing, appCtx->presentPolicy, appCtx->swapchain);
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_PACING);
+
+        apply_input(loop);
+        nk_input_end(&appCtx->ui.ctx);
+
+        if (settings.presentPolicy != appCtx->presentPolicy) {
+            result = appCtx_set_present_policy(appCtx, settings.presentPolicy);
+            if (result != VK_SUCCESS) {
+                break;
+            }
+        }
+
+        if (appCtx->framebufferResized
+            && timer_now_ns() - appCtx->lastResizeNs >= YACW_RESIZE_DEBOUNCE_NS) {
+            result = appCtx_recreate_swapchain(appCtx);
+            if (result != VK_SUCCESS) {
+                break;
+            }
+        }
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_EVENTS);
+
+        FrameCtx* frame = &appCtx->frames[appCtx->currentFrame];
+
+        // Only wait for the frame that last used this slot, earlier frames keep the GPU busy
+        result = frame_timeline_wait(&appCtx->timeline, frame->timelineValue);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        frame_timing_collect(&appCtx->timing, appCtx->currentFrame);
+        appCtx_begin_frame(appCtx);
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_WAIT);
 
         uint32_t imageIndex;
-        result = vkAcquireNextImageKHR(appCtx.device,
-            appCtx.swapchain,
+        result = vkAcquireNextImageKHR(appCtx->device,
+            appCtx->swapchain,
             UINT64_MAX,
-            appCtx.imageAvailableSemaphore,
+            frame->imageAvailableSemaphore,
             VK_NULL_HANDLE,
             &imageIndex);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-            LOG_INFO("Swapchain out of date, not recreating...");
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_ACQUIRE);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // Nothing can be presented, sleep on input instead of spinning while the user is
+            // still dragging the window edge
+            uint64_t sinceResizeNs = timer_now_ns() - appCtx->lastResizeNs;
+            if (appCtx->framebufferResized && sinceResizeNs < YACW_RESIZE_DEBOUNCE_NS) {
+                input_queue_wait(&appCtx->input, YACW_RESIZE_DEBOUNCE_NS - sinceResizeNs);
+                result = VK_SUCCESS;
+                continue;
+            }
+
+            LOG_INFO_LIMITED("Swapchain out of date, recreating...");
+            result = appCtx_recreate_swapchain(appCtx);
+            if (result != VK_SUCCESS) {
+                break;
+            }
             continue;
+        } else if (result == VK_SUBOPTIMAL_KHR) {
+            // The acquire semaphore is signaled, render this frame and recreate afterwards
+            appCtx->framebufferResized = true;
         } else if (result != VK_SUCCESS) {
             LOG_ERROR("Failed to acquire next swapchain image: %d", result);
             break;
         }
 
-        VkSubmitInfo submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &appCtx.imageAvailableSemaphore,
-            .pWaitDstStageMask
-            = (VkPipelineStageFlags[]) { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
-            .commandBufferCount = 1,
-            .pCommandBuffers = &appCtx.commandBuffers[imageIndex],
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &appCtx.renderFinishedSemaphore[imageIndex] };
-
-        result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, appCtx.inFlightFence);
+        // The image may still be in use by a frame from another slot
+        result = frame_timeline_wait(&appCtx->timeline, appCtx->imageTimelineValues[imageIndex]);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_WAIT);
+
+        draw_ui(&appCtx->ui.ctx, cpuStats.avgMs, cpuStats.p99Ms, gpuStats.avgMs, &settings);
+
+        result = appCtx_record_frame(appCtx, frame->commandBuffer, imageIndex, NULL);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_RECORD);
+
+        result = appCtx_submit_frame(appCtx, loop->graphicsQueue, imageIndex);
         if (result != VK_SUCCESS) {
-            LOG_ERROR("Failed to submit draw command buffer: %d", result);
             break;
         }
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_SUBMIT);
+
+        appCtx->currentFrame = (appCtx->currentFrame + 1) % YACW_FRAMES_IN_FLIGHT;
 
         VkPresentInfoKHR presentInfo = { .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
             .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &appCtx.renderFinishedSemaphore[imageIndex],
+            .pWaitSemaphores = &appCtx->renderFinishedSemaphore[imageIndex],
             .swapchainCount = 1,
-            .pSwapchains = &appCtx.swapchain,
+            .pSwapchains = &appCtx->swapchain,
             .pImageIndices = &imageIndex };
+        VkPresentIdKHR presentId;
+        frame_pacing_present(&appCtx->pacing, &presentInfo, &presentId);
+        DamagePresentRegions presentRegions;
+        if (appCtx->incrementalPresent) {
+            damage_chain_present(&appCtx->frameDamage, &presentInfo, &presentRegions);
+        }
 
-        result = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+        result = vkQueuePresentKHR(loop->graphicsQueue, &presentInfo);
+        frame_timing_mark(&appCtx->timing, FRAME_TIMING_PRESENT);
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-            LOG_INFO("Swapchain out of date, not recreating...");
-            continue;
+            // Picked up by the debounced recreation at the top of the loop
+            appCtx->framebufferResized = true;
+            result = VK_SUCCESS;
         } else if (result != VK_SUCCESS) {
             LOG_ERROR("Failed to present swapchain image: %d", result);
             break;
         }
+
+        frame_timing_end_frame(&appCtx->timing);
+        appCtx_frame_drawn(appCtx);
+
+        uint64_t nowNs = timer_now_ns();
+        lastDrawNs = nowNs;
+
+        // From the event thread receiving the input to the frame showing it being queued
+        if (loop->oldestInputNs != 0) {
+            uint64_t latencyNs = nowNs - loop->oldestInputNs;
+            inputLatencySumNs += latencyNs;
+            inputLatencyMaxNs = latencyNs > inputLatencyMaxNs ? latencyNs : inputLatencyMaxNs;
+            inputLatencyCount++;
+            loop->oldestInputNs = 0;
+        }
+
+        if (nowNs - statsStartNs >= 1000000000ull
+            && frame_timing_stats(&appCtx->timing, FRAME_TIMING_CPU_FRAME, &cpuStats)) {
+            if (!frame_timing_stats(&appCtx->timing, FRAME_TIMING_GPU, &gpuStats)) {
+                gpuStats = (FrameTimingStats) { 0 };
+            }
+
+            LOG_INFO("Frame time: avg %.3f ms, p99 %.3f ms, gpu %.3f ms, %.1f fps (%u frames in "
+                     "flight)",
+                cpuStats.avgMs,
+                cpuStats.p99Ms,
+                gpuStats.avgMs,
+                1000.0 / cpuStats.avgMs,
+                YACW_FRAMES_IN_FLIGHT);
+            if (inputLatencyCount > 0) {
+                LOG_INFO("Input to present: avg %.3f ms, max %.3f ms over %u frames",
+                    timer_ns_to_ms(inputLatencySumNs) / inputLatencyCount,
+                    timer_ns_to_ms(inputLatencyMaxNs),
+                    inputLatencyCount);
+            }
+
+            statsStartNs = nowNs;
+            inputLatencySumNs = 0;
+            inputLatencyMaxNs = 0;
+            inputLatencyCount = 0;
+        }
+    }
+
+    loop->result = result;
+
+    // Ends the event loop if rendering failed, a no-op once the window is closing anyway
+    glfwSetWindowShouldClose(appCtx->window, GLFW_TRUE);
+    glfwPostEmptyEvent();
+
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    VkResult result;
+    AppCtx appCtx = { 0 };
+    int exitCode = 0;
+
+    // Option errors are still logged synchronously so they come out before the usage text
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // Dropping under a burst is preferable to stalling the render loop on the log writer
+    if (!log_init(LOG_FULL_DROP)) {
+        LOG_ERROR("Failed to start the log writer thread, logging synchronously");
+    }
+
+    // Everything compiled in goes to the binary log, the console keeps to INFO and above
+    const char* binaryLogPath = getenv("YACW_LOG_BINARY");
+    if (binaryLogPath != NULL && binaryLogPath[0] != '\0') {
+        log_open_binary(binaryLogPath, LOG_LEVEL_INFO);
+    }
+
+    appCtx.headlessExtent = options.extent;
+    appCtx.presentPolicy = options.presentPolicy;
+    appCtx.forceRenderPass = options.renderPass;
+
+    appCtx.gpuSelector = options.gpu;
+    if (appCtx.gpuSelector == NULL) {
+        const char* gpu = getenv("YACW_GPU");
+        appCtx.gpuSelector = gpu != NULL && gpu[0] != '\0' ? gpu : NULL;
+    }
+
+    // Set up before the window, whose callbacks push into it
+    if (!options.headless && !input_queue_init(&appCtx.input)) {
+        log_shutdown();
+        return 1;
+    }
+
+    // Glfw setup, skipped entirely when headless so no display is needed
+    if (!options.headless) {
+        glfwSetErrorCallback(glfw_error_callback);
+
+        if (glfwInit() != GLFW_TRUE) {
+            LOG_ERROR("Failed to initialize GLFW");
+            exitCode = 1;
+            goto cleanup_glfw;
+        }
+        LOG_INFO("GLFW initialized successfully");
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+        appCtx.window = glfwCreateWindow(640, 480, "Hello Vulkan", NULL, NULL);
+        if (appCtx.window == NULL) {
+            LOG_ERROR("Failed to create GLFW window");
+            exitCode = 1;
+            goto cleanup_glfw;
+        }
+        LOG_INFO("GLFW window created successfully");
+
+        int width, height;
+        glfwGetFramebufferSize(appCtx.window, &width, &height);
+        appCtx.framebufferExtent = (VkExtent2D) { (uint32_t)width, (uint32_t)height };
+
+        glfwSetWindowUserPointer(appCtx.window, &appCtx);
+        glfwSetFramebufferSizeCallback(appCtx.window, glfw_framebuffer_size_callback);
+        glfwSetCursorPosCallback(appCtx.window, glfw_cursor_pos_callback);
+        glfwSetMouseButtonCallback(appCtx.window, glfw_mouse_button_callback);
+        glfwSetScrollCallback(appCtx.window, glfw_scroll_callback);
+        glfwSetCharCallback(appCtx.window, glfw_char_callback);
+        glfwSetWindowRefreshCallback(appCtx.window, glfw_window_refresh_callback);
+    }
+
+    result = appCtx_init(&appCtx);
+    if (result != VK_SUCCESS) {
+        exitCode = 1;
+        goto cleanup_glfw;
+    }
+
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    vkGetDeviceQueue(appCtx.device, appCtx.queueFamilyIndex, 0, &graphicsQueue);
+    LOG_INFO("Graphics queue obtained");
+
+    if (options.headless) {
+        result = run_headless(&appCtx, graphicsQueue, &options);
+        exitCode = result == VK_SUCCESS ? 0 : 1;
+        goto cleanup_glfw;
+    }
+
+    RenderLoop loop = { .appCtx = &appCtx,
+        .graphicsQueue = graphicsQueue,
+        .onDemand = options.onDemand,
+        .result = VK_SUCCESS };
+    atomic_init(&loop.quit, false);
+
+    // From here on this thread only pumps window events, GPU stalls on the render thread no
+    // longer hold up input and the AppCtx belongs to the render thread until it is joined
+    pthread_t renderThread;
+    if (pthread_create(&renderThread, NULL, render_thread_main, &loop) != 0) {
+        LOG_ERROR("Failed to start the render thread");
+        exitCode = 1;
+        goto cleanup_glfw;
     }
 
+    while (!glfwWindowShouldClose(appCtx.window)) {
+        glfwWaitEvents();
+    }
+
+    atomic_store(&loop.quit, true);
+    input_queue_wake(&appCtx.input);
+    pthread_join(renderThread, NULL);
+    exitCode = loop.result == VK_SUCCESS ? 0 : 1;
+
     vkDeviceWaitIdle(appCtx.device);
 
+    for (uint32_t slot = 0; slot < YACW_FRAMES_IN_FLIGHT; slot++) {
+        frame_timing_collect(&appCtx.timing, slot);
+    }
+    frame_timing_log_summary(&appCtx.timing);
+
 cleanup_glfw:
     appCtx_deinit(&appCtx);
-    glfwDestroyWindow(appCtx.window);
-    glfwTerminate();
+    if (!options.headless) {
+        glfwDestroyWindow(appCtx.window);
+        glfwTerminate();
+        input_queue_deinit(&appCtx.input);
+    }
+
+    asset_cache_deinit();
+    log_shutdown();
 
-    return 0;
+    return exitCode;
 }
@@ -0,0 +1,721 @@
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "log.h"
+#include "nk_vulkan.h"
+
+typedef struct NkVulkanVertex {
+    float position[2];
+    float uv[2];
+    nk_byte color[4];
+} NkVulkanVertex;
+
+typedef struct NkVulkanPushConstants {
+    float scale[2];
+    float translate[2];
+} NkVulkanPushConstants;
+
+static const struct nk_draw_vertex_layout_element vertexLayout[] = {
+    { NK_VERTEX_POSITION, NK_FORMAT_FLOAT, offsetof(NkVulkanVertex, position) },
+    { NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, offsetof(NkVulkanVertex, uv) },
+    { NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, offsetof(NkVulkanVertex, color) },
+    { NK_VERTEX_LAYOUT_END }
+};
+
+static VkResult nk_vulkan_upload_font(
+    NkVulkan* ui, UploadCtx* upload, const void* pixels, uint32_t width, uint32_t height)
+{
+    VkResult result;
+    VkDeviceSize imageSize = (VkDeviceSize)width * height * 4;
+
+    // Device-local image, written once
+    VkImageCreateInfo imageInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = { width, height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED };
+
+    result = gpu_memory_create_image(ui->gpuMemory,
+        &imageInfo,
+        GPU_MEMORY_USAGE_GPU_ONLY,
+        &ui->fontImage,
+        &ui->fontAllocation);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create font atlas image: %d", result);
+        return result;
+    }
+
+    // Goes out with the first frame, which waits for it before sampling
+    result = upload_image(upload,
+        ui->fontImage,
+        imageInfo.extent,
+        pixels,
+        imageSize,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to stage font atlas: %d", result);
+        return result;
+    }
+
+    LOG_INFO("Font atlas staged: %ux%u", width, height);
+
+    return result;
+}
+
+static VkResult nk_vulkan_init_font(NkVulkan* ui, VkDevice device, UploadCtx* upload)
+{
+    VkResult result;
+
+    nk_font_atlas_init_default(&ui->atlas);
+    nk_font_atlas_begin(&ui->atlas);
+
+    struct nk_font* font = nk_font_atlas_add_default(&ui->atlas, 13.0f, NULL);
+
+    int width, height;
+    const void* pixels = nk_font_atlas_bake(&ui->atlas, &width, &height, NK_FONT_ATLAS_RGBA32);
+    if (pixels == NULL) {
+        LOG_ERROR("Failed to bake the Nuklear font atlas");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    result = nk_vulkan_upload_font(ui, upload, pixels, (uint32_t)width, (uint32_t)height);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    VkImageViewCreateInfo viewInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = ui->fontImage,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1 } };
+
+    result = vkCreateImageView(device, &viewInfo, NULL, &ui->fontImageView);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create font atlas image view: %d", result);
+        return result;
+    }
+
+    VkSamplerCreateInfo samplerInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod = 1.0f };
+
+    result = vkCreateSampler(device, &samplerInfo, NULL, &ui->fontSampler);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create font atlas sampler: %d", result);
+        return result;
+    }
+
+    // Only one texture exists, every draw command samples the font atlas
+    nk_font_atlas_end(&ui->atlas, nk_handle_id(0), &ui->nullTexture);
+    nk_font_atlas_cleanup(&ui->atlas);
+
+    if (!nk_init_default(&ui->ctx, &font->handle)) {
+        LOG_ERROR("Failed to initialize the Nuklear context");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    return result;
+}
+
+static VkResult nk_vulkan_init_descriptors(NkVulkan* ui, VkDevice device)
+{
+    VkResult result;
+
+    VkDescriptorSetLayoutBinding binding = { .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT };
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo
+        = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+              .bindingCount = 1,
+              .pBindings = &binding };
+
+    result = vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &ui->descriptorSetLayout);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create UI descriptor set layout: %d", result);
+        return result;
+    }
+
+    VkDescriptorPoolSize poolSize
+        = { .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1 };
+
+    VkDescriptorPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize };
+
+    result = vkCreateDescriptorPool(device, &poolInfo, NULL, &ui->descriptorPool);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create UI descriptor pool: %d", result);
+        return result;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo
+        = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+              .descriptorPool = ui->descriptorPool,
+              .descriptorSetCount = 1,
+              .pSetLayouts = &ui->descriptorSetLayout };
+
+    result = vkAllocateDescriptorSets(device, &allocInfo, &ui->descriptorSet);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to allocate UI descriptor set: %d", result);
+        return result;
+    }
+
+    VkDescriptorImageInfo imageInfo = { .sampler = ui->fontSampler,
+        .imageView = ui->fontImageView,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+    VkWriteDescriptorSet write = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = ui->descriptorSet,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &imageInfo };
+
+    vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+
+    return result;
+}
+
+static VkResult nk_vulkan_init_pipeline_layout(NkVulkan* ui, VkDevice device)
+{
+    VkResult result;
+
+    VkPushConstantRange pushConstantRange = { .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(NkVulkanPushConstants) };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+              .setLayoutCount = 1,
+              .pSetLayouts = &ui->descriptorSetLayout,
+              .pushConstantRangeCount = 1,
+              .pPushConstantRanges = &pushConstantRange };
+
+    result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &ui->pipelineLayout);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create UI pipeline layout: %d", result);
+        return result;
+    }
+
+    return result;
+}
+
+static bool format_is_srgb(VkFormat format)
+{
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+        return true;
+    default:
+        return false;
+    }
+}
+
+VkResult nk_vulkan_create_pipeline(NkVulkan* ui,
+    VkDevice device,
+    VkPipelineCache pipelineCache,
+    const RenderTarget* target,
+    VkShaderModule vertShaderModule,
+    VkShaderModule fragShaderModule)
+{
+    VkResult result;
+
+    // srgbTarget in ui.vert, whether the colors have to be decoded for the attachment
+    VkBool32 srgbTarget = format_is_srgb(target->colorFormat) ? VK_TRUE : VK_FALSE;
+    VkSpecializationMapEntry specializationEntry
+        = { .constantID = 0, .offset = 0, .size = sizeof(srgbTarget) };
+    VkSpecializationInfo specializationInfo = { .mapEntryCount = 1,
+        .pMapEntries = &specializationEntry,
+        .dataSize = sizeof(srgbTarget),
+        .pData = &srgbTarget };
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertShaderModule,
+            .pName = "main",
+            .pSpecializationInfo = &specializationInfo },
+        { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragShaderModule,
+            .pName = "main" },
+    };
+
+    VkVertexInputBindingDescription bindingDescription = { .binding = 0,
+        .stride = sizeof(NkVulkanVertex),
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX };
+
+    VkVertexInputAttributeDescription attributeDescriptions[] = {
+        { .location = 0,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32_SFLOAT,
+            .offset = offsetof(NkVulkanVertex, position) },
+        { .location = 1,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32_SFLOAT,
+            .offset = offsetof(NkVulkanVertex, uv) },
+        { .location = 2,
+            .binding = 0,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .offset = offsetof(NkVulkanVertex, color) },
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+              .vertexBindingDescriptionCount = 1,
+              .pVertexBindingDescriptions = &bindingDescription,
+              .vertexAttributeDescriptionCount
+              = sizeof(attributeDescriptions) / sizeof(attributeDescriptions[0]),
+              .pVertexAttributeDescriptions = attributeDescriptions };
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+              .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+              .primitiveRestartEnable = VK_FALSE };
+
+    VkPipelineViewportStateCreateInfo viewportState
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+              .viewportCount = 1,
+              .scissorCount = 1 };
+
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+              .dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]),
+              .pDynamicStates = dynamicStates };
+
+    // Nuklear does not keep a consistent winding order
+    VkPipelineRasterizationStateCreateInfo rasterizer
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+              .polygonMode = VK_POLYGON_MODE_FILL,
+              .lineWidth = 1.0f,
+              .cullMode = VK_CULL_MODE_NONE,
+              .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE };
+
+    VkPipelineMultisampleStateCreateInfo multisampling
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+              .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT };
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = { .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+            | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT };
+
+    VkPipelineColorBlendStateCreateInfo colorBlending
+        = { .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+              .attachmentCount = 1,
+              .pAttachments = &colorBlendAttachment };
+
+    VkPipelineRenderingCreateInfo renderingInfo;
+    VkGraphicsPipelineCreateInfo pipelineInfo
+        = { .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+              .pNext = render_target_pipeline_chain(target, &renderingInfo),
+              .stageCount = sizeof(shaderStages) / sizeof(shaderStages[0]),
+              .pStages = shaderStages,
+              .pVertexInputState = &vertexInputInfo,
+              .pInputAssemblyState = &inputAssembly,
+              .pViewportState = &viewportState,
+              .pRasterizationState = &rasterizer,
+              .pMultisampleState = &multisampling,
+              .pColorBlendState = &colorBlending,
+              .pDynamicState = &dynamicState,
+              .layout = ui->pipelineLayout,
+              .renderPass = target->renderPass,
+              .subpass = 0 };
+
+    result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL, &ui->pipeline);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create UI pipeline: %d", result);
+        return result;
+    }
+    LOG_INFO("UI pipeline created successfully");
+
+    return result;
+}
+
+VkResult nk_vulkan_init(NkVulkan* ui,
+    GpuMemory* gpuMemory,
+    UploadCtx* upload,
+    VkDevice device,
+    uint32_t frameCount)
+{
+    VkResult result;
+
+    ui->gpuMemory = gpuMemory;
+    ui->frameCount = frameCount;
+
+    result = nk_vulkan_init_font(ui, device, upload);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = nk_vulkan_init_descriptors(ui, device);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = nk_vulkan_init_pipeline_layout(ui, device);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    // Written with one copy per frame from the host frames below
+    VkDeviceSize streamSize
+        = (VkDeviceSize)frameCount * (NK_VULKAN_VERTEX_BUFFER_SIZE + NK_VULKAN_INDEX_BUFFER_SIZE);
+
+    VkBufferCreateInfo streamInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = streamSize,
+        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE };
+
+    result = gpu_memory_create_buffer(gpuMemory,
+        &streamInfo,
+        GPU_MEMORY_USAGE_CPU_TO_GPU,
+        &ui->streamBuffer,
+        &ui->streamAllocation);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create UI stream buffer: %d", result);
+        return result;
+    }
+    ui->streamMapped = ui->streamAllocation.mapped;
+
+    size_t hostFrameSize = NK_VULKAN_VERTEX_BUFFER_SIZE + NK_VULKAN_INDEX_BUFFER_SIZE
+        + NK_VULKAN_MAX_DRAWS * sizeof(NkVulkanDraw);
+    uint8_t* hostFrames = malloc(2 * hostFrameSize);
+    if (hostFrames == NULL) {
+        LOG_ERROR("Failed to allocate memory for the UI host frames");
+        return VK_RESULT_MAX_ENUM;
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        uint8_t* hostFrame = hostFrames + i * hostFrameSize;
+        ui->frames[i] = (NkVulkanFrame) { .vertices = hostFrame,
+            .indices = hostFrame + NK_VULKAN_VERTEX_BUFFER_SIZE,
+            .draws = (NkVulkanDraw*)(hostFrame + NK_VULKAN_VERTEX_BUFFER_SIZE
+                + NK_VULKAN_INDEX_BUFFER_SIZE) };
+    }
+
+    nk_buffer_init_default(&ui->commands);
+
+    LOG_INFO("Nuklear Vulkan backend initialized: %u frame slices of %u KiB",
+        frameCount,
+        (NK_VULKAN_VERTEX_BUFFER_SIZE + NK_VULKAN_INDEX_BUFFER_SIZE) / 1024);
+
+    return result;
+}
+
+// Bounds of the vertices of one triangle, grown into bounds
+static void grow_triangle_bounds(const NkVulkanFrame* frame, uint32_t firstIndex, float bounds[4])
+{
+    const nk_draw_index* indices = (const nk_draw_index*)frame->indices + firstIndex;
+    const NkVulkanVertex* vertices = (const NkVulkanVertex*)frame->vertices;
+
+    for (uint32_t i = 0; i < 3; i++) {
+        const float* position = vertices[indices[i]].position;
+        bounds[0] = position[0] < bounds[0] ? position[0] : bounds[0];
+        bounds[1] = position[1] < bounds[1] ? position[1] : bounds[1];
+        bounds[2] = position[0] > bounds[2] ? position[0] : bounds[2];
+        bounds[3] = position[1] > bounds[3] ? position[1] : bounds[3];
+    }
+}
+
+static bool triangles_equal(const NkVulkanFrame* a,
+    uint32_t firstIndexA,
+    const NkVulkanFrame* b,
+    uint32_t firstIndexB)
+{
+    const nk_draw_index* indicesA = (const nk_draw_index*)a->indices + firstIndexA;
+    const nk_draw_index* indicesB = (const nk_draw_index*)b->indices + firstIndexB;
+    const NkVulkanVertex* verticesA = (const NkVulkanVertex*)a->vertices;
+    const NkVulkanVertex* verticesB = (const NkVulkanVertex*)b->vertices;
+
+    // Indices differ whenever anything earlier changed, what they point at is what is drawn
+    for (uint32_t i = 0; i < 3; i++) {
+        if (memcmp(&verticesA[indicesA[i]], &verticesB[indicesB[i]], sizeof(NkVulkanVertex))
+            != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool rect_equal(VkRect2D a, VkRect2D b)
+{
+    return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.extent.width == b.extent.width
+        && a.extent.height == b.extent.height;
+}
+
+// Commands are matched by position. Where both frames have the same command only the triangles
+// that changed are damaged, anything else damages the scissors of both.
+static void diff_frames(const NkVulkanFrame* previous,
+    const NkVulkanFrame* current,
+    VkExtent2D extent,
+    DamageRegion* damage)
+{
+    uint32_t drawCount
+        = previous->drawCount > current->drawCount ? previous->drawCount : current->drawCount;
+
+    for (uint32_t i = 0; i < drawCount && !damage->full; i++) {
+        const NkVulkanDraw* before = i < previous->drawCount ? &previous->draws[i] : NULL;
+        const NkVulkanDraw* after = i < current->drawCount ? &current->draws[i] : NULL;
+
+        if (before == NULL || after == NULL || before->elemCount != after->elemCount
+            || !rect_equal(before->scissor, after->scissor)) {
+            if (before != NULL) {
+                damage_add(damage, before->scissor, extent);
+            }
+            if (after != NULL) {
+                damage_add(damage, after->scissor, extent);
+            }
+            continue;
+        }
+
+        float bounds[4] = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint32_t t = 0; t < after->elemCount; t += 3) {
+            uint32_t indexBefore = before->firstIndex + t;
+            uint32_t indexAfter = after->firstIndex + t;
+            if (!triangles_equal(previous, indexBefore, current, indexAfter)) {
+                grow_triangle_bounds(previous, indexBefore, bounds);
+                grow_triangle_bounds(current, indexAfter, bounds);
+            }
+        }
+        if (bounds[0] > bounds[2]) {
+            continue;
+        }
+
+        // One pixel of slack for anti-aliasing fringes and rasterization rounding
+        int32_t x0 = (int32_t)floorf(bounds[0]) - 1;
+        int32_t y0 = (int32_t)floorf(bounds[1]) - 1;
+        int32_t x1 = (int32_t)ceilf(bounds[2]) + 1;
+        int32_t y1 = (int32_t)ceilf(bounds[3]) + 1;
+        VkRect2D changed = { .offset = { x0, y0 },
+            .extent = { (uint32_t)(x1 - x0), (uint32_t)(y1 - y0) } };
+        if (damage_intersect(changed, after->scissor, &changed)) {
+            damage_add(damage, changed, extent);
+        }
+    }
+}
+
+void nk_vulkan_prepare(NkVulkan* ui, uint32_t frameIndex, VkExtent2D extent, DamageRegion* damage)
+{
+    const NkVulkanFrame* previous = &ui->frames[ui->currentFrame];
+    ui->currentFrame ^= 1;
+    NkVulkanFrame* current = &ui->frames[ui->currentFrame];
+    current->drawCount = 0;
+    current->valid = false;
+
+    struct nk_convert_config config = { .vertex_layout = vertexLayout,
+        .vertex_size = sizeof(NkVulkanVertex),
+        .vertex_alignment = _Alignof(NkVulkanVertex),
+        .tex_null = ui->nullTexture,
+        .circle_segment_count = 22,
+        .curve_segment_count = 22,
+        .arc_segment_count = 22,
+        .global_alpha = 1.0f,
+        .shape_AA = NK_ANTI_ALIASING_ON,
+        .line_AA = NK_ANTI_ALIASING_ON };
+
+    // Converted into host memory, reading the previous frame back from the write-combined
+    // stream buffer would be slow
+    struct nk_buffer vertices, indices;
+    nk_buffer_init_fixed(&vertices, current->vertices, NK_VULKAN_VERTEX_BUFFER_SIZE);
+    nk_buffer_init_fixed(&indices, current->indices, NK_VULKAN_INDEX_BUFFER_SIZE);
+    nk_buffer_clear(&ui->commands);
+
+    nk_flags convertResult = nk_convert(&ui->ctx, &ui->commands, &vertices, &indices, &config);
+    if (convertResult != NK_CONVERT_SUCCESS) {
+        LOG_ERROR("Failed to convert Nuklear draw commands: 0x%x", convertResult);
+        nk_clear(&ui->ctx);
+        damage_set_full(damage);
+        return;
+    }
+
+    const struct nk_draw_command* cmd;
+    uint32_t firstIndex = 0;
+
+    nk_draw_foreach(cmd, &ui->ctx, &ui->commands)
+    {
+        if (cmd->elem_count == 0) {
+            continue;
+        }
+
+        // Clip rect to framebuffer bounds, scissor offsets must not be negative
+        float x0 = cmd->clip_rect.x < 0.0f ? 0.0f : cmd->clip_rect.x;
+        float y0 = cmd->clip_rect.y < 0.0f ? 0.0f : cmd->clip_rect.y;
+        float x1 = cmd->clip_rect.x + cmd->clip_rect.w;
+        float y1 = cmd->clip_rect.y + cmd->clip_rect.h;
+        x1 = x1 > (float)extent.width ? (float)extent.width : x1;
+        y1 = y1 > (float)extent.height ? (float)extent.height : y1;
+
+        VkRect2D scissor = { 0 };
+        if (x1 > x0 && y1 > y0) {
+            scissor = (VkRect2D) { .offset = { (int32_t)x0, (int32_t)y0 },
+                .extent = { (uint32_t)(x1 - x0), (uint32_t)(y1 - y0) } };
+        }
+
+        current->draws[current->drawCount++] = (NkVulkanDraw) {
+            .scissor = scissor, .firstIndex = firstIndex, .elemCount = cmd->elem_count
+        };
+        firstIndex += cmd->elem_count;
+    }
+
+    nk_clear(&ui->ctx);
+
+    // The slice of this frame is free, the slot's timeline value its previous user signals has
+    // been waited for
+    VkDeviceSize vertexOffset
+        = (VkDeviceSize)frameIndex * (NK_VULKAN_VERTEX_BUFFER_SIZE + NK_VULKAN_INDEX_BUFFER_SIZE);
+    VkDeviceSize indexOffset = vertexOffset + NK_VULKAN_VERTEX_BUFFER_SIZE;
+    memcpy(ui->streamMapped + vertexOffset, current->vertices, nk_buffer_total(&vertices));
+    memcpy(ui->streamMapped + indexOffset, current->indices, nk_buffer_total(&indices));
+
+    current->valid = true;
+    if (previous->valid) {
+        diff_frames(previous, current, extent, damage);
+    } else {
+        damage_set_full(damage);
+    }
+}
+
+void nk_vulkan_render(NkVulkan* ui,
+    VkCommandBuffer commandBuffer,
+    uint32_t frameIndex,
+    VkExtent2D extent,
+    const DamageRegion* damage)
+{
+    const NkVulkanFrame* frame = &ui->frames[ui->currentFrame];
+    if (frame->drawCount == 0 || damage_is_empty(damage)) {
+        return;
+    }
+
+    VkDeviceSize vertexOffset
+        = (VkDeviceSize)frameIndex * (NK_VULKAN_VERTEX_BUFFER_SIZE + NK_VULKAN_INDEX_BUFFER_SIZE);
+    VkDeviceSize indexOffset = vertexOffset + NK_VULKAN_VERTEX_BUFFER_SIZE;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ui->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        ui->pipelineLayout,
+        0,
+        1,
+        &ui->descriptorSet,
+        0,
+        NULL);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &ui->streamBuffer, &vertexOffset);
+    vkCmdBindIndexBuffer(commandBuffer,
+        ui->streamBuffer,
+        indexOffset,
+        sizeof(nk_draw_index) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+
+    VkViewport viewport = { .x = 0.0f,
+        .y = 0.0f,
+        .width = (float)extent.width,
+        .height = (float)extent.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    NkVulkanPushConstants pushConstants = { .scale = { 2.0f / extent.width, 2.0f / extent.height },
+        .translate = { -1.0f, -1.0f } };
+    vkCmdPushConstants(commandBuffer,
+        ui->pipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT,
+        0,
+        sizeof(pushConstants),
+        &pushConstants);
+
+    for (uint32_t i = 0; i < frame->drawCount; i++) {
+        const NkVulkanDraw* draw = &frame->draws[i];
+        if (draw->scissor.extent.width == 0) {
+            continue;
+        }
+
+        if (damage->full) {
+            vkCmdSetScissor(commandBuffer, 0, 1, &draw->scissor);
+            vkCmdDrawIndexed(commandBuffer, draw->elemCount, 1, draw->firstIndex, 0, 0);
+            continue;
+        }
+
+        // Damage rects do not overlap, so blended pixels are still drawn exactly once
+        for (uint32_t r = 0; r < damage->count; r++) {
+            VkRect2D scissor;
+            if (damage_intersect(draw->scissor, damage->rects[r], &scissor)) {
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                vkCmdDrawIndexed(commandBuffer, draw->elemCount, 1, draw->firstIndex, 0, 0);
+            }
+        }
+    }
+}
+
+void nk_vulkan_deinit(NkVulkan* ui, VkDevice device)
+{
+    // The font atlas is set up first thing in nk_vulkan_init
+    if (ui->frameCount > 0) {
+        nk_buffer_free(&ui->commands);
+        // Both host frames live in the allocation of the first
+        free(ui->frames[0].vertices);
+        nk_font_atlas_clear(&ui->atlas);
+        nk_free(&ui->ctx);
+    }
+
+    if (ui->streamBuffer != VK_NULL_HANDLE) {
+        gpu_memory_destroy_buffer(ui->gpuMemory, ui->streamBuffer, &ui->streamAllocation);
+    }
+
+    if (ui->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, ui->pipeline, NULL);
+    }
+
+    if (ui->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, ui->pipelineLayout, NULL);
+    }
+
+    if (ui->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, ui->descriptorPool, NULL);
+    }
+
+    if (ui->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, ui->descriptorSetLayout, NULL);
+    }
+
+    if (ui->fontSampler != VK_NULL_HANDLE) {
+        vkDestroySampler(device, ui->fontSampler, NULL);
+    }
+
+    if (ui->fontImageView != VK_NULL_HANDLE) {
+        vkDestroyImageView(device, ui->fontImageView, NULL);
+    }
+
+    if (ui->fontImage != VK_NULL_HANDLE) {
+        gpu_memory_destroy_image(ui->gpuMemory, ui->fontImage, &ui->fontAllocation);
+    }
+}
@@ -0,0 +1,187 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "asset.h"
+#include "cache_dir.h"
+#include "log.h"
+#include "pipeline_cache.h"
+#include "timer.h"
+
+#define PIPELINE_CACHE_FILE_NAME "pipeline_cache.bin"
+
+static bool pipeline_cache_validate(
+    VkPhysicalDevice physicalDevice, const void* data, size_t dataSize)
+{
+    VkPipelineCacheHeaderVersionOne header;
+
+    if (dataSize < sizeof(header)) {
+        LOG_INFO("Pipeline cache miss: file too small (%zu bytes)", dataSize);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.headerSize < sizeof(header) || header.headerSize > dataSize) {
+        LOG_INFO("Pipeline cache miss: invalid header size %u", header.headerSize);
+        return false;
+    }
+
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        LOG_INFO("Pipeline cache miss: unknown header version %d", header.headerVersion);
+        return false;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID) {
+        LOG_INFO("Pipeline cache miss: written for device %04x:%04x, running on %04x:%04x",
+            header.vendorID,
+            header.deviceID,
+            properties.vendorID,
+            properties.deviceID);
+        return false;
+    }
+
+    // Changes with every driver update
+    if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        LOG_INFO("Pipeline cache miss: pipeline cache UUID mismatch, driver changed");
+        return false;
+    }
+
+    return true;
+}
+
+static bool pipeline_cache_read(const char* path, AssetView* view)
+{
+    if (!asset_acquire(path, view)) {
+        if (errno == ENOENT) {
+            LOG_INFO("Pipeline cache miss: %s does not exist", path);
+        } else {
+            LOG_ERROR("Could not open pipeline cache %s: %s", path, strerror(errno));
+        }
+        return false;
+    }
+
+    return true;
+}
+
+void pipeline_cache_prefetch(void)
+{
+    char path[4096];
+    if (cache_dir_path(PIPELINE_CACHE_FILE_NAME, path, sizeof(path))) {
+        asset_prefetch(path);
+    }
+}
+
+VkResult pipeline_cache_init(
+    VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache* pipelineCache)
+{
+    VkResult result;
+    uint64_t startNs = timer_now_ns();
+
+    AssetView file = { 0 };
+    size_t dataSize = 0;
+
+    char path[4096];
+    if (cache_dir_path(PIPELINE_CACHE_FILE_NAME, path, sizeof(path))
+        && pipeline_cache_read(path, &file)
+        && pipeline_cache_validate(physicalDevice, file.data, file.size)) {
+        dataSize = file.size;
+    }
+
+    // The driver copies what it needs, the mapping can go right after
+    VkPipelineCacheCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = dataSize,
+        .pInitialData = dataSize > 0 ? file.data : NULL };
+
+    result = vkCreatePipelineCache(device, &createInfo, NULL, pipelineCache);
+    asset_release(&file);
+
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create pipeline cache: %d", result);
+        return result;
+    }
+
+    if (dataSize > 0) {
+        LOG_INFO("Pipeline cache hit: loaded %zu bytes in %.3f ms",
+            dataSize,
+            timer_ns_to_ms(timer_now_ns() - startNs));
+    } else {
+        LOG_INFO("Empty pipeline cache created in %.3f ms",
+            timer_ns_to_ms(timer_now_ns() - startNs));
+    }
+
+    return result;
+}
+
+static void pipeline_cache_save(VkDevice device, VkPipelineCache pipelineCache)
+{
+    VkResult result;
+
+    char path[4096];
+    char tmpPath[4096 + 32];
+    if (!cache_dir_path(PIPELINE_CACHE_FILE_NAME, path, sizeof(path))) {
+        return;
+    }
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%ld.tmp", path, (long)getpid());
+
+    size_t dataSize = 0;
+    result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, NULL);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to get pipeline cache size: %d", result);
+        return;
+    }
+    if (dataSize == 0) {
+        LOG_DEBUG("Pipeline cache is empty, not saving it");
+        return;
+    }
+
+    void* data = malloc(dataSize);
+    if (data == NULL) {
+        LOG_ERROR("Failed to allocate %zu bytes for the pipeline cache", dataSize);
+        return;
+    }
+
+    result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, data);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to get pipeline cache data: %d", result);
+        free(data);
+        return;
+    }
+
+    // Write to a temporary file and rename over the old one, so a crash or a concurrent
+    // instance never leaves a truncated cache behind
+    FILE* fp = fopen(tmpPath, "wb");
+    if (fp == NULL) {
+        LOG_ERROR("Could not open %s for writing: %s", tmpPath, strerror(errno));
+        free(data);
+        return;
+    }
+
+    bool written = fwrite(data, 1, dataSize, fp) == dataSize && fflush(fp) == 0
+        && fsync(fileno(fp)) == 0;
+    written = (fclose(fp) == 0) && written;
+    free(data);
+
+    if (!written || rename(tmpPath, path) != 0) {
+        LOG_ERROR("Could not write pipeline cache %s: %s", path, strerror(errno));
+        unlink(tmpPath);
+        return;
+    }
+
+    LOG_INFO("Pipeline cache saved: %zu bytes to %s", dataSize, path);
+}
+
+void pipeline_cache_deinit(VkDevice device, VkPipelineCache pipelineCache)
+{
+    if (pipelineCache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    pipeline_cache_save(device, pipelineCache);
+    vkDestroyPipelineCache(device, pipelineCache, NULL);
+}
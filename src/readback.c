@@ -0,0 +1,171 @@
+#include "readback.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+VkResult readback_init(
+    Readback* readback, GpuMemory* gpuMemory, VkExtent2D extent, VkFormat format)
+{
+    VkResult result;
+
+    readback->extent = extent;
+    readback->format = format;
+
+    VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = (VkDeviceSize)extent.width * extent.height * 4,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE };
+
+    result = gpu_memory_create_buffer(gpuMemory,
+        &bufferInfo,
+        GPU_MEMORY_USAGE_GPU_TO_CPU,
+        &readback->buffer,
+        &readback->allocation);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create readback buffer: %d", result);
+        return result;
+    }
+
+    return result;
+}
+
+void readback_record(Readback* readback,
+    const Sync2* sync2,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageLayout layout)
+{
+    VkImageSubresourceRange range = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1 };
+
+    VkImageMemoryBarrier2 toTransfer = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+        .oldLayout = layout,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = range };
+
+    sync2_image_barrier(sync2, commandBuffer, &toTransfer);
+
+    VkBufferImageCopy region = { .bufferOffset = 0,
+        .imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1 },
+        .imageExtent = { readback->extent.width, readback->extent.height, 1 } };
+
+    vkCmdCopyImageToBuffer(commandBuffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        readback->buffer,
+        1,
+        &region);
+
+    VkBufferMemoryBarrier2 toHost = { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+        .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = readback->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE };
+
+    // Nothing later in the submission touches the image, the second scope is empty
+    VkImageMemoryBarrier2 toOriginal = toTransfer;
+    toOriginal.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    toOriginal.srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+    toOriginal.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    toOriginal.dstAccessMask = VK_ACCESS_2_NONE;
+    toOriginal.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toOriginal.newLayout = layout;
+
+    VkDependencyInfo dependencyInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers = &toHost,
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers = &toOriginal };
+
+    sync2_pipeline_barrier(sync2, commandBuffer, &dependencyInfo);
+}
+
+bool readback_write_ppm(Readback* readback, GpuMemory* gpuMemory, const char* path)
+{
+    bool swapRedBlue;
+    switch (readback->format) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        swapRedBlue = true;
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        swapRedBlue = false;
+        break;
+    default:
+        LOG_ERROR("Cannot write format %d as PPM", readback->format);
+        return false;
+    }
+
+    if (gpu_memory_invalidate(gpuMemory, &readback->allocation) != VK_SUCCESS) {
+        return false;
+    }
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        LOG_ERROR("Could not open %s for writing", path);
+        return false;
+    }
+
+    uint32_t width = readback->extent.width;
+    uint32_t height = readback->extent.height;
+
+    uint8_t* row = malloc((size_t)width * 3);
+    if (row == NULL) {
+        LOG_ERROR("Failed to allocate PPM row");
+        fclose(fp);
+        return false;
+    }
+
+    fprintf(fp, "P6\n%u %u\n255\n", width, height);
+
+    // sRGB formats already hold encoded values, which is what PPM viewers expect
+    const uint8_t* pixels = readback->allocation.mapped;
+    bool ok = true;
+    for (uint32_t y = 0; y < height && ok; y++) {
+        const uint8_t* src = pixels + (size_t)y * width * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            row[x * 3 + 0] = src[x * 4 + (swapRedBlue ? 2 : 0)];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + (swapRedBlue ? 0 : 2)];
+        }
+        ok = fwrite(row, 3, width, fp) == width;
+    }
+
+    free(row);
+    if (fclose(fp) != 0 || !ok) {
+        LOG_ERROR("Failed to write %s", path);
+        return false;
+    }
+
+    LOG_INFO("Wrote %ux%u frame to %s", width, height, path);
+    return true;
+}
+
+void readback_deinit(Readback* readback, GpuMemory* gpuMemory)
+{
+    if (readback->buffer != VK_NULL_HANDLE) {
+        gpu_memory_destroy_buffer(gpuMemory, readback->buffer, &readback->allocation);
+        readback->buffer = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,287 @@
+#include "shader_reload.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "cache_dir.h"
+#include "log.h"
+#include "shaders.h"
+#include "timer.h"
+
+// Editors tend to write a file in several steps, rebuild once they have been quiet this long
+#define SHADER_RELOAD_SETTLE_MS 50
+// How often the watcher thread checks whether it should stop
+#define SHADER_RELOAD_STOP_POLL_MS 100
+
+extern char** environ;
+
+static const ShaderId reloadedShaders[] = { SHADER_TRIANGLE_VERT, SHADER_TRIANGLE_FRAG };
+#define RELOADED_SHADER_COUNT (sizeof(reloadedShaders) / sizeof(reloadedShaders[0]))
+
+// The source is the SPIR-V file name without ".spv", e.g. "shader.vert"
+static size_t source_name_length(ShaderId id) { return strlen(shader_file_name(id)) - 4; }
+
+static bool is_reloaded_source(const char* name)
+{
+    for (uint32_t i = 0; i < RELOADED_SHADER_COUNT; i++) {
+        size_t length = source_name_length(reloadedShaders[i]);
+        if (strncmp(name, shader_file_name(reloadedShaders[i]), length) == 0
+            && name[length] == '\0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compiles into the cache directory, renaming over the previous output so the asset cache never
+// sees a partially written file
+static bool compile_shader(ShaderId id, char* spvPath, size_t spvPathSize)
+{
+    char sourcePath[4096];
+    char tmpPath[4096 + 32];
+    snprintf(sourcePath,
+        sizeof(sourcePath),
+        "%s/%.*s",
+        YACW_SHADER_SOURCE_DIR,
+        (int)source_name_length(id),
+        shader_file_name(id));
+
+    if (!cache_dir_path(shader_file_name(id), spvPath, spvPathSize)) {
+        return false;
+    }
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%ld.tmp", spvPath, (long)getpid());
+
+    char* argv[] = { YACW_GLSLC_EXECUTABLE, sourcePath, "-o", tmpPath, NULL };
+
+    // glslc reports compile errors on the inherited stderr
+    pid_t pid;
+    int error = posix_spawn(&pid, YACW_GLSLC_EXECUTABLE, NULL, NULL, argv, environ);
+    if (error != 0) {
+        LOG_ERROR("Could not run %s: %s", YACW_GLSLC_EXECUTABLE, strerror(error));
+        return false;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            LOG_ERROR("Could not wait for glslc: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        LOG_ERROR("Failed to compile %s, keeping the current pipeline", sourcePath);
+        unlink(tmpPath);
+        return false;
+    }
+
+    if (rename(tmpPath, spvPath) != 0) {
+        LOG_ERROR("Could not write %s: %s", spvPath, strerror(errno));
+        unlink(tmpPath);
+        return false;
+    }
+
+    return true;
+}
+
+static VkPipeline build_pipeline(ShaderReload* reload)
+{
+    VkShaderModule modules[RELOADED_SHADER_COUNT] = { VK_NULL_HANDLE };
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    uint64_t startNs = timer_now_ns();
+    for (uint32_t i = 0; i < RELOADED_SHADER_COUNT; i++) {
+        char spvPath[4096];
+        if (!compile_shader(reloadedShaders[i], spvPath, sizeof(spvPath))
+            || create_shader_module(reload->device, spvPath, &modules[i]) != VK_SUCCESS) {
+            goto cleanup;
+        }
+    }
+
+    if (create_graphics_pipeline(reload->device,
+            reload->pipelineCache,
+            &reload->target,
+            reload->pipelineLayout,
+            modules[0],
+            modules[1],
+            &pipeline)
+        != VK_SUCCESS) {
+        pipeline = VK_NULL_HANDLE;
+        goto cleanup;
+    }
+    LOG_INFO("Shaders reloaded in %.3f ms", timer_ns_to_ms(timer_now_ns() - startNs));
+
+cleanup:
+    for (uint32_t i = 0; i < RELOADED_SHADER_COUNT; i++) {
+        if (modules[i] != VK_NULL_HANDLE) {
+            vkDestroyShaderModule(reload->device, modules[i], NULL);
+        }
+    }
+    return pipeline;
+}
+
+static void publish(ShaderReload* reload, VkPipeline pipeline)
+{
+    pthread_mutex_lock(&reload->mutex);
+    VkPipeline superseded = reload->ready;
+    reload->ready = pipeline;
+    pthread_mutex_unlock(&reload->mutex);
+
+    // The render thread never saw it
+    if (superseded != VK_NULL_HANDLE) {
+        vkDestroyPipeline(reload->device, superseded, NULL);
+    }
+
+    if (reload->onReady != NULL) {
+        reload->onReady(reload->onReadyArg);
+    }
+}
+
+// Returns whether any of the reloaded sources was written
+static bool read_events(ShaderReload* reload)
+{
+    // Aligned for the struct inotify_event at its start
+    _Alignas(struct inotify_event) char buffer[4096];
+    bool changed = false;
+
+    for (;;) {
+        ssize_t length = read(reload->inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (char* at = buffer; at < buffer + length;) {
+            struct inotify_event* event = (struct inotify_event*)at;
+            if (event->len > 0 && is_reloaded_source(event->name)) {
+                changed = true;
+            }
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+static void* watch_thread(void* arg)
+{
+    ShaderReload* reload = arg;
+    bool pending = false;
+
+    while (!atomic_load_explicit(&reload->stop, memory_order_relaxed)) {
+        struct pollfd pfd = { .fd = reload->inotifyFd, .events = POLLIN };
+        int timeoutMs = pending ? SHADER_RELOAD_SETTLE_MS : SHADER_RELOAD_STOP_POLL_MS;
+
+        int ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("Polling the shader watch failed: %s", strerror(errno));
+            break;
+        }
+
+        if (ready > 0) {
+            pending = read_events(reload) || pending;
+        } else if (ready == 0 && pending) {
+            pending = false;
+
+            VkPipeline pipeline = build_pipeline(reload);
+            if (pipeline != VK_NULL_HANDLE) {
+                publish(reload, pipeline);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+VkResult shader_reload_init(ShaderReload* reload,
+    VkDevice device,
+    VkPipelineCache pipelineCache,
+    const RenderTarget* target,
+    VkPipelineLayout pipelineLayout,
+    ShaderReloadReadyFn onReady,
+    void* onReadyArg)
+{
+    *reload = (ShaderReload) { .device = device,
+        .pipelineCache = pipelineCache,
+        .target = *target,
+        .pipelineLayout = pipelineLayout,
+        .onReady = onReady,
+        .onReadyArg = onReadyArg,
+        .inotifyFd = -1 };
+
+    if (pthread_mutex_init(&reload->mutex, NULL) != 0) {
+        LOG_ERROR("Failed to create shader reload mutex");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    reload->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reload->inotifyFd < 0) {
+        LOG_WARN("Shader hot reload disabled, inotify failed: %s", strerror(errno));
+        return VK_SUCCESS;
+    }
+
+    // Editors either rewrite the file or rename a new one over it
+    if (inotify_add_watch(reload->inotifyFd, YACW_SHADER_SOURCE_DIR, IN_CLOSE_WRITE | IN_MOVED_TO)
+        < 0) {
+        LOG_WARN("Shader hot reload disabled, could not watch %s: %s",
+            YACW_SHADER_SOURCE_DIR,
+            strerror(errno));
+        close(reload->inotifyFd);
+        reload->inotifyFd = -1;
+        return VK_SUCCESS;
+    }
+
+    if (pthread_create(&reload->thread, NULL, watch_thread, reload) != 0) {
+        LOG_WARN("Shader hot reload disabled, could not start the watcher thread");
+        close(reload->inotifyFd);
+        reload->inotifyFd = -1;
+        return VK_SUCCESS;
+    }
+    reload->threadStarted = true;
+
+    LOG_INFO("Watching %s for shader changes", YACW_SHADER_SOURCE_DIR);
+    return VK_SUCCESS;
+}
+
+VkPipeline shader_reload_take(ShaderReload* reload)
+{
+    pthread_mutex_lock(&reload->mutex);
+    VkPipeline pipeline = reload->ready;
+    reload->ready = VK_NULL_HANDLE;
+    pthread_mutex_unlock(&reload->mutex);
+
+    return pipeline;
+}
+
+void shader_reload_deinit(ShaderReload* reload)
+{
+    if (reload->device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    if (reload->threadStarted) {
+        atomic_store_explicit(&reload->stop, true, memory_order_relaxed);
+        pthread_join(reload->thread, NULL);
+        reload->threadStarted = false;
+    }
+
+    if (reload->inotifyFd >= 0) {
+        close(reload->inotifyFd);
+        reload->inotifyFd = -1;
+    }
+
+    if (reload->ready != VK_NULL_HANDLE) {
+        vkDestroyPipeline(reload->device, reload->ready, NULL);
+        reload->ready = VK_NULL_HANDLE;
+    }
+
+    pthread_mutex_destroy(&reload->mutex);
+    reload->device = VK_NULL_HANDLE;
+}
@@ -0,0 +1,93 @@
+#include "shaders.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app.h"
+#include "asset.h"
+#include "log.h"
+
+// glslc -mfmt=c emits the words as an initializer list, see CMakeLists.txt
+static const uint32_t triangleVert[] =
+#include "shader.vert.inc"
+    ;
+
+static const uint32_t triangleFrag[] =
+#include "shader.frag.inc"
+    ;
+
+static const uint32_t uiVert[] =
+#include "ui.vert.inc"
+    ;
+
+static const uint32_t uiFrag[] =
+#include "ui.frag.inc"
+    ;
+
+static const struct {
+    const uint32_t* code;
+    size_t size;
+    const char* fileName;
+} shaders[SHADER_COUNT] = {
+    [SHADER_TRIANGLE_VERT] = { triangleVert, sizeof(triangleVert), "shader.vert.spv" },
+    [SHADER_TRIANGLE_FRAG] = { triangleFrag, sizeof(triangleFrag), "shader.frag.spv" },
+    [SHADER_UI_VERT] = { uiVert, sizeof(uiVert), "ui.vert.spv" },
+    [SHADER_UI_FRAG] = { uiFrag, sizeof(uiFrag), "ui.frag.spv" },
+};
+
+ShaderCode shader_code(ShaderId id)
+{
+    return (ShaderCode) { .code = shaders[id].code, .size = shaders[id].size };
+}
+
+const char* shader_file_name(ShaderId id) { return shaders[id].fileName; }
+
+// Opt-in override for iterating on shaders without relinking
+static bool override_path(ShaderId id, char* path, size_t pathSize)
+{
+    const char* shaderDir = getenv("YACW_SHADER_DIR");
+    if (shaderDir == NULL || shaderDir[0] == '\0') {
+        return false;
+    }
+
+    snprintf(path, pathSize, "%s/%s", shaderDir, shaders[id].fileName);
+    return true;
+}
+
+void shader_prefetch(void)
+{
+    char path[4096];
+    for (ShaderId id = 0; id < SHADER_COUNT; id++) {
+        if (override_path(id, path, sizeof(path))) {
+            asset_prefetch(path);
+        }
+    }
+}
+
+VkResult shader_create_module(VkDevice device, ShaderId id, VkShaderModule* shaderModule)
+{
+    VkResult result;
+
+    char path[4096];
+    if (override_path(id, path, sizeof(path))) {
+        LOG_INFO("Loading shader %s from YACW_SHADER_DIR", path);
+
+        return create_shader_module(device, path, shaderModule);
+    }
+
+    VkShaderModuleCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = shaders[id].size,
+        .pCode = shaders[id].code };
+
+    result = vkCreateShaderModule(device, &createInfo, NULL, shaderModule);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create shader module %s: %d", shaders[id].fileName, result);
+        return result;
+    }
+    LOG_DEBUG("Shader module %s created from %zu embedded bytes",
+        shaders[id].fileName,
+        shaders[id].size);
+
+    return result;
+}
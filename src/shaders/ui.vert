@@ -0,0 +1,28 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    vec2 scale;
+    vec2 translate;
+} pc;
+
+// Set from the color attachment format by nk_vulkan_create_pipeline
+layout(constant_id = 0) const bool srgbTarget = true;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inUv;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+    fragUv = inUv;
+
+    // Nuklear colors are sRGB encoded. An sRGB attachment expects linear values and encodes them
+    // again on write, a UNORM one stores the encoded values as they are.
+    vec3 color = srgbTarget ? pow(inColor.rgb, vec3(2.2)) : inColor.rgb;
+    fragColor = vec4(color, inColor.a);
+
+    // Pixel coordinates to clip space
+    gl_Position = vec4(inPosition * pc.scale + pc.translate, 0.0, 1.0);
+}
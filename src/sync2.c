@@ -0,0 +1,200 @@
+#include "sync2.h"
+
+#include "device_select.h"
+#include "log.h"
+
+Sync2Support sync2_support(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    Sync2Support support = SYNC2_NONE;
+    if (properties.apiVersion >= VK_API_VERSION_1_3) {
+        support = SYNC2_CORE;
+    } else if (device_has_extension(physicalDevice, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+        support = SYNC2_EXTENSION;
+    } else {
+        return SYNC2_NONE;
+    }
+
+    VkPhysicalDeviceSynchronization2Features synchronization2Features
+        = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES };
+    VkPhysicalDeviceFeatures2 features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &synchronization2Features };
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    return synchronization2Features.synchronization2 ? support : SYNC2_NONE;
+}
+
+bool sync2_init(Sync2* sync2, VkDevice device, Sync2Support support)
+{
+    *sync2 = (Sync2) { 0 };
+    if (support == SYNC2_NONE) {
+        return true;
+    }
+
+    bool core = support == SYNC2_CORE;
+    PFN_vkQueueSubmit2 queueSubmit2 = (PFN_vkQueueSubmit2)vkGetDeviceProcAddr(
+        device, core ? "vkQueueSubmit2" : "vkQueueSubmit2KHR");
+    PFN_vkCmdPipelineBarrier2 pipelineBarrier2 = (PFN_vkCmdPipelineBarrier2)vkGetDeviceProcAddr(
+        device, core ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR");
+    if (queueSubmit2 == NULL || pipelineBarrier2 == NULL) {
+        LOG_WARN("Synchronization2 entry points are missing");
+        return false;
+    }
+
+    *sync2 = (Sync2) { .queueSubmit2 = queueSubmit2, .pipelineBarrier2 = pipelineBarrier2 };
+    return true;
+}
+
+// An empty first scope only means waiting for nothing, and an empty second scope blocking
+// nothing, the original command spells those TOP_OF_PIPE and BOTTOM_OF_PIPE
+static void legacy_barrier(VkCommandBuffer commandBuffer,
+    VkDependencyFlags dependencyFlags,
+    VkPipelineStageFlags2 srcStageMask,
+    VkPipelineStageFlags2 dstStageMask,
+    const VkMemoryBarrier* memoryBarrier,
+    const VkBufferMemoryBarrier* bufferBarrier,
+    const VkImageMemoryBarrier* imageBarrier)
+{
+    vkCmdPipelineBarrier(commandBuffer,
+        srcStageMask != 0 ? (VkPipelineStageFlags)srcStageMask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        dstStageMask != 0 ? (VkPipelineStageFlags)dstStageMask
+                          : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        dependencyFlags,
+        memoryBarrier != NULL ? 1 : 0,
+        memoryBarrier,
+        bufferBarrier != NULL ? 1 : 0,
+        bufferBarrier,
+        imageBarrier != NULL ? 1 : 0,
+        imageBarrier);
+}
+
+void sync2_pipeline_barrier(
+    const Sync2* sync2, VkCommandBuffer commandBuffer, const VkDependencyInfo* dependencyInfo)
+{
+    if (sync2_enabled(sync2)) {
+        sync2->pipelineBarrier2(commandBuffer, dependencyInfo);
+        return;
+    }
+
+    VkDependencyFlags flags = dependencyInfo->dependencyFlags;
+
+    for (uint32_t i = 0; i < dependencyInfo->memoryBarrierCount; i++) {
+        const VkMemoryBarrier2* barrier = &dependencyInfo->pMemoryBarriers[i];
+        VkMemoryBarrier legacyBarrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = (VkAccessFlags)barrier->srcAccessMask,
+            .dstAccessMask = (VkAccessFlags)barrier->dstAccessMask };
+        legacy_barrier(commandBuffer,
+            flags,
+            barrier->srcStageMask,
+            barrier->dstStageMask,
+            &legacyBarrier,
+            NULL,
+            NULL);
+    }
+
+    for (uint32_t i = 0; i < dependencyInfo->bufferMemoryBarrierCount; i++) {
+        const VkBufferMemoryBarrier2* barrier = &dependencyInfo->pBufferMemoryBarriers[i];
+        VkBufferMemoryBarrier legacyBarrier = { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = (VkAccessFlags)barrier->srcAccessMask,
+            .dstAccessMask = (VkAccessFlags)barrier->dstAccessMask,
+            .srcQueueFamilyIndex = barrier->srcQueueFamilyIndex,
+            .dstQueueFamilyIndex = barrier->dstQueueFamilyIndex,
+            .buffer = barrier->buffer,
+            .offset = barrier->offset,
+            .size = barrier->size };
+        legacy_barrier(commandBuffer,
+            flags,
+            barrier->srcStageMask,
+            barrier->dstStageMask,
+            NULL,
+            &legacyBarrier,
+            NULL);
+    }
+
+    for (uint32_t i = 0; i < dependencyInfo->imageMemoryBarrierCount; i++) {
+        const VkImageMemoryBarrier2* barrier = &dependencyInfo->pImageMemoryBarriers[i];
+        VkImageMemoryBarrier legacyBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = (VkAccessFlags)barrier->srcAccessMask,
+            .dstAccessMask = (VkAccessFlags)barrier->dstAccessMask,
+            .oldLayout = barrier->oldLayout,
+            .newLayout = barrier->newLayout,
+            .srcQueueFamilyIndex = barrier->srcQueueFamilyIndex,
+            .dstQueueFamilyIndex = barrier->dstQueueFamilyIndex,
+            .image = barrier->image,
+            .subresourceRange = barrier->subresourceRange };
+        legacy_barrier(commandBuffer,
+            flags,
+            barrier->srcStageMask,
+            barrier->dstStageMask,
+            NULL,
+            NULL,
+            &legacyBarrier);
+    }
+}
+
+void sync2_image_barrier(
+    const Sync2* sync2, VkCommandBuffer commandBuffer, const VkImageMemoryBarrier2* barrier)
+{
+    VkDependencyInfo dependencyInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers = barrier };
+    sync2_pipeline_barrier(sync2, commandBuffer, &dependencyInfo);
+}
+
+VkResult sync2_queue_submit(
+    const Sync2* sync2, VkQueue queue, const VkSubmitInfo2* submit, VkFence fence)
+{
+    if (sync2_enabled(sync2)) {
+        return sync2->queueSubmit2(queue, 1, submit, fence);
+    }
+
+    if (submit->waitSemaphoreInfoCount > SYNC2_MAX_SEMAPHORES
+        || submit->signalSemaphoreInfoCount > SYNC2_MAX_SEMAPHORES
+        || submit->commandBufferInfoCount > SYNC2_MAX_COMMAND_BUFFERS) {
+        LOG_ERROR("Submission too large to translate without synchronization2");
+        return VK_RESULT_MAX_ENUM;
+    }
+
+    VkSemaphore waitSemaphores[SYNC2_MAX_SEMAPHORES];
+    VkPipelineStageFlags waitStages[SYNC2_MAX_SEMAPHORES];
+    uint64_t waitValues[SYNC2_MAX_SEMAPHORES];
+    for (uint32_t i = 0; i < submit->waitSemaphoreInfoCount; i++) {
+        waitSemaphores[i] = submit->pWaitSemaphoreInfos[i].semaphore;
+        waitStages[i] = (VkPipelineStageFlags)submit->pWaitSemaphoreInfos[i].stageMask;
+        waitValues[i] = submit->pWaitSemaphoreInfos[i].value;
+    }
+
+    VkSemaphore signalSemaphores[SYNC2_MAX_SEMAPHORES];
+    uint64_t signalValues[SYNC2_MAX_SEMAPHORES];
+    for (uint32_t i = 0; i < submit->signalSemaphoreInfoCount; i++) {
+        signalSemaphores[i] = submit->pSignalSemaphoreInfos[i].semaphore;
+        signalValues[i] = submit->pSignalSemaphoreInfos[i].value;
+    }
+
+    VkCommandBuffer commandBuffers[SYNC2_MAX_COMMAND_BUFFERS];
+    for (uint32_t i = 0; i < submit->commandBufferInfoCount; i++) {
+        commandBuffers[i] = submit->pCommandBufferInfos[i].commandBuffer;
+    }
+
+    // Values of binary semaphores are ignored
+    VkTimelineSemaphoreSubmitInfo timelineInfo
+        = { .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+              .waitSemaphoreValueCount = submit->waitSemaphoreInfoCount,
+              .pWaitSemaphoreValues = waitValues,
+              .signalSemaphoreValueCount = submit->signalSemaphoreInfoCount,
+              .pSignalSemaphoreValues = signalValues };
+
+    VkSubmitInfo submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineInfo,
+        .waitSemaphoreCount = submit->waitSemaphoreInfoCount,
+        .pWaitSemaphores = waitSemaphores,
+        .pWaitDstStageMask = waitStages,
+        .commandBufferCount = submit->commandBufferInfoCount,
+        .pCommandBuffers = commandBuffers,
+        .signalSemaphoreCount = submit->signalSemaphoreInfoCount,
+        .pSignalSemaphores = signalSemaphores };
+
+    return vkQueueSubmit(queue, 1, &submitInfo, fence);
+}
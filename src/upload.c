@@ -0,0 +1,560 @@
+#include "upload.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+// Covers the texel size of every format uploaded so far and the 4 byte copy offset rule
+#define UPLOAD_STAGING_ALIGNMENT 16
+
+static bool barriers_reserve(void** array, uint32_t* capacity, uint32_t count, size_t elementSize)
+{
+    if (count < *capacity) {
+        return true;
+    }
+
+    uint32_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void* grown = realloc(*array, newCapacity * elementSize);
+    if (grown == NULL) {
+        LOG_ERROR("Failed to grow upload barrier array");
+        return false;
+    }
+
+    *array = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+static VkResult wait_timeline(UploadCtx* upload, uint64_t value)
+{
+    VkSemaphoreWaitInfo waitInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &upload->timeline,
+        .pValues = &value };
+
+    VkResult result = vkWaitSemaphores(upload->device, &waitInfo, UINT64_MAX);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to wait for upload timeline value %llu: %d",
+            (unsigned long long)value,
+            result);
+    }
+
+    return result;
+}
+
+// Moves the staging tail past every batch the GPU has finished with
+static void reclaim_staging(UploadCtx* upload)
+{
+    uint64_t completed = 0;
+    if (vkGetSemaphoreCounterValue(upload->device, upload->timeline, &completed) != VK_SUCCESS) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+        UploadBatch* batch = &upload->batches[i];
+        if (batch->timelineValue != 0 && batch->timelineValue <= completed
+            && batch->stagingEnd > upload->stagingTail) {
+            upload->stagingTail = batch->stagingEnd;
+        }
+    }
+}
+
+// Oldest batch the GPU is still working on, 0 if all are done
+static uint64_t oldest_pending_value(UploadCtx* upload)
+{
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(upload->device, upload->timeline, &completed);
+
+    uint64_t oldest = 0;
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+        uint64_t value = upload->batches[i].timelineValue;
+        if (value > completed && (oldest == 0 || value < oldest)) {
+            oldest = value;
+        }
+    }
+
+    return oldest;
+}
+
+static VkResult stage(UploadCtx* upload, const void* data, VkDeviceSize size, VkDeviceSize* offset)
+{
+    if (size > UPLOAD_STAGING_SIZE) {
+        LOG_ERROR("Upload of %llu bytes exceeds the %llu byte staging ring",
+            (unsigned long long)size,
+            (unsigned long long)UPLOAD_STAGING_SIZE);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    for (;;) {
+        reclaim_staging(upload);
+
+        VkDeviceSize start = (upload->stagingHead + UPLOAD_STAGING_ALIGNMENT - 1)
+            & ~(VkDeviceSize)(UPLOAD_STAGING_ALIGNMENT - 1);
+
+        // Copies never wrap, skip the remainder of the ring instead
+        VkDeviceSize position = start % UPLOAD_STAGING_SIZE;
+        if (position + size > UPLOAD_STAGING_SIZE) {
+            start += UPLOAD_STAGING_SIZE - position;
+            position = 0;
+        }
+
+        if (start + size - upload->stagingTail <= UPLOAD_STAGING_SIZE) {
+            memcpy((uint8_t*)upload->stagingAllocation.mapped + position, data, size);
+            upload->stagingHead = start + size;
+            *offset = position;
+            return VK_SUCCESS;
+        }
+
+        // Ring is full: hand what is recorded so far to the GPU and wait for the oldest batch
+        VkResult result = upload_flush(upload);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+
+        uint64_t oldest = oldest_pending_value(upload);
+        if (oldest == 0) {
+            LOG_ERROR("Upload staging ring is full with no batch in flight");
+            return VK_RESULT_MAX_ENUM;
+        }
+
+        result = wait_timeline(upload, oldest);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+    }
+}
+
+static VkResult begin_batch(UploadCtx* upload)
+{
+    if (upload->recording) {
+        return VK_SUCCESS;
+    }
+
+    UploadBatch* batch = &upload->batches[upload->currentBatch];
+
+    // The command buffer may still be executing from UPLOAD_BATCH_COUNT flushes ago
+    if (batch->timelineValue != 0) {
+        VkResult result = wait_timeline(upload, batch->timelineValue);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+    }
+
+    VkResult result = vkResetCommandBuffer(batch->commandBuffer, 0);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to reset upload command buffer: %d", result);
+        return result;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+
+    result = vkBeginCommandBuffer(batch->commandBuffer, &beginInfo);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to begin upload command buffer: %d", result);
+        return result;
+    }
+
+    upload->recording = true;
+    upload->copyCount = 0;
+    return VK_SUCCESS;
+}
+
+static bool needs_ownership_transfer(const UploadCtx* upload)
+{
+    return upload->transferQueueFamilyIndex != upload->graphicsQueueFamilyIndex;
+}
+
+VkResult upload_init(UploadCtx* upload,
+    VkDevice device,
+    GpuMemory* gpuMemory,
+    VkQueue queue,
+    uint32_t transferQueueFamilyIndex,
+    uint32_t graphicsQueueFamilyIndex)
+{
+    VkResult result;
+
+    upload->device = device;
+    upload->gpuMemory = gpuMemory;
+    upload->queue = queue;
+    upload->transferQueueFamilyIndex = transferQueueFamilyIndex;
+    upload->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+    upload->nextTimelineValue = 1;
+
+    VkCommandPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+            | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = transferQueueFamilyIndex };
+
+    result = vkCreateCommandPool(device, &poolInfo, NULL, &upload->commandPool);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create upload command pool: %d", result);
+        return result;
+    }
+
+    VkCommandBuffer commandBuffers[UPLOAD_BATCH_COUNT];
+    VkCommandBufferAllocateInfo allocInfo
+        = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+              .commandPool = upload->commandPool,
+              .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+              .commandBufferCount = UPLOAD_BATCH_COUNT };
+
+    result = vkAllocateCommandBuffers(device, &allocInfo, commandBuffers);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to allocate upload command buffers: %d", result);
+        return result;
+    }
+
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+        upload->batches[i] = (UploadBatch) { .commandBuffer = commandBuffers[i] };
+    }
+
+    VkSemaphoreTypeCreateInfo timelineInfo
+        = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+              .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+              .initialValue = 0 };
+    VkSemaphoreCreateInfo semaphoreInfo
+        = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &timelineInfo };
+
+    result = vkCreateSemaphore(device, &semaphoreInfo, NULL, &upload->timeline);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create upload timeline semaphore: %d", result);
+        return result;
+    }
+
+    VkBufferCreateInfo stagingInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = UPLOAD_STAGING_SIZE,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE };
+
+    result = gpu_memory_create_buffer(gpuMemory,
+        &stagingInfo,
+        GPU_MEMORY_USAGE_CPU_TO_GPU,
+        &upload->stagingBuffer,
+        &upload->stagingAllocation);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create upload staging ring: %d", result);
+        return result;
+    }
+
+    LOG_INFO("Upload engine on queue family %u (graphics %u), %llu MiB staging ring",
+        transferQueueFamilyIndex,
+        graphicsQueueFamilyIndex,
+        (unsigned long long)(UPLOAD_STAGING_SIZE >> 20));
+
+    return result;
+}
+
+VkResult upload_buffer(UploadCtx* upload,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    const void* data,
+    VkDeviceSize size,
+    VkPipelineStageFlags dstStageMask,
+    VkAccessFlags dstAccessMask)
+{
+    VkResult result;
+
+    VkDeviceSize stagingOffset;
+    result = stage(upload, data, size, &stagingOffset);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = begin_batch(upload);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    VkCommandBuffer commandBuffer = upload->batches[upload->currentBatch].commandBuffer;
+
+    VkBufferCopy region = { .srcOffset = stagingOffset, .dstOffset = offset, .size = size };
+    vkCmdCopyBuffer(commandBuffer, upload->stagingBuffer, buffer, 1, &region);
+    upload->copyCount++;
+
+    // Within one family the timeline wait alone makes the copy visible
+    if (needs_ownership_transfer(upload)) {
+        if (!barriers_reserve((void**)&upload->recordingBuffers,
+                &upload->recordingBufferCapacity,
+                upload->recordingBufferCount,
+                sizeof(VkBufferMemoryBarrier))) {
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+
+        upload->recordingBuffers[upload->recordingBufferCount++]
+            = (VkBufferMemoryBarrier) { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                  .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                  .dstAccessMask = 0,
+                  .srcQueueFamilyIndex = upload->transferQueueFamilyIndex,
+                  .dstQueueFamilyIndex = upload->graphicsQueueFamilyIndex,
+                  .buffer = buffer,
+                  .offset = offset,
+                  .size = size };
+    }
+
+    upload->recordingStageMask |= dstStageMask;
+    upload->recordingAccessMask |= dstAccessMask;
+
+    return result;
+}
+
+VkResult upload_image(UploadCtx* upload,
+    VkImage image,
+    VkExtent3D extent,
+    const void* data,
+    VkDeviceSize size,
+    VkImageLayout finalLayout,
+    VkPipelineStageFlags dstStageMask,
+    VkAccessFlags dstAccessMask)
+{
+    VkResult result;
+
+    VkDeviceSize stagingOffset;
+    result = stage(upload, data, size, &stagingOffset);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = begin_batch(upload);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    if (!barriers_reserve((void**)&upload->recordingImages,
+            &upload->recordingImageCapacity,
+            upload->recordingImageCount,
+            sizeof(VkImageMemoryBarrier))) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    VkCommandBuffer commandBuffer = upload->batches[upload->currentBatch].commandBuffer;
+
+    VkImageSubresourceRange range = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1 };
+
+    VkImageMemoryBarrier toTransfer = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = range };
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &toTransfer);
+
+    VkBufferImageCopy region = { .bufferOffset = stagingOffset,
+        .imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1 },
+        .imageExtent = extent };
+
+    vkCmdCopyBufferToImage(commandBuffer,
+        upload->stagingBuffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1,
+        &region);
+    upload->copyCount++;
+
+    // Release to the graphics family, or only the layout transition when there is one family
+    bool transfer = needs_ownership_transfer(upload);
+    upload->recordingImages[upload->recordingImageCount++]
+        = (VkImageMemoryBarrier) { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+              .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+              .dstAccessMask = 0,
+              .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+              .newLayout = finalLayout,
+              .srcQueueFamilyIndex
+              = transfer ? upload->transferQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED,
+              .dstQueueFamilyIndex
+              = transfer ? upload->graphicsQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED,
+              .image = image,
+              .subresourceRange = range };
+
+    upload->recordingStageMask |= dstStageMask;
+    upload->recordingAccessMask |= dstAccessMask;
+
+    return result;
+}
+
+VkResult upload_flush(UploadCtx* upload)
+{
+    VkResult result;
+
+    if (!upload->recording) {
+        return VK_SUCCESS;
+    }
+
+    UploadBatch* batch = &upload->batches[upload->currentBatch];
+
+    // All release barriers of the batch at once
+    if (upload->recordingBufferCount > 0 || upload->recordingImageCount > 0) {
+        vkCmdPipelineBarrier(batch->commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0,
+            NULL,
+            upload->recordingBufferCount,
+            upload->recordingBuffers,
+            upload->recordingImageCount,
+            upload->recordingImages);
+    }
+
+    result = vkEndCommandBuffer(batch->commandBuffer);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to end upload command buffer: %d", result);
+        return result;
+    }
+
+    uint64_t signalValue = upload->nextTimelineValue;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo
+        = { .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+              .signalSemaphoreValueCount = 1,
+              .pSignalSemaphoreValues = &signalValue };
+
+    VkSubmitInfo submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineInfo,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch->commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &upload->timeline };
+
+    result = vkQueueSubmit(upload->queue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to submit upload batch: %d", result);
+        return result;
+    }
+
+    upload->nextTimelineValue++;
+    batch->timelineValue = signalValue;
+    batch->stagingEnd = upload->stagingHead;
+
+    // The graphics side repeats each release as an acquire
+    if (needs_ownership_transfer(upload)) {
+        for (uint32_t i = 0; i < upload->recordingBufferCount; i++) {
+            if (!barriers_reserve((void**)&upload->pendingBuffers,
+                    &upload->pendingBufferCapacity,
+                    upload->pendingBufferCount,
+                    sizeof(VkBufferMemoryBarrier2))) {
+                return VK_ERROR_OUT_OF_HOST_MEMORY;
+            }
+
+            const VkBufferMemoryBarrier* release = &upload->recordingBuffers[i];
+            upload->pendingBuffers[upload->pendingBufferCount++]
+                = (VkBufferMemoryBarrier2) { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                      .srcStageMask = upload->recordingStageMask,
+                      .srcAccessMask = VK_ACCESS_2_NONE,
+                      .dstStageMask = upload->recordingStageMask,
+                      .dstAccessMask = upload->recordingAccessMask,
+                      .srcQueueFamilyIndex = release->srcQueueFamilyIndex,
+                      .dstQueueFamilyIndex = release->dstQueueFamilyIndex,
+                      .buffer = release->buffer,
+                      .offset = release->offset,
+                      .size = release->size };
+        }
+
+        for (uint32_t i = 0; i < upload->recordingImageCount; i++) {
+            if (!barriers_reserve((void**)&upload->pendingImages,
+                    &upload->pendingImageCapacity,
+                    upload->pendingImageCount,
+                    sizeof(VkImageMemoryBarrier2))) {
+                return VK_ERROR_OUT_OF_HOST_MEMORY;
+            }
+
+            const VkImageMemoryBarrier* release = &upload->recordingImages[i];
+            upload->pendingImages[upload->pendingImageCount++]
+                = (VkImageMemoryBarrier2) { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                      .srcStageMask = upload->recordingStageMask,
+                      .srcAccessMask = VK_ACCESS_2_NONE,
+                      .dstStageMask = upload->recordingStageMask,
+                      .dstAccessMask = upload->recordingAccessMask,
+                      .oldLayout = release->oldLayout,
+                      .newLayout = release->newLayout,
+                      .srcQueueFamilyIndex = release->srcQueueFamilyIndex,
+                      .dstQueueFamilyIndex = release->dstQueueFamilyIndex,
+                      .image = release->image,
+                      .subresourceRange = release->subresourceRange };
+        }
+    }
+
+    upload->waitValue = signalValue;
+    upload->waitStageMask |= upload->recordingStageMask;
+
+    upload->recordingBufferCount = 0;
+    upload->recordingImageCount = 0;
+    upload->recordingStageMask = 0;
+    upload->recordingAccessMask = 0;
+    upload->recording = false;
+    upload->currentBatch = (upload->currentBatch + 1) % UPLOAD_BATCH_COUNT;
+
+    return result;
+}
+
+uint64_t upload_record_acquire(UploadCtx* upload,
+    const Sync2* sync2,
+    VkCommandBuffer commandBuffer,
+    VkPipelineStageFlags* waitStageMask)
+{
+    uint64_t waitValue = upload->waitValue;
+    *waitStageMask = upload->waitStageMask;
+
+    // Chained to the semaphore wait through the same stages
+    if (upload->pendingBufferCount > 0 || upload->pendingImageCount > 0) {
+        VkDependencyInfo dependencyInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .bufferMemoryBarrierCount = upload->pendingBufferCount,
+            .pBufferMemoryBarriers = upload->pendingBuffers,
+            .imageMemoryBarrierCount = upload->pendingImageCount,
+            .pImageMemoryBarriers = upload->pendingImages };
+        sync2_pipeline_barrier(sync2, commandBuffer, &dependencyInfo);
+    }
+
+    upload->pendingBufferCount = 0;
+    upload->pendingImageCount = 0;
+    upload->waitValue = 0;
+    upload->waitStageMask = 0;
+
+    return waitValue;
+}
+
+void upload_deinit(UploadCtx* upload)
+{
+    if (upload->timeline != VK_NULL_HANDLE) {
+        if (upload->nextTimelineValue > 1) {
+            wait_timeline(upload, upload->nextTimelineValue - 1);
+        }
+        vkDestroySemaphore(upload->device, upload->timeline, NULL);
+    }
+
+    // Command buffers are freed together with their pool
+    if (upload->commandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(upload->device, upload->commandPool, NULL);
+    }
+
+    if (upload->stagingBuffer != VK_NULL_HANDLE) {
+        gpu_memory_destroy_buffer(
+            upload->gpuMemory, upload->stagingBuffer, &upload->stagingAllocation);
+    }
+
+    free(upload->recordingBuffers);
+    free(upload->recordingImages);
+    free(upload->pendingBuffers);
+    free(upload->pendingImages);
+}
@@ -0,0 +1,183 @@
+// Decodes a binary log written by log_open_binary into the same text lines the console shows
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log_binary.h"
+#include "log_format.h"
+
+typedef struct DecodedSite {
+    LogLevel level;
+    int line;
+    char* file;
+    char* fmt;
+} DecodedSite;
+
+static char* copy_string(const uint8_t* data, uint32_t length)
+{
+    char* string = malloc(length + 1);
+    if (string != NULL) {
+        memcpy(string, data, length);
+        string[length] = '\0';
+    }
+    return string;
+}
+
+static int decode(const uint8_t* data, size_t size, LogLevel minLevel)
+{
+    LogBinaryHeader header;
+    if (size < sizeof(header)) {
+        fprintf(stderr, "File too small for a binary log\n");
+        return 1;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, LOG_BINARY_MAGIC, sizeof(header.magic)) != 0
+        || header.version != LOG_BINARY_VERSION) {
+        fprintf(stderr, "Not a version %d binary log\n", LOG_BINARY_VERSION);
+        return 1;
+    }
+
+    DecodedSite* sites = NULL;
+    uint32_t siteCount = 0;
+    uint32_t siteCapacity = 0;
+
+    LogDateCache dateCache = LOG_DATE_CACHE_INIT;
+    char line[LOG_LINE_MAX];
+    int exitCode = 0;
+
+    size_t offset = sizeof(header);
+    while (offset + 2 * sizeof(uint32_t) <= size) {
+        uint32_t prefix[2];
+        memcpy(prefix, data + offset, sizeof(prefix));
+        uint32_t type = prefix[0];
+        uint32_t entrySize = prefix[1];
+
+        if (type == LOG_BINARY_END) {
+            break;
+        }
+        if (entrySize < sizeof(prefix) || offset + entrySize > size) {
+            fprintf(stderr, "Truncated entry at offset %zu\n", offset);
+            exitCode = 1;
+            break;
+        }
+
+        const uint8_t* entry = data + offset;
+        offset += entrySize;
+
+        if (type == LOG_BINARY_SITE && entrySize >= sizeof(LogBinarySite)) {
+            LogBinarySite site;
+            memcpy(&site, entry, sizeof(site));
+            if (site.id != siteCount
+                || sizeof(site) + (size_t)site.fileLength + site.fmtLength > entrySize) {
+                fprintf(stderr, "Corrupt call site %u\n", site.id);
+                exitCode = 1;
+                break;
+            }
+
+            if (siteCount == siteCapacity) {
+                siteCapacity = siteCapacity == 0 ? 64 : siteCapacity * 2;
+                DecodedSite* grown = realloc(sites, sizeof(DecodedSite) * siteCapacity);
+                if (grown == NULL) {
+                    fprintf(stderr, "Out of memory\n");
+                    exitCode = 1;
+                    break;
+                }
+                sites = grown;
+            }
+
+            sites[siteCount++] = (DecodedSite) { .level = (LogLevel)site.level,
+                .line = site.line,
+                .file = copy_string(entry + sizeof(site), site.fileLength),
+                .fmt = copy_string(entry + sizeof(site) + site.fileLength, site.fmtLength) };
+        } else if (type == LOG_BINARY_RECORD && entrySize >= sizeof(LogBinaryRecord)) {
+            LogBinaryRecord record;
+            memcpy(&record, entry, sizeof(record));
+            if (record.site >= siteCount || sizeof(record) + (size_t)record.argsSize > entrySize) {
+                fprintf(stderr, "Corrupt record at offset %zu\n", offset - entrySize);
+                exitCode = 1;
+                break;
+            }
+
+            DecodedSite* site = &sites[record.site];
+            if (site->level < minLevel || site->file == NULL || site->fmt == NULL) {
+                continue;
+            }
+
+            size_t length = log_format_line(&dateCache,
+                site->level,
+                site->file,
+                site->line,
+                record.timestampNs,
+                site->fmt,
+                entry + sizeof(record),
+                record.argsSize,
+                record.truncated,
+                line);
+            fwrite(line, 1, length, stdout);
+        }
+        // Unknown entry types are skipped using their size
+    }
+
+    for (uint32_t i = 0; i < siteCount; i++) {
+        free(sites[i].file);
+        free(sites[i].fmt);
+    }
+    free(sites);
+
+    return exitCode;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s LOG_FILE [MIN_LEVEL]\n", argv[0]);
+        fprintf(stderr, "  MIN_LEVEL is one of TRACE, DEBUG, INFO, WARN, ERROR (default TRACE)\n");
+        return 2;
+    }
+
+    LogLevel minLevel = LOG_LEVEL_TRACE;
+    if (argc == 3) {
+        LogLevel level = LOG_LEVEL_TRACE;
+        for (; level <= LOG_LEVEL_ERROR; level++) {
+            if (strcmp(argv[2], log_level_name(level)) == 0) {
+                break;
+            }
+        }
+        if (level > LOG_LEVEL_ERROR) {
+            fprintf(stderr, "Unknown level %s\n", argv[2]);
+            return 2;
+        }
+        minLevel = level;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Could not read %s\n", argv[1]);
+        close(fd);
+        return 1;
+    }
+
+    const uint8_t* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s\n", argv[1]);
+        return 1;
+    }
+
+    int exitCode = decode(data, (size_t)st.st_size, minLevel);
+
+    munmap((void*)data, (size_t)st.st_size);
+    return exitCode;
+}